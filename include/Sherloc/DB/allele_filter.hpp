@@ -0,0 +1,150 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <vector>
+#include <Sherloc/DB/db.hpp>
+
+namespace Sherloc::DB {
+
+/**
+ * @brief Stable 64 bit hash of an allele key, (kind, position, allele bases)
+ *
+ * It is stored in the database files, so it must not depend on the standard library.
+ */
+inline uint64_t allele_key_hash(char kind, uint32_t pos, std::string_view allele){
+  // FNV-1a, then the splitmix64 finalizer to spread the bits
+  auto hash = uint64_t{0xcbf29ce484222325};
+  auto mix_byte = [&hash](uint8_t byte){
+    hash ^= byte;
+    hash *= uint64_t{0x100000001b3};
+  };
+  mix_byte(static_cast<uint8_t>(kind));
+  for(int shift = 0; shift < 32; shift += 8){
+    mix_byte(static_cast<uint8_t>(pos >> shift));
+  }
+  for(auto base : allele){
+    mix_byte(static_cast<uint8_t>(base));
+  }
+  hash ^= hash >> 30;
+  hash *= uint64_t{0xbf58476d1ce4e5b9};
+  hash ^= hash >> 27;
+  hash *= uint64_t{0x94d049bb133111eb};
+  hash ^= hash >> 31;
+  return hash;
+}
+
+/**
+ * @brief Blocked Bloom filter of the allele keys of a chromosome, one filter per chunk
+ *
+ * A key sets `probes` bits in one 512 bit block (a cache line), so a query touches one
+ * cache line. With `bits_per_key` = 10 the false positive rate is about 1%. A chunk without
+ * alleles (or not built) has no block and never matches.
+ */
+class AlleleFilter {
+public:
+  static constexpr size_t bits_per_key = 10;
+  static constexpr size_t probes = 7;
+  static constexpr size_t block_words = 8;
+
+private:
+  FlatArray<uint64_t> words;        // the blocks of all chunks
+  FlatArray<uint64_t> chunk_blocks; // first block of chunk `i`, size = chunks + 1
+
+  static constexpr size_t block_bits = block_words * 64;
+
+  static auto block_of(uint64_t hash, size_t blocks){
+    return static_cast<size_t>(((hash >> 32) * blocks) >> 32);
+  }
+
+  template<class Fn>
+  static void for_each_bit(uint64_t hash, Fn&& fn){
+    auto h1 = static_cast<uint32_t>(hash);
+    auto h2 = static_cast<uint32_t>(hash >> 32) | 1u;
+    for(size_t probe = 0; probe < probes; ++probe){
+      fn((h1 + probe * h2) % block_bits);
+    }
+  }
+
+public:
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & words;
+    ar & chunk_blocks;
+  }
+
+  /**
+   * @brief The blocks of a chunk filter from the hashes of its keys, built apart (e.g. on
+   * the thread building the chunk) and added with `append_blocks`
+   */
+  static std::vector<uint64_t> make_blocks(std::span<const uint64_t> hashes){
+    auto blocks = (hashes.size() * bits_per_key + block_bits - 1) / block_bits;
+    auto chunk_words = std::vector<uint64_t>(blocks * block_words, 0);
+    for(auto hash : hashes){
+      auto block = chunk_words.data() + block_of(hash, blocks) * block_words;
+      for_each_bit(hash, [block](auto bit){
+        block[bit / 64] |= uint64_t{1} << (bit % 64);
+      });
+    }
+    return chunk_words;
+  }
+
+  /**
+   * @brief Add the blocks of chunk `chunk_idx` (see `make_blocks`). The chunks are added in
+   * increasing order, the skipped ones are empty.
+   */
+  void append_blocks(size_t chunk_idx, std::span<const uint64_t> chunk_words){
+    if(chunk_blocks.empty()){
+      chunk_blocks.push_back(0);
+    }
+    while(chunks() < chunk_idx){
+      chunk_blocks.push_back(chunk_blocks.back());
+    }
+    if(chunks() > chunk_idx){
+      throw std::invalid_argument(
+        fmt::format("AlleleFilter: chunk {} is added after chunk {}", chunk_idx, chunks() - 1));
+    }
+    words.append(chunk_words.data(), chunk_words.size());
+    chunk_blocks.push_back(chunk_blocks.back() + chunk_words.size() / block_words);
+  }
+
+  /**
+   * @brief Add the filter of chunk `chunk_idx` from the hashes of its keys
+   */
+  void add_chunk(size_t chunk_idx, std::span<const uint64_t> hashes){
+    append_blocks(chunk_idx, make_blocks(hashes));
+  }
+
+  [[nodiscard]] size_t chunks() const {
+    return chunk_blocks.empty() ? 0 : chunk_blocks.size() - 1;
+  }
+
+  [[nodiscard]] size_t bytes() const {
+    return (words.size() + chunk_blocks.size()) * sizeof(uint64_t);
+  }
+
+  /**
+   * @return false if the key is surely not in the chunk
+   */
+  [[nodiscard]] bool may_contain(size_t chunk_idx, uint64_t hash) const {
+    if(chunk_idx >= chunks()){
+      return false;
+    }
+    auto first = chunk_blocks[chunk_idx];
+    auto blocks = chunk_blocks[chunk_idx + 1] - first;
+    if(blocks == 0){
+      return false;
+    }
+    auto block = words.data() + (first + block_of(hash, blocks)) * block_words;
+    auto found = true;
+    for_each_bit(hash, [block, &found](auto bit){
+      found = found and (block[bit / 64] >> (bit % 64) & 1);
+    });
+    return found;
+  }
+};
+
+}
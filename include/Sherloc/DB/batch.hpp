@@ -0,0 +1,114 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <ranges>
+#include <span>
+#include <Sherloc/Attr/allele.hpp>
+#include <Sherloc/sherloc_member.hpp>
+
+/**
+ * Helpers of the batched (merge join) lookups
+ *
+ * A batch of alleles sorted by position is looked up in a database sorted by position with
+ * one forward walk instead of one binary search per allele. Each search gallops from the
+ * previous match (1, 2, 4, ... elements ahead) before the binary search, so it costs
+ * O(log distance): dense batches walk the database linearly, sparse batches skip it.
+ */
+
+namespace Sherloc::DB {
+
+/**
+ * @brief Equal ranges of a sequence of keys in a sorted random access range, each search
+ * starting from the previous one
+ *
+ * Keys are expected in non decreasing order. A key smaller than the previous one is still
+ * found (by a binary search before the current position), it only costs O(log N).
+ * Only the std::ranges iterator operations are used, the iterators of views like
+ * `iota | transform` are random access but legacy input iterators.
+ */
+template<std::random_access_iterator It, class Proj = std::identity>
+class GallopCursor {
+private:
+  It first;
+  It last;
+  It cur;
+  Proj proj;
+
+  /**
+   * @brief lower / upper bound of `key` in [from, last), galloping from `from`.
+   * `before(elem)` is true for the elements in front of the bound.
+   */
+  template<class Before>
+  It gallop(It from, Before&& before) const {
+    auto lo = from;
+    auto hi = from;
+    auto step = std::iter_difference_t<It>{1};
+    while(hi != last and before(std::invoke(proj, *hi))){
+      lo = std::ranges::next(hi);
+      hi += std::min(step, std::ranges::distance(hi, last));
+      step *= 2;
+    }
+    // the bound is in [lo, hi]
+    return std::ranges::partition_point(lo, hi, before, proj);
+  }
+
+public:
+  GallopCursor(It first, It last, Proj proj = {}):
+    first(first), last(last), cur(first), proj(std::move(proj)) {}
+
+  template<std::ranges::random_access_range Range>
+  explicit GallopCursor(Range& range, Proj proj = {}):
+    GallopCursor(std::ranges::begin(range), std::ranges::end(range), std::move(proj)) {}
+
+  /**
+   * @brief The elements equal to `key` (by projection)
+   */
+  template<class Key>
+  auto equal_range(const Key& key){
+    if(cur != first and !(std::invoke(proj, *std::ranges::prev(cur)) < key)){ // key went backwards
+      cur = std::ranges::lower_bound(first, cur, key, {}, proj);
+    }else{
+      cur = gallop(cur, [&](const auto& value){ return value < key; });
+    }
+    auto upper = gallop(cur, [&](const auto& value){ return !(key < value); });
+    return std::ranges::subrange(cur, upper);
+  }
+
+  /**
+   * @brief Iterator of the last element not greater than `key`, `end` if there is none
+   */
+  template<class Key>
+  auto floor(const Key& key){
+    auto upper = equal_range(key).end();
+    return upper == first ? last : std::ranges::prev(upper);
+  }
+
+  [[nodiscard]] auto begin() const { return first; }
+  [[nodiscard]] auto end() const { return last; }
+};
+
+template<std::ranges::random_access_range Range, class Proj = std::identity>
+GallopCursor(Range&, Proj = {}) -> GallopCursor<std::ranges::iterator_t<Range>, Proj>;
+
+/**
+ * @brief Call `fn(chr_idx, offset, run)` on each run of consecutive alleles on the same
+ * chromosome, `offset` being the index of the run in `sher_mems`
+ */
+template<class Fn>
+inline void for_each_chr_run(std::span<const SherlocMember> sher_mems, Fn&& fn){
+  auto begin = size_t{0};
+  while(begin < sher_mems.size()){
+    auto end = begin + 1;
+    while(end < sher_mems.size() and sher_mems[end].chr == sher_mems[begin].chr){
+      ++end;
+    }
+    fn(Attr::ChrMap::chr2idx(sher_mems[begin].chr), begin,
+      sher_mems.subspan(begin, end - begin));
+    begin = end;
+  }
+}
+
+}
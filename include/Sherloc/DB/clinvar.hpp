@@ -1,10 +1,22 @@
 #pragma once
 
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <limits>
+#include <map>
+#include <span>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
 #include <vector>
 #include <string>
+#include <string_view>
 #include <optional>
 #include <boost/algorithm/string.hpp>
 #include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/batch.hpp>
+#include <Sherloc/DB/interned.hpp>
 #include <Sherloc/DB/vcf.hpp>
 #include <Sherloc/Attr/utils.hpp>
 #include <Sherloc/sherloc_member.hpp>
@@ -52,16 +64,24 @@ public:
   Clinvar( const std::string& ref0, const std::string& alt0 )
     :ref(ref0), alt(alt0){}
 
-  Clinvar(HTS_VCF& vcf)
-    :ref(vcf.record.ref), alt(vcf.record.alt)
+  // header ids of the INFO tags used by the constructor, resolved once per vcf
+  struct InfoIds {
+    int clndn, clnsig, clnvi, geneinfo, clnrevstat, alleleid;
+    InfoIds(const HTS_VCF& vcf):
+      clndn(vcf.info2id("CLNDN")), clnsig(vcf.info2id("CLNSIG")),
+      clnvi(vcf.info2id("CLNVI")), geneinfo(vcf.info2id("GENEINFO")),
+      clnrevstat(vcf.info2id("CLNREVSTAT")), alleleid(vcf.info2id("ALLELEID")) {}
+  };
+
+  Clinvar(HTS_VCF& vcf, const InfoIds& info_ids)
+    :ref(vcf.view.ref), alt(vcf.view.alt)
   {
     // ref alt to vep stlye
-    std::string clndn, clnvi;
-    clndn = vcf.info_str("CLNDN").value_or(std::string{});
-    clnsig = vcf.info_str("CLNSIG").value_or(std::string{});
-    clnvi = vcf.info_str("CLNVI").value_or(std::string{});
-    geneinfo = vcf.info_str("GENEINFO").value_or(std::string{});
-    star = status2star(vcf.info_str("CLNREVSTAT").value_or(""));
+    auto clndn = std::string{vcf.info_view(info_ids.clndn).value_or("")};
+    auto clnvi = vcf.info_view(info_ids.clnvi).value_or("");
+    clnsig = vcf.info_view(info_ids.clnsig).value_or("");
+    geneinfo = vcf.info_view(info_ids.geneinfo).value_or("");
+    star = status2star(vcf.info_view(info_ids.clnrevstat).value_or(""));
     std::ranges::for_each(clndn, Attr::as_upper);
     std::ranges::for_each(clnsig, Attr::as_upper);
 
@@ -102,11 +122,11 @@ public:
       }
     }
 
-    allele_id = vcf.info_int("ALLELEID").value_or(-1);
+    allele_id = vcf.info_int(info_ids.alleleid).value_or(-1);
   }
 
-  static int8_t status2star(const std::string& status){
-    const static auto status_map = std::map<std::string, int8_t>{
+  static int8_t status2star(std::string_view status){
+    const static auto status_map = std::map<std::string, int8_t, std::less<>>{
       {"no_assertion_criteria_provided", 0},
       {"no_assertion_provided", 0},
       {"no_interpretation_for_the_single_variant", 0},
@@ -166,11 +186,19 @@ public:
   DVD( const std::string& ref0, const std::string& alt0 )
     :ref(ref0), alt(alt0){}
 
-  DVD( HTS_VCF& vcf )
-    :ref(vcf.record.ref), alt(vcf.record.alt), gene_symbol(vcf.info_str("GENE").value_or(""))
+  // header ids of the INFO tags used by the constructor, resolved once per vcf
+  struct InfoIds {
+    int gene, final_disease, final_pathogenicity;
+    InfoIds(const HTS_VCF& vcf):
+      gene(vcf.info2id("GENE")), final_disease(vcf.info2id("FINAL_DISEASE")),
+      final_pathogenicity(vcf.info2id("FINAL_PATHOGENICITY")) {}
+  };
+
+  DVD( HTS_VCF& vcf, const InfoIds& info_ids )
+    :ref(vcf.view.ref), alt(vcf.view.alt), gene_symbol(vcf.info_view(info_ids.gene).value_or(""))
   {
-    auto final_disease = vcf.info_str("FINAL_DISEASE").value_or("");
-    auto pathogenicity = vcf.info_str("FINAL_PATHOGENICITY").value_or("");
+    auto final_disease = std::string{vcf.info_view(info_ids.final_disease).value_or("")};
+    auto pathogenicity = std::string{vcf.info_view(info_ids.final_pathogenicity).value_or("")};
     std::ranges::for_each(final_disease, [](auto& c){
       Attr::as_upper(c);
       if(c == '_') c = ' ';
@@ -198,26 +226,353 @@ public:
   }
 };
 
+/**
+ * @brief The positions and alleles of a chromosome table, sorted by position. The alleles
+ * are ids in the interned strings of the database.
+ */
+class AlleleColumns {
+public:
+  FlatArray<uint32_t> positions;
+  FlatArray<InternedStrings::IdType> refs;
+  FlatArray<InternedStrings::IdType> alts;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & positions;
+    ar & refs;
+    ar & alts;
+  }
+
+  [[nodiscard]] size_t size() const { return positions.size(); }
+
+  void push_back(size_t pos, std::string_view ref, std::string_view alt, InternedStrings& strings){
+    if(pos > std::numeric_limits<uint32_t>::max()){
+      throw std::invalid_argument(fmt::format("AlleleColumns: position {} over 32 bits", pos));
+    }
+    positions.push_back(static_cast<uint32_t>(pos));
+    refs.push_back(strings.intern(ref));
+    alts.push_back(strings.intern(alt));
+  }
+
+  /**
+   * @brief Index range of the records at `pos`
+   */
+  [[nodiscard]] std::pair<size_t, size_t> equal_range(size_t pos) const {
+    auto [s_it, e_it] = std::ranges::equal_range(positions, pos);
+    return {static_cast<size_t>(s_it - positions.begin()), static_cast<size_t>(e_it - positions.begin())};
+  }
+
+  /**
+   * @brief `equal_range` of positions in non decreasing order, one call per position, each
+   * search gallops from the previous one
+   */
+  [[nodiscard]] auto cursor() const {
+    return [cursor = GallopCursor(positions), this](size_t pos) mutable {
+      auto range = cursor.equal_range(pos);
+      return std::pair{
+        static_cast<size_t>(range.begin() - positions.begin()),
+        static_cast<size_t>(range.end() - positions.begin())
+      };
+    };
+  }
+
+  /**
+   * @brief Index of the record of (ref, alt) in an index range, std::nullopt if none
+   */
+  [[nodiscard]] std::optional<size_t> find(
+    std::pair<size_t, size_t> range, std::string_view ref, std::string_view alt,
+    const InternedStrings& strings
+  ) const {
+    for(auto idx = range.first; idx < range.second; ++idx){
+      if(strings[refs[idx]] == ref and strings[alts[idx]] == alt){
+        return idx;
+      }
+    }
+    return std::nullopt;
+  }
+};
+
+// bits of the flag columns of the record tables
+namespace record_flags {
+  constexpr uint8_t onset       = 0b0001;
+  constexpr uint8_t severe      = 0b0010;
+  constexpr uint8_t consequence = 0b0100;
+  constexpr uint8_t benign      = 0b1000;
+  constexpr unsigned star_shift = 4; // ClinVar stars, above the flags
+
+  constexpr uint8_t pack(bool onset0, bool severe0, bool consequence0, bool benign0){
+    return (onset0 ? onset : 0) | (severe0 ? severe : 0) |
+      (consequence0 ? consequence : 0) | (benign0 ? benign : 0);
+  }
+}
+
+/**
+ * @brief The ClinVar records of a chromosome as columns, a record is rebuilt by `record`
+ */
+class ClinvarTable {
+public:
+  AlleleColumns alleles;
+  FlatArray<InternedStrings::IdType> clnsigs;
+  FlatArray<InternedStrings::IdType> codons;
+  FlatArray<InternedStrings::IdType> geneinfos;
+  FlatArray<int64_t> allele_ids;
+  FlatArray<uint8_t> flags; // `record_flags`, and the star above them
+  FlatArray<char> adars;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & alleles;
+    ar & clnsigs;
+    ar & codons;
+    ar & geneinfos;
+    ar & allele_ids;
+    ar & flags;
+    ar & adars;
+  }
+
+  [[nodiscard]] size_t size() const { return alleles.size(); }
+
+  void push_back(size_t pos, const Clinvar& clinvar, InternedStrings& strings){
+    alleles.push_back(pos, clinvar.ref, clinvar.alt, strings);
+    clnsigs.push_back(strings.intern(clinvar.clnsig));
+    codons.push_back(strings.intern(clinvar.codon));
+    geneinfos.push_back(strings.intern(clinvar.geneinfo));
+    allele_ids.push_back(clinvar.allele_id);
+    flags.push_back(record_flags::pack(clinvar.onset, clinvar.severe, clinvar.consequence, clinvar.benign)
+      | static_cast<uint8_t>(clinvar.star << record_flags::star_shift));
+    adars.push_back(clinvar.adar);
+  }
+
+  [[nodiscard]] Clinvar record(size_t idx, const InternedStrings& strings) const {
+    auto clinvar = Clinvar{
+      std::string{strings[alleles.refs[idx]]},
+      std::string{strings[alleles.alts[idx]]}
+    };
+    clinvar.clnsig = strings[clnsigs[idx]];
+    clinvar.codon = strings[codons[idx]];
+    clinvar.geneinfo = strings[geneinfos[idx]];
+    clinvar.allele_id = allele_ids[idx];
+    auto flag = flags[idx];
+    clinvar.onset = flag & record_flags::onset;
+    clinvar.severe = flag & record_flags::severe;
+    clinvar.consequence = flag & record_flags::consequence;
+    clinvar.benign = flag & record_flags::benign;
+    clinvar.star = static_cast<int8_t>(flag >> record_flags::star_shift);
+    clinvar.adar = adars[idx];
+    return clinvar;
+  }
+};
+
+/**
+ * @brief A record of a `ClinvarTable` read in place, nothing is copied until `record`.
+ * Valid as long as the table and the strings it points to.
+ */
+class ClinvarView {
+private:
+  const ClinvarTable* table;
+  const InternedStrings* strings;
+  size_t idx;
+
+  [[nodiscard]] bool flag(uint8_t bit) const { return table->flags[idx] & bit; }
+
+public:
+  ClinvarView(const ClinvarTable& table, size_t idx, const InternedStrings& strings)
+  : table(&table), strings(&strings), idx(idx) {}
+
+  [[nodiscard]] std::string_view ref() const { return (*strings)[table->alleles.refs[idx]]; }
+  [[nodiscard]] std::string_view alt() const { return (*strings)[table->alleles.alts[idx]]; }
+  [[nodiscard]] std::string_view codon() const { return (*strings)[table->codons[idx]]; }
+  [[nodiscard]] int64_t allele_id() const { return table->allele_ids[idx]; }
+  [[nodiscard]] bool consequence() const { return flag(record_flags::consequence); }
+  [[nodiscard]] bool benign() const { return flag(record_flags::benign); }
+
+  [[nodiscard]] Clinvar record() const { return table->record(idx, *strings); }
+};
+
+/**
+ * @brief The DVD records of a chromosome as columns, a record is rebuilt by `record`
+ */
+class DVDTable {
+public:
+  AlleleColumns alleles;
+  FlatArray<InternedStrings::IdType> gene_symbols;
+  FlatArray<InternedStrings::IdType> clnsigs;
+  FlatArray<uint8_t> flags; // `record_flags`
+  FlatArray<char> adars;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & alleles;
+    ar & gene_symbols;
+    ar & clnsigs;
+    ar & flags;
+    ar & adars;
+  }
+
+  [[nodiscard]] size_t size() const { return alleles.size(); }
+
+  void push_back(size_t pos, const DVD& dvd, InternedStrings& strings){
+    alleles.push_back(pos, dvd.ref, dvd.alt, strings);
+    gene_symbols.push_back(strings.intern(dvd.gene_symbol));
+    clnsigs.push_back(strings.intern(dvd.clnsig));
+    flags.push_back(record_flags::pack(dvd.onset, dvd.severe, dvd.consequence, dvd.benign));
+    adars.push_back(dvd.adar);
+  }
+
+  [[nodiscard]] DVD record(size_t idx, const InternedStrings& strings) const {
+    auto dvd = DVD{
+      std::string{strings[alleles.refs[idx]]},
+      std::string{strings[alleles.alts[idx]]}
+    };
+    dvd.gene_symbol = strings[gene_symbols[idx]];
+    dvd.clnsig = strings[clnsigs[idx]];
+    auto flag = flags[idx];
+    dvd.onset = flag & record_flags::onset;
+    dvd.severe = flag & record_flags::severe;
+    dvd.consequence = flag & record_flags::consequence;
+    dvd.benign = flag & record_flags::benign;
+    dvd.adar = adars[idx];
+    return dvd;
+  }
+};
+
+/**
+ * @brief ClinVar ID -> (chromosome, index of its record)
+ *
+ * An open addressing hash table with linear probing, at most half full, so a lookup is
+ * usually one probe. The slots are flat arrays and map in place with the database.
+ */
+class ClinvarIdIndex {
+public:
+  static constexpr auto empty_id = std::numeric_limits<uint64_t>::max();
+
+  // (ClinVar ID, chromosome, index of the record)
+  using Entry = std::tuple<uint64_t, size_t, size_t>;
+
+private:
+  FlatArray<uint64_t> ids;       // `empty_id` in the empty slots
+  FlatArray<uint64_t> locations; // chromosome << 32 | index
+  uint64_t count = 0;
+
+  static size_t slot_of(uint64_t id, size_t mask){
+    // splitmix64 finalizer, the IDs are dense so their low bits alone would cluster
+    id ^= id >> 30;
+    id *= uint64_t{0xbf58476d1ce4e5b9};
+    id ^= id >> 27;
+    id *= uint64_t{0x94d049bb133111eb};
+    id ^= id >> 31;
+    return static_cast<size_t>(id) & mask;
+  }
+
+public:
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & ids;
+    ar & locations;
+    ar & count;
+  }
+
+  /**
+   * @brief Rebuild the table from its entries, the first of repeated IDs is kept
+   */
+  void build(std::span<const Entry> entries){
+    auto capacity = std::bit_ceil(std::max<size_t>(16, entries.size() * 2));
+    auto mask = capacity - 1;
+    auto id_slots = std::vector<uint64_t>(capacity, empty_id);
+    auto location_slots = std::vector<uint64_t>(capacity, 0);
+    count = 0;
+    for(auto& [id, chr, index] : entries){
+      if(id == empty_id){
+        throw std::invalid_argument(fmt::format("ClinvarIdIndex: ID {} is reserved", id));
+      }
+      auto slot = slot_of(id, mask);
+      while(id_slots[slot] != empty_id and id_slots[slot] != id){
+        slot = (slot + 1) & mask;
+      }
+      if(id_slots[slot] == id){
+        continue;
+      }
+      id_slots[slot] = id;
+      location_slots[slot] = static_cast<uint64_t>(chr) << 32 | index;
+      ++count;
+    }
+    ids = std::move(id_slots);
+    locations = std::move(location_slots);
+  }
+
+  /**
+   * @return (chromosome, index of the record), std::nullopt if the ID is not indexed
+   */
+  [[nodiscard]] std::optional<std::pair<size_t, size_t>> find(uint64_t id) const {
+    if(ids.empty() or id == empty_id){
+      return std::nullopt;
+    }
+    auto mask = ids.size() - 1;
+    for(auto slot = slot_of(id, mask); ids[slot] != empty_id; slot = (slot + 1) & mask){
+      if(ids[slot] == id){
+        auto location = locations[slot];
+        return std::pair{static_cast<size_t>(location >> 32), static_cast<size_t>(location & 0xffffffff)};
+      }
+    }
+    return std::nullopt;
+  }
+
+  [[nodiscard]] size_t size() const { return count; }
+
+  [[nodiscard]] size_t bytes() const {
+    return (ids.size() + locations.size()) * sizeof(uint64_t);
+  }
+};
+
 class DataBaseClinvar : public BaseDB {
 public:
-  // chr -> vec[(pos, Clinvar record)...]
-  using PosClinvar = std::pair<size_t, Clinvar>;
-  std::map<ChrIndexType, std::vector<PosClinvar>> chr2vec;
+  // the strings of the records (alleles, clinical significances, genes...)
+  InternedStrings strings;
 
-  // chr -> {ID of clinvar, index of vec}
-  using ID2Index = std::pair<size_t, size_t>;
-  std::map<ChrIndexType, std::vector<ID2Index>> clinvar_id2index;
+  // chr -> ClinVar records sorted by position
+  std::map<ChrIndexType, ClinvarTable> chr2table;
 
+  // ID of clinvar -> {chr, index of record}
+  ClinvarIdIndex id_index;
 
   // Transcript ID -> vec[arr(cds pos, AA pos, ID of clinvar)]
   using PosType = std::array<size_t, 3>;
   std::map<std::string, std::vector<PosType>> txp_map;
 
-  HOLMES_SERIALIZE(ar, _ver) {
+  HOLMES_SERIALIZE(ar, version) {
     ar & db_version;
     ar & db_build_time;
-    ar & chr2vec;
-    ar & clinvar_id2index;
+    if constexpr (Archive::is_loading::value){
+      if(version < 2){ // built before the tables, chr -> vec[(pos, Clinvar record)...]
+        auto chr2vec = std::map<ChrIndexType, std::vector<std::pair<size_t, Clinvar>>>{};
+        ar & chr2vec;
+        strings = InternedStrings{};
+        chr2table.clear();
+        for(auto& [chr, vec] : chr2vec){
+          auto& table = chr2table[chr];
+          for(auto& [pos, clinvar] : vec){
+            table.push_back(pos, clinvar, strings);
+          }
+        }
+      }
+      if(version == 0){ // built before the global index, chr -> sorted {ID, index of vec}
+        auto clinvar_id2index = std::map<ChrIndexType, std::vector<std::pair<size_t, size_t>>>{};
+        ar & clinvar_id2index;
+        auto entries = std::vector<ClinvarIdIndex::Entry>{};
+        for(auto& [chr, id2index] : clinvar_id2index){
+          for(auto& [id, index] : id2index){
+            entries.emplace_back(id, chr, index);
+          }
+        }
+        id_index.build(entries);
+      }
+      if(version < 2){
+        if(version == 1){
+          ar & id_index;
+        }
+        ar & txp_map;
+        return;
+      }
+    }
+    ar & strings;
+    ar & chr2table;
+    ar & id_index;
     ar & txp_map;
   }
 
@@ -251,9 +606,13 @@ public:
     auto aa_idx         = vep_header_index.at("Protein_position");
     auto var_type_idx   = vep_header_index.at("Consequence");
     auto cols = std::vector<std::string>{};
+    auto info_ids = Clinvar::InfoIds{clinvar_vcf};
+    auto csq_id = clinvar_vcf.info2id("CSQ");
+    auto clndn_id = info_ids.clndn;
+    auto id_entries = std::vector<ClinvarIdIndex::Entry>{};
 
     while (true) {
-      switch (clinvar_vcf.parse_line()) {
+      switch (clinvar_vcf.parse_view()) {
         using enum HTS_VCF::VCF_Status;
         case OK:
           break;
@@ -273,31 +632,28 @@ public:
 
       // FIXME: currently DB<Clinvar> store variant allele in VEP style 
       // BUT for indel, position is minus 1 due to some ordering issue
-      clinvar_vcf.to_vep_style();
-      if(clinvar_vcf.record.ref == "-" or clinvar_vcf.record.alt == "-"){
-        --clinvar_vcf.record.pos;
+      auto pos = clinvar_vcf.view.to_vep_style();
+      if(clinvar_vcf.view.ref == "-" or clinvar_vcf.view.alt == "-"){
+        --pos;
       }
 
-      ChrIndexType chr_idx;
-      try{
-        chr_idx = Attr::ChrMap::chr2idx(clinvar_vcf.record.chr);
-      }catch(std::out_of_range& e){
-        SPDLOG_WARN("Skipped unaccepted chr: `{}`", clinvar_vcf.record.chr);
+      if(!clinvar_vcf.view.accepted_chr()){
+        SPDLOG_WARN("Skipped unaccepted chr: `{}`", clinvar_vcf.view.chr);
         continue;
       }
+      ChrIndexType chr_idx = clinvar_vcf.view.chr_idx;
 
       // push ClinVar record
-      auto& chromosome = chr2vec[chr_idx];
-      chromosome.emplace_back(clinvar_vcf.record.pos, clinvar_vcf);
+      auto& table = chr2table[chr_idx];
+      table.push_back(pos, Clinvar{clinvar_vcf, info_ids}, strings);
 
       // push id2index pair
       auto clinvar_id = std::stoul(clinvar_vcf.get_ID());
-      clinvar_id2index[chr_idx].emplace_back(
-        clinvar_id, chromosome.size() - 1);
+      id_entries.emplace_back(clinvar_id, chr_idx, table.size() - 1);
 
       // parse txp2id pair
       for(auto&& txp_csq : clinvar_vcf
-            .info_str("CSQ")
+            .info_view(csq_id)
             .value_or("") | std::views::split(','))
       {
         boost::split(
@@ -328,26 +684,26 @@ public:
 
       if(line_num % 500000 == 0){
         SPDLOG_INFO("line {}'s CLNDN: {}, vcf id: {}",
-          line_num, clinvar_vcf.info_str("CLNDN").value_or(""), clinvar_id);
+          line_num, clinvar_vcf.info_view(clndn_id).value_or(""), clinvar_id);
       }
       line_num++;
     }
 
     // check clinvar record positions are sorted
-    for(auto& [chr, vec] : chr2vec){
-      if(auto til = std::ranges::is_sorted_until(vec, {}, &PosClinvar::first); til != vec.end()){
-        auto idx = std::distance(std::begin(vec), til);
+    for(auto& [chr, table] : chr2table){
+      auto& positions = table.alleles.positions;
+      if(auto til = std::ranges::is_sorted_until(positions); til != positions.end()){
+        auto idx = static_cast<size_t>(std::distance(positions.begin(), til));
         SPDLOG_ERROR("chr{} is sorted til {}", chr, idx);
-        SPDLOG_CRITICAL("pos {}, allele id: {}", vec[idx-1].first, vec[idx-1].second.allele_id);
-        SPDLOG_CRITICAL("pos {}, allele id: {}", vec[idx].first, vec[idx].second.allele_id);
-        SPDLOG_CRITICAL("pos {}, allele id: {}", vec[idx+1].first, vec[idx+1].second.allele_id);
+        for(auto log_idx = idx - 1; log_idx <= idx + 1 and log_idx < table.size(); ++log_idx){
+          SPDLOG_CRITICAL("pos {}, allele id: {}", positions[log_idx], table.allele_ids[log_idx]);
+        }
       }
     }
+    SPDLOG_INFO("{} distinct strings ({:.1f} MB)", strings.size(), strings.bytes() / 1048576.);
 
-    // sort clinvar id
-    for(auto& [chr, id2index]: clinvar_id2index){
-      std::ranges::sort(id2index, {}, &ID2Index::first);
-    }
+    id_index.build(id_entries);
+    SPDLOG_INFO("Indexed {} ClinVar IDs ({:.1f} MB)", id_index.size(), id_index.bytes() / 1048576.);
 
     // sort all element in txp_map
     SPDLOG_INFO("Sorting positions...");
@@ -363,7 +719,7 @@ public:
   void save(const Path& filename) override {
     this->set_build_time();
     this->log_metadata("DataBaseClinvar");
-    save_archive_to(*this, filename);
+    save_flat_to(*this, filename);
   }
 
   void load(const Path& filename) override {
@@ -371,9 +727,9 @@ public:
     this->log_metadata("DataBaseClinvar");
   }
 
-  std::optional<Clinvar> find(const std::string& chr0, size_t pos0, const std::string& ref0, const std::string& alt0) {
-    auto it_chr = chr2vec.find(Attr::ChrMap::chr2idx(chr0));
-    if (it_chr == chr2vec.end())
+  std::optional<Clinvar> find(const std::string& chr0, size_t pos0, const std::string& ref0, const std::string& alt0) const {
+    auto it_chr = chr2table.find(Attr::ChrMap::chr2idx(chr0));
+    if (it_chr == chr2table.end())
       return std::nullopt;
 
     // FIXME: currently Clinvar store variant allele in VEP style 
@@ -381,29 +737,77 @@ public:
     if(ref0 == "-" or alt0 == "-")
       --pos0;
 
-    auto& vec = it_chr->second;
-
-    auto [s_it, e_it] = std::ranges::equal_range(vec, pos0, {}, &PosClinvar::first);
-    for(auto it = s_it; it != e_it; ++it){
-      auto& clinvar = it->second;
-      if(ref0 == clinvar.ref and alt0 == clinvar.alt)
-        return clinvar;
-    }
-    return std::nullopt;
+    auto& table = it_chr->second;
+    auto idx = table.alleles.find(table.alleles.equal_range(pos0), ref0, alt0, strings);
+    if(!idx.has_value())
+      return std::nullopt;
+    return table.record(*idx, strings);
   }
 
-  inline auto find(const SherlocMember& sher_mem) {
+  inline auto find(const SherlocMember& sher_mem) const {
     return find(sher_mem.chr, sher_mem.pos, sher_mem.ref, sher_mem.alt);
   }
 
-  Clinvar* find(size_t clinvar_idx){
-    for(auto&& [chr, id2index] : clinvar_id2index){
-      auto it = std::ranges::lower_bound(id2index, clinvar_idx, {}, &ID2Index::first);
-      if (it != id2index.end() and it->first == clinvar_idx){
-        return &chr2vec.at(chr)[it->second].second;
+  /**
+   * @brief `find` of a batch of alleles, one column of results in the same order.
+   * The alleles of a chromosome are merged with its records in one pass.
+   */
+  std::vector<std::optional<Clinvar>> find_batch(std::span<const SherlocMember> sher_mems) const {
+    auto ret = std::vector<std::optional<Clinvar>>(sher_mems.size());
+    for_each_chr_run(sher_mems, [&](auto chr, auto offset, auto run){
+      auto it_chr = chr2table.find(chr);
+      if (it_chr == chr2table.end())
+        return;
+      auto& table = it_chr->second;
+      auto equal_range = table.alleles.cursor();
+      for(size_t idx = 0; idx < run.size(); ++idx){
+        auto& sher_mem = run[idx];
+        auto pos0 = sher_mem.pos;
+        if(sher_mem.ref == "-" or sher_mem.alt == "-") // same indel shift as `find`
+          --pos0;
+        auto found = table.alleles.find(equal_range(pos0), sher_mem.ref, sher_mem.alt, strings);
+        if(found.has_value()){
+          ret[offset + idx] = table.record(*found, strings);
+        }
       }
+    });
+    return ret;
+  }
+
+  /**
+   * @brief The record of a ClinVar ID, read in place
+   */
+  std::optional<ClinvarView> view(size_t clinvar_idx) const {
+    auto location = id_index.find(clinvar_idx);
+    if (!location.has_value()){
+      return std::nullopt;
+    }
+    auto& [chr, index] = *location;
+    return ClinvarView{chr2table.at(chr), index, strings};
+  }
+
+  std::optional<Clinvar> find(size_t clinvar_idx) const {
+    auto found = view(clinvar_idx);
+    if (!found.has_value()){
+      return std::nullopt;
+    }
+    return found->record();
+  }
+
+  /**
+   * @brief All the records stored at `pos0` (no indel shift, see `find`), read in place
+   */
+  std::vector<ClinvarView> find_at(const std::string& chr0, size_t pos0) const {
+    auto ret = std::vector<ClinvarView>{};
+    auto it_chr = chr2table.find(Attr::ChrMap::chr2idx(chr0));
+    if (it_chr == chr2table.end())
+      return ret;
+    auto& table = it_chr->second;
+    auto [s_idx, e_idx] = table.alleles.equal_range(pos0);
+    for(auto idx = s_idx; idx < e_idx; ++idx){
+      ret.emplace_back(table, idx, strings);
     }
-    return nullptr;
+    return ret;
   }
 
   static size_t CDS_proj(const PosType& cds_aa_idx){
@@ -414,8 +818,11 @@ public:
     return cds_aa_idx.at(1);
   }
 
-  auto find_txp_by(const std::string& txp, std::pair<size_t, size_t> bounds, auto&& proj){
-    auto ret = std::vector<Clinvar*>{};
+  /**
+   * @brief The records of `txp` whose `proj` (`CDS_proj` or `AA_proj`) is in `bounds`, read in place
+   */
+  std::vector<ClinvarView> find_txp_by(const std::string& txp, std::pair<size_t, size_t> bounds, auto&& proj) const {
+    auto ret = std::vector<ClinvarView>{};
     
     auto txp_it = txp_map.find(txp);
     if(txp_it == txp_map.end()){
@@ -432,7 +839,9 @@ public:
     }
 
     for(auto id : clinvar_ids){
-      ret.emplace_back(find(id));
+      if(auto found = view(id); found.has_value()){
+        ret.emplace_back(*found);
+      }
     }
     return ret;
   }
@@ -440,12 +849,31 @@ public:
 
 class DataBaseDVD : public BaseDB {
 public:
-  using PosDVD = std::pair<size_t, DVD>;
-  std::map<ChrIndexType, std::vector<PosDVD>> db_map;
+  // the strings of the records (alleles, genes, pathogenicities)
+  InternedStrings strings;
 
-  HOLMES_SERIALIZE(ar, _ver){
+  // chr -> DVD records sorted by position
+  std::map<ChrIndexType, DVDTable> db_map;
+
+  HOLMES_SERIALIZE(ar, version){
     ar & db_version;
     ar & db_build_time;
+    if constexpr (Archive::is_loading::value){
+      if(version == 0){ // built before the tables, chr -> vec[(pos, DVD record)...]
+        auto chr2vec = std::map<ChrIndexType, std::vector<std::pair<size_t, DVD>>>{};
+        ar & chr2vec;
+        strings = InternedStrings{};
+        db_map.clear();
+        for(auto& [chr, vec] : chr2vec){
+          auto& table = db_map[chr];
+          for(auto& [pos, dvd] : vec){
+            table.push_back(pos, dvd, strings);
+          }
+        }
+        return;
+      }
+    }
+    ar & strings;
     ar & db_map;
   }
 
@@ -454,8 +882,9 @@ public:
     db_version = dvd_vcf.get_generic_header_value("fileDate").value_or("None");
 
     int line_num = 0;
+    auto info_ids = DVD::InfoIds{dvd_vcf};
     HTS_VCF::VCF_Status status;
-    while ((status = dvd_vcf.parse_line()) != HTS_VCF::VCF_Status::VCF_EOF) {
+    while ((status = dvd_vcf.parse_view()) != HTS_VCF::VCF_Status::VCF_EOF) {
       switch (status) {
         using enum HTS_VCF::VCF_Status;
         case OK:
@@ -470,21 +899,18 @@ public:
           throw std::runtime_error("unknown status");
       }
       // So currently DB<DVD> store variant allele in VEP style
-      dvd_vcf.to_vep_style();
-      if(dvd_vcf.record.ref == "-" or dvd_vcf.record.alt == "-"){
-        --dvd_vcf.record.pos;
+      auto pos = dvd_vcf.view.to_vep_style();
+      if(dvd_vcf.view.ref == "-" or dvd_vcf.view.alt == "-"){
+        --pos;
       }
 
-      ChrIndexType chr_idx;
-      try{
-        chr_idx = Attr::ChrMap::chr2idx(dvd_vcf.record.chr);
-      }catch(std::out_of_range& e){
-        SPDLOG_WARN("Skipped unaccepted chr: `{}`", dvd_vcf.record.chr);
+      if(!dvd_vcf.view.accepted_chr()){
+        SPDLOG_WARN("Skipped unaccepted chr: `{}`", dvd_vcf.view.chr);
         continue;
       }
+      ChrIndexType chr_idx = dvd_vcf.view.chr_idx;
 
-      auto& chromosome = db_map[chr_idx];
-      chromosome.emplace_back(dvd_vcf.record.pos, dvd_vcf);
+      db_map[chr_idx].push_back(pos, DVD{dvd_vcf, info_ids}, strings);
 
       if(line_num % 500000 == 0){
         SPDLOG_INFO("DB<DVD> parsed {} lines.", line_num);
@@ -495,8 +921,8 @@ public:
       line_num++;
     }
 
-    for(auto& [chr, vec] : db_map){
-      if(!std::ranges::is_sorted(vec, {}, &PosDVD::first)){
+    for(auto& [chr, table] : db_map){
+      if(!std::ranges::is_sorted(table.alleles.positions)){
         SPDLOG_ERROR("chr{} is not sorted!", Attr::ChrMap::idx2chr(chr));
         exit(1);
       }
@@ -506,7 +932,7 @@ public:
   void save(const Path& filename) override {
     this->set_build_time();
     this->log_metadata("DataBaseDVD");
-    save_archive_to(*this, filename);
+    save_flat_to(*this, filename);
   }
 
   void load(const Path& filename) override {
@@ -514,21 +940,22 @@ public:
     this->log_metadata("DataBaseDVD");
   }
 
-  std::optional<std::string> get_gene_symbol(const std::string& chr0, size_t pos0) {
+  std::optional<std::string> get_gene_symbol(const std::string& chr0, size_t pos0) const {
     auto it_chr = db_map.find(Attr::ChrMap::chr2idx(chr0));
     if (it_chr == db_map.end())
       return std::nullopt;
-    auto&& [_, vec] = *it_chr;
-    auto [s_it, e_it] = std::ranges::equal_range(vec, pos0, {}, &PosDVD::first);
-    for(auto it = s_it; it != e_it; ++ it){
-      if (!it->second.gene_symbol.empty() and it->second.consequence){
-        return it->second.gene_symbol;
+    auto& table = it_chr->second;
+    auto [s_idx, e_idx] = table.alleles.equal_range(pos0);
+    for(auto idx = s_idx; idx < e_idx; ++idx){
+      auto gene_symbol = strings[table.gene_symbols[idx]];
+      if (!gene_symbol.empty() and (table.flags[idx] & record_flags::consequence)){
+        return std::string{gene_symbol};
       }
     }
     return std::nullopt;
   }
 
-  std::optional<DVD> find(const std::string& chr, size_t pos, const std::string& ref, const std::string& alt) {
+  std::optional<DVD> find(const std::string& chr, size_t pos, const std::string& ref, const std::string& alt) const {
     auto it_chr = db_map.find(Attr::ChrMap::chr2idx(chr));
     if (it_chr == db_map.end())
       return std::nullopt;
@@ -538,21 +965,45 @@ public:
     if(ref == "-" or alt == "-")
       --pos;
 
-    auto& vec = it_chr->second;
-    auto [s_it, e_it] = std::ranges::equal_range(vec, pos, {}, &PosDVD::first);
-    for(auto it = s_it; it != e_it; ++ it){
-      auto& dvd = it->second;
-      if(dvd.ref == ref and dvd.alt == alt){
-        return dvd;
-      }
-    }
-
-    return std::nullopt;
+    auto& table = it_chr->second;
+    auto idx = table.alleles.find(table.alleles.equal_range(pos), ref, alt, strings);
+    if(!idx.has_value())
+      return std::nullopt;
+    return table.record(*idx, strings);
   }
 
-  inline auto find(const SherlocMember& sher_mem) {
+  inline auto find(const SherlocMember& sher_mem) const {
     return find(sher_mem.chr, sher_mem.pos, sher_mem.ref, sher_mem.alt);
   }
+
+  /**
+   * @brief `find` of a batch of alleles, one column of results in the same order.
+   * The alleles of a chromosome are merged with its records in one pass.
+   */
+  std::vector<std::optional<DVD>> find_batch(std::span<const SherlocMember> sher_mems) const {
+    auto ret = std::vector<std::optional<DVD>>(sher_mems.size());
+    for_each_chr_run(sher_mems, [&](auto chr, auto offset, auto run){
+      auto it_chr = db_map.find(chr);
+      if (it_chr == db_map.end())
+        return;
+      auto& table = it_chr->second;
+      auto equal_range = table.alleles.cursor();
+      for(size_t idx = 0; idx < run.size(); ++idx){
+        auto& sher_mem = run[idx];
+        auto pos = sher_mem.pos;
+        if(sher_mem.ref == "-" or sher_mem.alt == "-") // same indel shift as `find`
+          --pos;
+        auto found = table.alleles.find(equal_range(pos), sher_mem.ref, sher_mem.alt, strings);
+        if(found.has_value()){
+          ret[offset + idx] = table.record(*found, strings);
+        }
+      }
+    });
+    return ret;
+  }
 };
 
 }
+
+BOOST_CLASS_VERSION(Sherloc::DB::DataBaseClinvar, 2)
+BOOST_CLASS_VERSION(Sherloc::DB::DataBaseDVD, 1)
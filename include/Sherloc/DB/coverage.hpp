@@ -1,8 +1,19 @@
 #pragma once
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <exception>
+#include <iterator>
+#include <optional>
+#include <stdexcept>
 #include <string>
 #include <set>
+#include <utility>
+#include <vector>
+#include <fmt/format.h>
 #include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/batch.hpp>
 #include <Sherloc/DB/hts.hpp>
 #include <Sherloc/sherloc_member.hpp>
 #include <Sherloc/Attr/utils.hpp>
@@ -41,35 +52,239 @@ public:
   }
 };
 
+/**
+ * @brief The coverage statuses of a chromosome as run starts (breakpoints)
+ *
+ * A run is one `uint32_t`, its start position shifted by 2 bits and its status ('0' - '3')
+ * in the low 2 bits, sorted by position. So `find` searches a flat array (4 bytes per
+ * breakpoint instead of a tree node) and the status comes with the matched breakpoint.
+ */
+class CoverageTrack {
+public:
+  static constexpr unsigned status_bits = 2;
+  static constexpr size_t max_pos = (size_t{1} << (32 - status_bits)) - 1;
+
+private:
+  FlatArray<uint32_t> runs;
+
+  static constexpr auto encode(size_t pos, uint32_t code){
+    return static_cast<uint32_t>(pos << status_bits) | code;
+  }
+
+  static auto decode(uint32_t run){
+    return Coverage{run >> status_bits, static_cast<char>('0' + (run & 0b11))};
+  }
+
+  // the largest key of `pos`, so the runs not after `pos` are the ones <= key
+  static auto key_of(size_t pos){
+    return encode(std::min(pos, max_pos), 0b11);
+  }
+
+public:
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & runs;
+  }
+
+  CoverageTrack() = default;
+
+  /**
+   * @brief From the runs sorted by position
+   */
+  template<std::input_iterator It>
+  CoverageTrack(It first, It last){
+    for(; first != last; ++first){
+      push_back(*first);
+    }
+  }
+
+  /**
+   * @param cov a run after the last one, status in '0' - '3'
+   */
+  void push_back(const Coverage& cov){
+    if(cov.status < '0' or cov.status > '3'){
+      throw std::invalid_argument(fmt::format("CoverageTrack: unknown status '{}'", cov.status));
+    }
+    if(cov.pos > max_pos){
+      throw std::invalid_argument(fmt::format("CoverageTrack: position {} over {}", cov.pos, max_pos));
+    }
+    if(!runs.empty() and cov.pos <= (runs.back() >> status_bits)){
+      throw std::invalid_argument(fmt::format("CoverageTrack: position {} after {} is not sorted",
+        cov.pos, runs.back() >> status_bits));
+    }
+    runs.push_back(encode(cov.pos, static_cast<uint32_t>(cov.status - '0')));
+  }
+
+  [[nodiscard]] size_t size() const { return runs.size(); }
+  [[nodiscard]] bool empty() const { return runs.empty(); }
+  [[nodiscard]] size_t bytes() const { return runs.size() * sizeof(uint32_t); }
+
+  [[nodiscard]] Coverage operator[](size_t idx) const {
+    return decode(runs[idx]);
+  }
+
+  /**
+   * @brief The run containing `pos`, i.e. the last one starting at or before it.
+   * A branchless binary search, the two possible next probes are prefetched.
+   */
+  [[nodiscard]] Coverage find(size_t pos) const {
+    auto key = key_of(pos);
+    if(runs.empty() or runs[0] > key){
+      return Coverage{0};
+    }
+    auto base = runs.data();
+    auto n = runs.size();
+    while(n > 1){
+      auto half = n / 2;
+      __builtin_prefetch(base + half / 2);
+      __builtin_prefetch(base + half + half / 2);
+      base = base[half] <= key ? base + half : base;
+      n -= half;
+    }
+    return decode(*base);
+  }
+
+  /**
+   * @brief `find` of positions in non decreasing order, one call per position, each search
+   * gallops from the previous run
+   */
+  [[nodiscard]] auto cursor() const {
+    return [cursor = GallopCursor(runs), this](size_t pos) mutable {
+      auto it = cursor.floor(key_of(pos));
+      return it == runs.end() ? Coverage{0} : decode(*it);
+    };
+  }
+};
+
 class DataBaseCoverage : public BaseDB {
 public:
-  std::vector<std::set<Coverage>> db_map;
+  std::vector<CoverageTrack> db_map;
+
+  // threads of `from`, the chromosomes are built in parallel if the coverage file is indexed
+  int thread_num = 4;
 
-  HOLMES_SERIALIZE(ar, _ver) {
+  HOLMES_SERIALIZE(ar, version) {
     ar & db_version;
     ar & db_build_time;
+    if constexpr (Archive::is_loading::value){
+      if(version == 0){ // built before the tracks, a tree of the runs per chromosome
+        auto trees = std::vector<std::set<Coverage>>{};
+        ar & trees;
+        db_map.clear();
+        for(auto& tree : trees){
+          db_map.emplace_back(tree.begin(), tree.end());
+        }
+        return;
+      }
+    }
     ar & db_map;
   }
 
-  void from(const Path& filename) override {
-    static constexpr auto tab_delimiter = Attr::delimiter('\t');
-    static constexpr auto version_prefix = std::string_view{"release/"};
-    spdlog::stopwatch sw;
-    size_t locus_idx, mean_idx, over_20_idx;
-    size_t pos_idx = 0;
-    bool is_old_format = false;
-    auto parse_chr_pos = [&](const std::vector<std::string>& cols, bool is_old_format){
-      size_t chr, pos;
-      if(is_old_format){
-        chr = Attr::ChrMap::chr2idx(cols[locus_idx]);
-        pos = std::stoul(cols[pos_idx]);
+  /**
+   * @brief Columns of the coverage TSV, the old format has "chrom" and "pos", the new one "locus"
+   */
+  struct Columns {
+    size_t locus = 0;
+    std::optional<size_t> pos; // old format only
+    size_t mean = 0;
+    size_t over_20 = 0;
+
+    static Columns from_header(std::string_view header_line){
+      auto header_index = Attr::make_header_index(header_line, Attr::delimiter('\t'));
+      auto columns = Columns{};
+      if(header_index.contains("locus")){
+        columns.locus = header_index.at("locus");
       }else{
-        auto [chr_str, pos_str] = Attr::explode(cols[locus_idx], ':');
-        chr = Attr::ChrMap::chr2idx(chr_str);
-        pos = std::stoul(pos_str);
+        columns.locus = header_index.at("chrom");
+        columns.pos = header_index.at("pos");
       }
-      return std::make_pair(chr, pos);
+      columns.mean = header_index.at("mean");
+      columns.over_20 = header_index.at("over_20");
+      return columns;
+    }
+  };
+
+  /**
+   * @brief Parse the chromosome and the coverage of a line, the fields are not copied
+   * @return std::nullopt if a column is missing or malformed
+   */
+  static std::optional<std::pair<std::string_view, Coverage>> parse_line(
+    std::string_view line, const Columns& columns
+  ){
+    auto locus = std::string_view{}, pos_str = std::string_view{};
+    auto mean_str = std::string_view{}, over_20_str = std::string_view{};
+    auto last = std::max({columns.locus, columns.pos.value_or(0), columns.mean, columns.over_20});
+    for(size_t col = 0; col <= last; ++col){
+      auto tab = line.find('\t');
+      auto field = line.substr(0, tab);
+      if(col == columns.locus) locus = field;
+      if(col == columns.pos) pos_str = field;
+      if(col == columns.mean) mean_str = field;
+      if(col == columns.over_20) over_20_str = field;
+      if(tab == std::string_view::npos){
+        if(col < last) return std::nullopt;
+        break;
+      }
+      line.remove_prefix(tab + 1);
+    }
+
+    auto chr = locus;
+    if(!columns.pos.has_value()){ // "chr1:12345"
+      auto colon = locus.rfind(':');
+      if(colon == std::string_view::npos) return std::nullopt;
+      chr = locus.substr(0, colon);
+      pos_str = locus.substr(colon + 1);
+    }
+    auto parse = [](std::string_view str, auto& value){
+      auto [ptr, ec] = std::from_chars(str.data(), str.data() + str.size(), value);
+      return ec == std::errc{} and ptr == str.data() + str.size();
     };
+    auto pos = size_t{0};
+    auto mean = 0., over_20 = 0.;
+    if(!parse(pos_str, pos) or !parse(mean_str, mean) or !parse(over_20_str, over_20)){
+      return std::nullopt;
+    }
+    return std::pair{chr, Coverage{pos, mean, over_20}};
+  }
+
+  /**
+   * @brief Append the run of a coverage to a track if its status changed
+   */
+  static void add_run(CoverageTrack& track, const Coverage& cov){
+    if(track[track.size() - 1].status != cov.status){
+      track.push_back(cov);
+    }
+  }
+
+  /**
+   * @brief Call `fn(chr, cov)` on each line left in `hts`, throws std::runtime_error on the
+   * lines that can't be read or parsed
+   */
+  template<class Fn>
+  static void for_each_line(HTS_File& hts, const Columns& columns, Fn&& fn){
+    auto status = HTS_File::HTS_Status{};
+    while((status = hts.parse_line()) != HTS_File::HTS_EOF){
+      if(status == HTS_File::READ_RECORD_FAILED){
+        throw std::runtime_error("Coverage: reading a line failed");
+      }
+      auto parsed = parse_line(hts.line, columns);
+      if(!parsed.has_value()){
+        throw std::runtime_error(fmt::format("Coverage: malformed line '{}'", hts.line));
+      }
+      fn(parsed->first, parsed->second);
+    }
+  }
+
+  /**
+   * @brief Build from the gnomAD coverage summary TSV, whose url is the first word of `filename`
+   *
+   * With a tabix index, each chromosome is read by its own region query and `thread_num`
+   * chromosomes are built at once. Without one the file is read sequentially, on one thread.
+   * The gnomAD coverage summary ("locus" column, e.g. chr1:12345) has no tabix index, since
+   * tabix needs the chromosome and the position in their own columns, see docs/Database.md
+   * to add them.
+   */
+  void from(const Path& filename) override {
+    static constexpr auto version_prefix = std::string_view{"release/"};
 
     auto url = std::string{};
     {
@@ -86,81 +301,109 @@ public:
     auto hts = HTS_File{url};
 
     // get header col indices
-    int total_cols = 0;
+    auto columns = Columns{};
     {
       auto status = hts.parse_line();
       if(status != HTS_File::HTS_Status::OK){
         SPDLOG_ERROR("Can't read `{}`, status code: {}", url, int(status));
         exit(1);
       }
-      auto header_index = Attr::make_header_index(hts.line, tab_delimiter);
-      is_old_format = !header_index.contains("locus");
-      if(is_old_format){ // old format: "chrom pos", new format "locus"
-        locus_idx = header_index.at("chrom");
-        pos_idx = header_index.at("pos");
-      } else {
-        locus_idx = header_index.at("locus");
-      }
-      mean_idx = header_index.at("mean");
-      over_20_idx = header_index.at("over_20");
+      columns = Columns::from_header(hts.line);
       SPDLOG_INFO("Indices: {}, mean: {}, over20: {} (, pos_idx: {})",
-        locus_idx, mean_idx, over_20_idx, pos_idx);
+        columns.locus, columns.mean, columns.over_20, columns.pos.value_or(0));
     }
 
-    db_map = std::vector<std::set<Coverage>>(
-      Attr::ChrMap::approved_chr.size(), {Coverage{0}});
+    db_map = std::vector<CoverageTrack>(Attr::ChrMap::approved_chr.size());
+    for(auto& track : db_map){
+      track.push_back(Coverage{0});
+    }
 
-    size_t pre_chr = 0;
-    char pre_status = '0';
-    auto cols = std::vector<std::string>{};
-    size_t line_num = 0;
-    auto status = HTS_File::HTS_Status{};
-    while((status = hts.parse_line()) != HTS_File::HTS_EOF){
-      if(status == HTS_File::READ_RECORD_FAILED){
-        SPDLOG_ERROR("Parsing line num {} failed!", line_num);
-        exit(1);
-      }
-      boost::split(cols, hts.line, tab_delimiter);
-      double mean, over_20;
+    // one region per approved chromosome of the index
+    auto regions = std::vector<std::pair<size_t, std::string>>{};
+    for(auto& name : hts.index_seqnames()){
       try{
-        mean = std::stod(cols[mean_idx]);
-        over_20 = std::stod(cols[over_20_idx]);
-      }catch(std::invalid_argument& e){
-        SPDLOG_ERROR("Coverage parse double exception: mean = '{}', over_20 = '{}'",
-          cols[mean_idx], cols[over_20_idx]);
-        exit(1);
+        auto chr = Attr::ChrMap::chr2idx(name);
+        if(std::ranges::find(regions, chr, &decltype(regions)::value_type::first) == regions.end()){
+          regions.emplace_back(chr, name);
+        }
+      }catch(std::out_of_range& e){
+        // not an approved chromosome
+      }
+    }
+
+    // exceptions can't leave the omp loop, keep the first one
+    auto error = std::exception_ptr{};
+    if(regions.empty()){
+      SPDLOG_INFO("No tabix index of `{}`, the chromosomes are read sequentially", url);
+      try {
+        build_sequential(hts, columns);
+      } catch (...) {
+        error = std::current_exception();
       }
+    }else{
+      #pragma omp parallel for schedule(dynamic) num_threads(std::max(1, thread_num))
+      for(size_t idx = 0; idx < regions.size(); ++idx){
+        auto& [chr, name] = regions[idx];
+        try {
+          spdlog::stopwatch sw;
+          auto reader = HTS_File{url};
+          reader.query(name);
+          auto& track = db_map[chr];
+          for_each_line(reader, columns, [&track](auto, const Coverage& cov){
+            add_run(track, cov);
+          });
+          SPDLOG_INFO("chr{} done, {} runs, spend {}s", Attr::ChrMap::idx2chr(chr), track.size(), sw);
+        } catch (...) {
+          #pragma omp critical(coverage_builder_error)
+          if (!error) error = std::current_exception();
+        }
+      }
+    }
 
-      Coverage cov{0, mean, over_20};
-      size_t chr;
+    if(error){
       try {
-        std::tie(chr, cov.pos) = parse_chr_pos(cols, is_old_format);
-      } catch (std::invalid_argument& e) {
-        SPDLOG_ERROR("line: '{}'", hts.line);
+        std::rethrow_exception(error);
+      } catch (std::exception& e) {
+        SPDLOG_ERROR("Building coverage failed: {}", e.what());
         exit(1);
       }
+    }
+  }
+
+private:
+  void build_sequential(HTS_File& hts, const Columns& columns){
+    spdlog::stopwatch sw;
+    auto pre_chr = std::string{};
+    auto chr_idx = std::optional<size_t>{};
+    size_t line_num = 0;
+    for_each_line(hts, columns, [&](std::string_view chr, const Coverage& cov){
       if(++line_num % 10000000 == 0){
-        SPDLOG_INFO("Parsed {} lines, chr = {}, pos = {}",
-          line_num, Attr::ChrMap::idx2chr(chr), cov.pos);
+        SPDLOG_INFO("Parsed {} lines, chr = {}, pos = {}", line_num, chr, cov.pos);
       }
       if(chr != pre_chr){
-        SPDLOG_INFO("chr{} done, spend {}s", Attr::ChrMap::idx2chr(pre_chr), sw);
+        if(!pre_chr.empty()){
+          SPDLOG_INFO("{} done, spend {}s", pre_chr, sw);
+        }
         sw.reset();
         pre_chr = chr;
-        pre_status = '0';
+        try{
+          chr_idx = Attr::ChrMap::chr2idx(std::string{chr});
+        }catch(std::out_of_range& e){
+          chr_idx = std::nullopt;
+        }
       }
-      if(cov.status == pre_status)
-        continue;
-      db_map[chr].emplace(cov);
-      pre_status = cov.status;
-    }
-    SPDLOG_INFO("chr{} done, spend {}s", Attr::ChrMap::idx2chr(pre_chr), sw);
+      if(chr_idx.has_value()){
+        add_run(db_map[*chr_idx], cov);
+      }
+    });
+    SPDLOG_INFO("{} done, spend {}s", pre_chr, sw);
   }
 
+public:
   void save(const Path& filename) override {
     this->set_build_time();
     this->log_metadata("DataBaseCoverage");
-    save_archive_to(*this, filename);
+    save_flat_to(*this, filename);
   }
 
   void load(const Path& filename) override {
@@ -168,15 +411,38 @@ public:
     this->log_metadata("DataBaseCoverage");
   }
 
-  Coverage find(const std::string& chr0, size_t pos0){
-    auto chr_num = Attr::ChrMap::chr2idx(chr0);
-    auto it = db_map[chr_num].upper_bound(Coverage{pos0});
-    return *std::prev(it);
+  Coverage find(const std::string& chr0, size_t pos0) const {
+    return db_map[Attr::ChrMap::chr2idx(chr0)].find(pos0);
   }
 
-  Coverage find(const SherlocMember& sher_mem){
+  Coverage find(const SherlocMember& sher_mem) const {
     return find(sher_mem.chr, sher_mem.pos);
   }
+
+  /**
+   * @brief `find` of a batch of alleles, one column of results in the same order.
+   * The runs of a chromosome are walked forward from the previous allele.
+   */
+  std::vector<Coverage> find_batch(std::span<const SherlocMember> sher_mems) const {
+    auto ret = std::vector<Coverage>(sher_mems.size());
+    for_each_chr_run(sher_mems, [&](auto chr, auto offset, auto run){
+      auto find_next = db_map[chr].cursor();
+      for(size_t idx = 0; idx < run.size(); ++idx){
+        ret[offset + idx] = find_next(run[idx].pos);
+      }
+    });
+    return ret;
+  }
+
+  [[nodiscard]] size_t bytes() const {
+    auto sum = size_t{0};
+    for(auto& track : db_map){
+      sum += track.bytes();
+    }
+    return sum;
+  }
 };
 
 }
+
+BOOST_CLASS_VERSION(Sherloc::DB::DataBaseCoverage, 1)
@@ -16,6 +16,7 @@
 #include <spdlog/spdlog.h>
 #include <Sherloc/Attr/clinical_keywords.hpp>
 #include <Sherloc/Attr/allele.hpp>
+#include <Sherloc/DB/flat.hpp>
 
 #define HOLMES_SERIALIZE(ar, version) \
   friend class boost::serialization::access; \
@@ -39,8 +40,17 @@ concept BoostSavable =
     { arc & t } -> std::convertible_to<boost::archive::binary_oarchive&>;
   };
 
+/**
+ * @brief Load a database saved by `save_flat_to` (mapped in place) or `save_archive_to`
+ * (zstd boost archive), the format is detected from the file magic
+ */
 template<BoostLoadable DataBase>
 inline void load_archive_from(DataBase& db, const std::filesystem::path& file_name){
+  if(is_flat_file(file_name)){
+    load_flat_from(db, file_name);
+    return;
+  }
+
   // construct boost gzip in stream
   std::ifstream file(file_name, std::ios_base::in | std::ios_base::binary);
   bios::filtering_streambuf<bios::input> fin;
@@ -0,0 +1,330 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <optional>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/exac.hpp>
+#include <Sherloc/DB/clinvar.hpp>
+#include <Sherloc/DB/coverage.hpp>
+#include <Sherloc/sherloc_member.hpp>
+
+/**
+ * Wire protocol between `holmes_dbd` and `sherloc --db_server`
+ *
+ * Every message is a frame of [ u64 payload size | boost binary archive ] on a Unix domain
+ * socket. The client sends a `DBRequest` holding a batch of alleles, the server replies
+ * one `DBResponse` with the answers in the same order.
+ */
+
+namespace Sherloc::DB {
+
+/**
+ * @brief An allele looked up by the population rules, the gene names are the
+ * ones of `SherlocMember::variants` (used by the gene info lookup)
+ */
+struct AlleleQuery {
+  std::string chr;
+  size_t pos = 0;
+  std::string ref;
+  std::string alt;
+  std::vector<std::string> genes;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & chr;
+    ar & pos;
+    ar & ref;
+    ar & alt;
+    ar & genes;
+  }
+
+  AlleleQuery() = default;
+
+  AlleleQuery(const SherlocMember& sher_mem):
+    chr(sher_mem.chr), pos(sher_mem.pos), ref(sher_mem.ref), alt(sher_mem.alt)
+  {
+    genes.reserve(sher_mem.variants.size());
+    for(auto& variant : sher_mem.variants){
+      genes.emplace_back(variant.gene_name);
+    }
+  }
+
+  [[nodiscard]] auto to_sher_mem() const {
+    auto sher_mem = SherlocMember(chr, pos, ref, alt);
+    sher_mem.variants.resize(genes.size());
+    for(size_t idx = 0; idx < genes.size(); ++idx){
+      sher_mem.variants[idx].gene_name = genes[idx];
+    }
+    return sher_mem;
+  }
+
+  static auto key_of(const SherlocMember& sher_mem){
+    return fmt::format("{}:{}:{}:{}", sher_mem.chr, sher_mem.pos, sher_mem.ref, sher_mem.alt);
+  }
+};
+
+/**
+ * @brief Results of all the allele keyed lookups of one `AlleleQuery`
+ */
+struct AlleleAnswer {
+  float k_af = 0.f;
+
+  bool has_clinvar = false;
+  Clinvar clinvar;
+
+  bool has_dvd = false;
+  DVD dvd;
+
+  std::vector<char> gene_info;
+
+  // the fields of `Exac` used by the rules
+  size_t gnom_pos = 0;
+  std::string gnom_ref;
+  std::string gnom_alt;
+  char gnom_status = '0';
+  char gnom_hom = '0';
+
+  Coverage coverage;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & k_af;
+    ar & has_clinvar;
+    ar & clinvar;
+    ar & has_dvd;
+    ar & dvd;
+    ar & gene_info;
+    ar & gnom_pos;
+    ar & gnom_ref;
+    ar & gnom_alt;
+    ar & gnom_status;
+    ar & gnom_hom;
+    ar & coverage;
+  }
+
+  void set_exac(const Exac& exac){
+    gnom_pos = exac.pos;
+    gnom_ref = exac.ref;
+    gnom_alt = exac.alt;
+    gnom_status = exac.status;
+    gnom_hom = exac.hom;
+  }
+
+  [[nodiscard]] auto get_exac() const {
+    auto exac = Exac(gnom_ref, gnom_alt);
+    exac.pos = gnom_pos;
+    exac.status = gnom_status;
+    exac.hom = gnom_hom;
+    return exac;
+  }
+};
+
+struct DBRequest {
+  std::vector<AlleleQuery> alleles;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & alleles;
+  }
+};
+
+struct DBResponse {
+  std::vector<AlleleAnswer> answers;
+  std::string error; // not empty if the server failed on the batch
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & answers;
+    ar & error;
+  }
+};
+
+namespace remote {
+
+  // the largest frame accepted, a length above it is a corrupted or foreign stream
+  // (a batch is one chromosome of alleles, far below this)
+  inline constexpr auto max_frame_size = uint64_t{1} << 30;
+
+  inline void write_all(int fd, const char* buf, size_t n){
+    while(n > 0){
+      auto written = ::send(fd, buf, n, MSG_NOSIGNAL);
+      if(written < 0){
+        if(errno == EINTR) continue;
+        throw std::runtime_error(fmt::format("db remote: send failed: {}", std::strerror(errno)));
+      }
+      buf += written;
+      n -= static_cast<size_t>(written);
+    }
+  }
+
+  /**
+   * @return false if the peer closed the connection before the first byte
+   */
+  inline bool read_all(int fd, char* buf, size_t n){
+    auto first = true;
+    while(n > 0){
+      auto got = ::recv(fd, buf, n, 0);
+      if(got < 0){
+        if(errno == EINTR) continue;
+        throw std::runtime_error(fmt::format("db remote: recv failed: {}", std::strerror(errno)));
+      }
+      if(got == 0){
+        if(first) return false;
+        throw std::runtime_error("db remote: connection closed in the middle of a frame");
+      }
+      first = false;
+      buf += got;
+      n -= static_cast<size_t>(got);
+    }
+    return true;
+  }
+
+  template<class Message>
+  inline void send_frame(int fd, const Message& message){
+    auto os = std::ostringstream{};
+    {
+      auto arc = boost::archive::binary_oarchive(os, boost::archive::no_header);
+      arc & message;
+    }
+    auto payload = os.str();
+    auto size = static_cast<uint64_t>(payload.size());
+    if(size > max_frame_size){
+      throw std::runtime_error(fmt::format(
+        "db remote: frame of {} bytes exceeds the maximum {}", size, max_frame_size));
+    }
+    write_all(fd, reinterpret_cast<const char*>(&size), sizeof(size));
+    write_all(fd, payload.data(), payload.size());
+  }
+
+  /**
+   * @return false if the peer closed the connection
+   * @throw std::runtime_error if the frame is larger than `max_frame_size`
+   */
+  template<class Message>
+  inline bool recv_frame(int fd, Message& message){
+    auto size = uint64_t{0};
+    if(!read_all(fd, reinterpret_cast<char*>(&size), sizeof(size))){
+      return false;
+    }
+    if(size > max_frame_size){
+      throw std::runtime_error(fmt::format(
+        "db remote: frame of {} bytes exceeds the maximum {}", size, max_frame_size));
+    }
+    auto payload = std::string(size, '\0');
+    if(size > 0 and !read_all(fd, payload.data(), payload.size())){
+      throw std::runtime_error("db remote: connection closed in the middle of a frame");
+    }
+    auto is = std::istringstream{std::move(payload)};
+    auto arc = boost::archive::binary_iarchive(is, boost::archive::no_header);
+    arc & message;
+    return true;
+  }
+
+  inline auto make_address(const Path& socket_path){
+    auto addr = sockaddr_un{};
+    addr.sun_family = AF_UNIX;
+    if(socket_path.native().size() >= sizeof(addr.sun_path)){
+      throw std::runtime_error(
+        fmt::format("db remote: socket path '{}' is too long", socket_path.c_str()));
+    }
+    std::strncpy(addr.sun_path, socket_path.c_str(), sizeof(addr.sun_path) - 1);
+    return addr;
+  }
+}
+
+/**
+ * @brief Client side of `holmes_dbd`
+ *
+ * `prefetch` sends the alleles of a batch at once and keeps the answers, so the per
+ * allele lookups afterwards don't go through the socket. `lookup` is thread safe.
+ */
+class DBClient {
+private:
+  int fd = -1;
+  Path socket_path;
+  std::unordered_map<std::string, AlleleAnswer> answers; // node based, references stay valid
+  std::mutex mutex;
+
+  auto query(DBRequest& request){
+    remote::send_frame(fd, request);
+    auto response = DBResponse{};
+    if(!remote::recv_frame(fd, response)){
+      throw std::runtime_error(
+        fmt::format("DBClient: holmes_dbd at '{}' closed the connection", socket_path.c_str()));
+    }
+    if(!response.error.empty()){
+      throw std::runtime_error(fmt::format("DBClient: holmes_dbd error: {}", response.error));
+    }
+    if(response.answers.size() != request.alleles.size()){
+      throw std::runtime_error("DBClient: holmes_dbd answered a different number of alleles");
+    }
+    return response.answers;
+  }
+
+public:
+  DBClient(const Path& socket_path): socket_path(socket_path) {
+    fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(fd < 0){
+      throw std::runtime_error(fmt::format("DBClient: socket failed: {}", std::strerror(errno)));
+    }
+    auto addr = remote::make_address(socket_path);
+    if(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0){
+      auto err = errno;
+      ::close(fd);
+      throw std::runtime_error(fmt::format("DBClient: can't connect to holmes_dbd at '{}': {}",
+        socket_path.c_str(), std::strerror(err)));
+    }
+    SPDLOG_INFO("DBClient: connected to holmes_dbd at '{}'", socket_path.c_str());
+  }
+
+  DBClient(const DBClient&) = delete;
+  DBClient& operator=(const DBClient&) = delete;
+
+  ~DBClient(){
+    if(fd >= 0){
+      ::close(fd);
+    }
+  }
+
+  /**
+   * @brief Look up all the alleles in one round trip, replacing the previous answers
+   */
+  void prefetch(const std::vector<SherlocMember>& sher_mems){
+    auto request = DBRequest{};
+    request.alleles.reserve(sher_mems.size());
+    for(auto& sher_mem : sher_mems){
+      request.alleles.emplace_back(sher_mem);
+    }
+    auto lock = std::lock_guard{mutex};
+    auto batch = query(request);
+
+    answers.clear();
+    answers.reserve(batch.size());
+    for(size_t idx = 0; idx < batch.size(); ++idx){
+      answers.insert_or_assign(AlleleQuery::key_of(sher_mems[idx]), std::move(batch[idx]));
+    }
+  }
+
+  /**
+   * @brief The answer of an allele, from the prefetched batch or asked on its own
+   */
+  const AlleleAnswer& lookup(const SherlocMember& sher_mem){
+    auto key = AlleleQuery::key_of(sher_mem);
+    auto lock = std::lock_guard{mutex};
+    if(auto it = answers.find(key); it != answers.end()){
+      return it->second;
+    }
+    auto request = DBRequest{{AlleleQuery(sher_mem)}};
+    return answers.insert_or_assign(std::move(key), std::move(query(request).front())).first->second;
+  }
+};
+
+}
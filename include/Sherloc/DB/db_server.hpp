@@ -0,0 +1,223 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <csignal>
+#include <list>
+#include <thread>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <Sherloc/DB/dbset.hpp>
+#include <Sherloc/DB/db_remote.hpp>
+#include <spdlog/spdlog.h>
+#include <spdlog/stopwatch.h>
+
+namespace Sherloc::DB {
+
+/**
+ * @brief Serves the allele lookups of one loaded `DBSet` to `sherloc --db_server` clients
+ * over a Unix domain socket
+ *
+ * Each client gets its own thread, their batches are answered concurrently: `answer_batch`
+ * only reads the databases, the decoded gnomAD chunks are shared through the thread safe
+ * `GnomChunkCache`.
+ * SIGINT / SIGTERM are taken through a signalfd polled next to the listening socket, they
+ * must be blocked in every thread (see `block_stop_signals`). On stop, the client connections
+ * are shut down and their threads joined before `run` returns.
+ */
+class DBServer {
+private:
+  struct Client {
+    int fd;
+    std::thread thread;
+    std::atomic<bool> done = false;
+  };
+
+  DBSet& db;
+  Path socket_path;
+  int listen_fd = -1;
+  int lookup_threads;
+  std::list<Client> clients; // only touched by the thread of `run`
+
+  auto answer(const DBRequest& request){
+    auto response = DBResponse{};
+    auto sher_mems = std::vector<SherlocMember>{};
+    sher_mems.reserve(request.alleles.size());
+    for(auto& query : request.alleles){
+      sher_mems.emplace_back(query.to_sher_mem());
+    }
+    try{
+      response.answers = db.answer_batch(sher_mems, lookup_threads);
+    }catch(const std::exception& e){
+      response.answers.clear();
+      response.error = e.what();
+    }
+    return response;
+  }
+
+  /**
+   * @brief Answer the requests of a client until it disconnects (or is shut down),
+   * the fd is closed by the owner of `clients` after the join
+   */
+  void serve_client(Client& client){
+    try{
+      auto request = DBRequest{};
+      while(remote::recv_frame(client.fd, request)){
+        spdlog::stopwatch sw;
+        auto response = answer(request);
+        remote::send_frame(client.fd, response);
+        SPDLOG_DEBUG("DBServer: answered {} alleles in {:.3f} sec.", request.alleles.size(), sw);
+      }
+    }catch(const std::exception& e){
+      SPDLOG_WARN("DBServer: client dropped: {}", e.what());
+    }
+    client.done = true;
+  }
+
+  /**
+   * @brief Join and close the clients, all of them or only the ones already disconnected
+   */
+  void reap_clients(bool all){
+    for(auto it = clients.begin(); it != clients.end();){
+      if(!all and !it->done){
+        ++it;
+        continue;
+      }
+      if(all){
+        // wakes up a thread blocked in recv, a request being answered finishes first
+        ::shutdown(it->fd, SHUT_RDWR);
+      }
+      it->thread.join();
+      ::close(it->fd);
+      it = clients.erase(it);
+    }
+  }
+
+  /**
+   * @brief Fails if another server is listening on the path, a stale socket file
+   * (connection refused) is removed
+   */
+  static void remove_stale_socket(const Path& socket_path){
+    auto probe = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(probe < 0){
+      throw std::runtime_error(fmt::format("DBServer: socket failed: {}", std::strerror(errno)));
+    }
+    auto addr = remote::make_address(socket_path);
+    auto connected = ::connect(probe, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == 0;
+    auto err = errno;
+    ::close(probe);
+    if(connected){
+      throw std::runtime_error(fmt::format(
+        "DBServer: another server is listening on '{}'", socket_path.c_str()));
+    }
+    if(err == ECONNREFUSED){
+      SPDLOG_INFO("DBServer: remove the stale socket '{}'", socket_path.c_str());
+      std::filesystem::remove(socket_path);
+    }
+  }
+
+public:
+  /**
+   * @brief Block SIGINT / SIGTERM in the calling thread, and in the threads it starts afterwards.
+   * Call it before any other thread is started (e.g. the DB loading), so the signals are only
+   * received by `run`.
+   */
+  static auto block_stop_signals(){
+    auto signals = sigset_t{};
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    if(auto err = ::pthread_sigmask(SIG_BLOCK, &signals, nullptr); err != 0){
+      throw std::runtime_error(fmt::format("DBServer: pthread_sigmask failed: {}", std::strerror(err)));
+    }
+    return signals;
+  }
+
+  /**
+   * @param lookup_threads threads decoding the gnomAD chunks of a batch (see `DBSet::answer_batch`)
+   */
+  DBServer(DBSet& db, const Path& socket_path, int lookup_threads = 1):
+    db(db), socket_path(socket_path), lookup_threads(lookup_threads)
+  {
+    remove_stale_socket(socket_path);
+    listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if(listen_fd < 0){
+      throw std::runtime_error(fmt::format("DBServer: socket failed: {}", std::strerror(errno)));
+    }
+    auto addr = remote::make_address(socket_path);
+    if(::bind(listen_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 or
+       ::listen(listen_fd, SOMAXCONN) != 0){
+      auto err = errno;
+      ::close(listen_fd);
+      throw std::runtime_error(fmt::format("DBServer: can't listen on '{}': {}",
+        socket_path.c_str(), std::strerror(err)));
+    }
+  }
+
+  DBServer(const DBServer&) = delete;
+  DBServer& operator=(const DBServer&) = delete;
+
+  ~DBServer(){
+    reap_clients(true);
+    if(listen_fd >= 0){
+      ::close(listen_fd);
+    }
+    std::filesystem::remove(socket_path);
+  }
+
+  /**
+   * @brief Accept clients until SIGINT / SIGTERM, then stop the clients
+   */
+  void run(){
+    auto signals = block_stop_signals();
+    auto signal_fd = ::signalfd(-1, &signals, SFD_CLOEXEC);
+    if(signal_fd < 0){
+      throw std::runtime_error(fmt::format("DBServer: signalfd failed: {}", std::strerror(errno)));
+    }
+
+    SPDLOG_INFO("DBServer: listening on '{}'", socket_path.c_str());
+    auto fds = std::array<pollfd, 2>{
+      pollfd{listen_fd, POLLIN, 0},
+      pollfd{signal_fd, POLLIN, 0}
+    };
+    try{
+      while(true){
+        if(::poll(fds.data(), fds.size(), -1) < 0){
+          if(errno == EINTR) continue;
+          throw std::runtime_error(fmt::format("DBServer: poll failed: {}", std::strerror(errno)));
+        }
+        if(fds[1].revents & POLLIN){
+          auto info = signalfd_siginfo{};
+          if(::read(signal_fd, &info, sizeof(info)) == sizeof(info)){
+            SPDLOG_INFO("DBServer: got signal {}, stopping", info.ssi_signo);
+          }
+          break;
+        }
+        if(!(fds[0].revents & POLLIN)){
+          continue;
+        }
+        auto client_fd = ::accept(listen_fd, nullptr, nullptr);
+        if(client_fd < 0){
+          if(errno == EINTR or errno == ECONNABORTED) continue;
+          throw std::runtime_error(fmt::format("DBServer: accept failed: {}", std::strerror(errno)));
+        }
+        reap_clients(false);
+        auto& client = clients.emplace_back(client_fd);
+        client.thread = std::thread([this, &client]{ serve_client(client); });
+      }
+    }catch(...){
+      ::close(signal_fd);
+      reap_clients(true);
+      throw;
+    }
+    ::close(signal_fd);
+    reap_clients(true);
+    SPDLOG_INFO("DBServer: stopped");
+  }
+};
+
+}
@@ -8,10 +8,13 @@
 #include <Sherloc/DB/gtf.hpp>
 #include <Sherloc/DB/uniprot.hpp>
 #include <Sherloc/DB/gene_info.hpp>
-
-#define DB_BENCHMARK(db, line, sw) \
-  (sw).reset(); line; \
-  SPDLOG_INFO("[ DBSet ] Loading <{}> takes {:.2f} sec.", db, (sw));
+#include <Sherloc/DB/db_remote.hpp>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <span>
+#include <omp.h>
+#include <spdlog/stopwatch.h>
 
 #define HOLMES_MAKE_TAG(tag) #tag
 
@@ -47,6 +50,9 @@ public:
 
   Path base_dir;
 
+  // set in client mode, the allele keyed lookups are answered by `holmes_dbd`
+  std::unique_ptr<DBClient> remote;
+
   static constexpr auto db_names = Attr::make_sv_array(
     "1kg", "clinvar", "dvd", "coverage", "gnom", "gene_info", "gtf", "uniprot"
   );
@@ -136,7 +142,23 @@ public:
   }
 
   DBSet() = default;
-  DBSet(const Path& config_file, const std::optional<Path>& assembly_file = std::nullopt){
+
+  /**
+   * @brief Load the databases in parallel
+   * 
+   * @param config_file db config json
+   * @param assembly_file fasta file, default to the `fasta` entry of config
+   * @param load_threads number of databases loaded at the same time
+   * @param db_server socket of a running `holmes_dbd`. If given, 1kg, dvd, coverage, gnomAD
+   * and gene info are not loaded, their lookups (and the clinvar allele lookup) are sent to
+   * the server. clinvar, fasta, gtf and uniprot are still loaded for the variant rules.
+   */
+  DBSet(
+    const Path& config_file,
+    const std::optional<Path>& assembly_file = std::nullopt,
+    int load_threads = 1,
+    const std::optional<Path>& db_server = std::nullopt
+  ){
     auto config = Attr::load_json(config_file,
       fmt::format("DBSet: config_file '{}' can't be opened!", config_file.c_str()));
 
@@ -144,21 +166,198 @@ public:
 
     auto checked_paths = make_checked_path(config, base_dir);
 
+    if(db_server.has_value()){
+      remote = std::make_unique<DBClient>(db_server.value());
+      load_all({
+        {"clinvar",   &db_clinvar,    checked_paths["clinvar"]},
+        {"fasta",     &db_fasta,      assembly_file.value_or(checked_paths["fasta"])},
+        {"gtf",       &db_gtf,        checked_paths["gtf"]},
+        {"uniprot",   &db_uniprot,    checked_paths["uniprot"]},
+      }, load_threads);
+      return;
+    }
+
     // load db
-    spdlog::stopwatch sw;
-    DB_BENCHMARK("1kg", db_1kg.load(checked_paths["1kg"]), sw);
-    DB_BENCHMARK("clinvar", db_clinvar.load(checked_paths["clinvar"]), sw);
-    DB_BENCHMARK("dvd", db_dvd.load(checked_paths["dvd"]), sw);
-    DB_BENCHMARK("coverage", db_coverage.load(checked_paths["coverage"]), sw);
-    DB_BENCHMARK("gnom", db_gnom.load(checked_paths["gnom"]), sw);
-    DB_BENCHMARK("gene_info", db_gene_info.load(checked_paths["gene_info"]), sw);
-    DB_BENCHMARK("fasta", db_fasta.load(
-      assembly_file.has_value() ?
-        assembly_file.value() :
-        checked_paths["fasta"]
-    ), sw);
-    DB_BENCHMARK("gtf", db_gtf.load(checked_paths["gtf"]), sw);
-    DB_BENCHMARK("uniprot", db_uniprot.load(checked_paths["uniprot"]), sw);
+    load_all({
+      {"1kg",       &db_1kg,        checked_paths["1kg"]},
+      {"clinvar",   &db_clinvar,    checked_paths["clinvar"]},
+      {"dvd",       &db_dvd,        checked_paths["dvd"]},
+      {"coverage",  &db_coverage,   checked_paths["coverage"]},
+      {"gnom",      &db_gnom,       checked_paths["gnom"]},
+      {"gene_info", &db_gene_info,  checked_paths["gene_info"]},
+      {"fasta",     &db_fasta,      assembly_file.value_or(checked_paths["fasta"])},
+      {"gtf",       &db_gtf,        checked_paths["gtf"]},
+      {"uniprot",   &db_uniprot,    checked_paths["uniprot"]},
+    }, load_threads);
+  }
+
+  [[nodiscard]] auto is_remote() const {
+    return remote != nullptr;
+  }
+
+  /**
+   * @brief Look up the alleles of a batch at once, the `find_*` of these alleles (the same
+   * objects) are then answered from the batch until `release_prefetch`.
+   * In client mode it's one round trip to the server, otherwise the alleles are merged with
+   * each local database in one pass (see `answer_batch`), on `threads` threads.
+   */
+  void prefetch(const std::vector<SherlocMember>& sher_mems, int threads = 1){
+    if(remote){
+      remote->prefetch(sher_mems);
+      return;
+    }
+    batch_answers = answer_batch(sher_mems, threads);
+    batch_mems = sher_mems;
+  }
+
+  void release_prefetch(){
+    batch_mems = {};
+    batch_answers.clear();
+  }
+
+  float find_1kg(const SherlocMember& sher_mem){
+    if(remote){
+      return remote->lookup(sher_mem).k_af;
+    }
+    if(auto answer = batch_answer(sher_mem)){
+      return answer->k_af;
+    }
+    return db_1kg.find(sher_mem);
+  }
+
+  std::optional<Clinvar> find_clinvar(const SherlocMember& sher_mem){
+    auto answer = remote ? &remote->lookup(sher_mem) : batch_answer(sher_mem);
+    if(answer){
+      return answer->has_clinvar ? std::optional{answer->clinvar} : std::nullopt;
+    }
+    return db_clinvar.find(sher_mem);
+  }
+
+  std::optional<DVD> find_dvd(const SherlocMember& sher_mem){
+    auto answer = remote ? &remote->lookup(sher_mem) : batch_answer(sher_mem);
+    if(answer){
+      return answer->has_dvd ? std::optional{answer->dvd} : std::nullopt;
+    }
+    return db_dvd.find(sher_mem);
+  }
+
+  std::vector<char> find_gene_info(const SherlocMember& sher_mem){
+    auto answer = remote ? &remote->lookup(sher_mem) : batch_answer(sher_mem);
+    return answer ? answer->gene_info : db_gene_info.find(sher_mem);
+  }
+
+  Exac find_gnom(const SherlocMember& sher_mem){
+    auto answer = remote ? &remote->lookup(sher_mem) : batch_answer(sher_mem);
+    return answer ? answer->get_exac() : db_gnom.find(sher_mem);
+  }
+
+  Coverage find_coverage(const SherlocMember& sher_mem){
+    auto answer = remote ? &remote->lookup(sher_mem) : batch_answer(sher_mem);
+    return answer ? answer->coverage : db_coverage.find(sher_mem);
+  }
+
+  /**
+   * @brief All the allele keyed lookups of one allele on the local databases (server side)
+   */
+  AlleleAnswer answer(const AlleleQuery& query){
+    return std::move(answer_batch(std::vector{query.to_sher_mem()}).front());
+  }
+
+  /**
+   * @brief All the allele keyed lookups of a batch of alleles on the local databases, each
+   * database answers the whole batch as one column (`find_batch`). The alleles should be
+   * grouped by chromosome and sorted by position, otherwise it's only slower.
+   * The gnomAD chunks (the costly part) are decoded on `threads` threads.
+   */
+  std::vector<AlleleAnswer> answer_batch(std::span<const SherlocMember> sher_mems, int threads = 1) const {
+    auto k_afs = db_1kg.find_batch(sher_mems);
+    auto clinvars = db_clinvar.find_batch(sher_mems);
+    auto dvds = db_dvd.find_batch(sher_mems);
+    auto exacs = db_gnom.find_batch(sher_mems, threads);
+    auto coverages = db_coverage.find_batch(sher_mems);
+
+    auto ret = std::vector<AlleleAnswer>(sher_mems.size());
+    for(size_t idx = 0; idx < sher_mems.size(); ++idx){
+      auto& answer = ret[idx];
+      answer.k_af = k_afs[idx];
+      if(clinvars[idx].has_value()){
+        answer.has_clinvar = true;
+        answer.clinvar = std::move(clinvars[idx].value());
+      }
+      if(dvds[idx].has_value()){
+        answer.has_dvd = true;
+        answer.dvd = std::move(dvds[idx].value());
+      }
+      answer.gene_info = db_gene_info.find(sher_mems[idx]);
+      answer.set_exac(exacs[idx]);
+      answer.coverage = coverages[idx];
+    }
+    return ret;
+  }
+
+private:
+  // the batch of the local `prefetch`, matched by address
+  std::span<const SherlocMember> batch_mems;
+  std::vector<AlleleAnswer> batch_answers;
+
+  const AlleleAnswer* batch_answer(const SherlocMember& sher_mem) const {
+    auto less = std::less<const SherlocMember*>{};
+    if(less(&sher_mem, batch_mems.data()) or !less(&sher_mem, batch_mems.data() + batch_mems.size())){
+      return nullptr;
+    }
+    return &batch_answers[&sher_mem - batch_mems.data()];
+  }
+
+  struct LoadTask {
+    std::string_view name;
+    BaseDB* db;
+    Path path;
+  };
+
+  static auto file_size_of(const Path& path){
+    auto ec = std::error_code{};
+    auto size = std::filesystem::file_size(path, ec);
+    return ec ? std::uintmax_t{0} : size; // e.g. gnomAD is a dir
+  }
+
+  /**
+   * @brief Each database is an independent archive, load them on `load_threads` threads.
+   * The largest one is started first. If any load fails, the other loads are still finished
+   * and the first error (in task order) is rethrown.
+   */
+  static void load_all(std::vector<LoadTask> tasks, int load_threads){
+    auto errors = std::vector<std::exception_ptr>(tasks.size());
+    auto sizes = std::vector<std::uintmax_t>(tasks.size());
+    auto order = std::vector<size_t>(tasks.size());
+    for(auto idx = size_t{0}; idx < tasks.size(); ++idx){
+      sizes[idx] = file_size_of(tasks[idx].path);
+      order[idx] = idx;
+    }
+    std::ranges::sort(order, std::greater{}, [&sizes](auto idx){ return sizes[idx]; });
+
+    spdlog::stopwatch total_sw;
+    #pragma omp parallel for schedule(dynamic) num_threads(std::max(1, load_threads))
+    for(int i = 0; i < static_cast<int>(order.size()); ++i){
+      auto idx = order[i];
+      auto& task = tasks[idx];
+      try{
+        spdlog::stopwatch sw;
+        task.db->load(task.path);
+        SPDLOG_INFO("[ DBSet ] Loading <{}> ({:.1f} MB) takes {:.2f} sec.",
+          task.name, sizes[idx] / 1048576., sw);
+      }catch(...){
+        SPDLOG_ERROR("[ DBSet ] Loading <{}> from '{}' failed.", task.name, task.path.c_str());
+        errors[idx] = std::current_exception();
+      }
+    }
+    SPDLOG_INFO("[ DBSet ] Loading {} databases with {} threads takes {:.2f} sec.",
+      tasks.size(), std::max(1, load_threads), total_sw);
+
+    for(auto& error : errors){
+      if(error){
+        std::rethrow_exception(error);
+      }
+    }
   }
 };
 
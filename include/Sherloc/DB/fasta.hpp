@@ -8,6 +8,7 @@
 #include <algorithm>
 #include <Sherloc/Attr/allele.hpp>
 #include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/hts_thread_pool.hpp>
 #include <spdlog/spdlog.h>
 #include <htslib/faidx.h>
 
@@ -32,6 +33,7 @@ public:
             SPDLOG_ERROR("FaidxWrapper: Can't load faidx file, path: {}", fa_file.c_str());
             throw std::runtime_error("FaidxWrapper: Can't load faidx file");
         }
+        HTSThreadPool::get().attach(fasta_index);
     }
 
     FaidxWrapper() = default;
@@ -0,0 +1,560 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fmt/format.h>
+#include <boost/mpl/bool.hpp>
+#include <boost/serialization/access.hpp>
+#include <boost/serialization/serialization.hpp>
+#include <boost/serialization/level.hpp>
+#include <boost/serialization/tracking.hpp>
+#include <boost/serialization/version.hpp>
+#include <boost/serialization/vector.hpp>
+#include <boost/serialization/string.hpp>
+
+/**
+ * Flat database files
+ *
+ * A flat file is an uncompressed dump of a database that can be `mmap`ed and queried in place:
+ *
+ *   [ magic "HOLMESFL" | u32 format version | u32 reserved ][ body ... ]
+ *
+ * The body is written in the order of the `HOLMES_SERIALIZE` members, so every database
+ * keeps a single serialization function for both boost archives and flat files.
+ * Like in a boost archive, each class member is preceded by its class version (u32), which
+ * is passed back to `serialize` on load, so the old layouts of a class are still read.
+ * `FlatArray<T>` / `FlatStrings` members are stored as 64-byte aligned sections and are
+ * mapped zero-copy on load, other members (scalars, strings, std containers) are decoded
+ * from the mapping. The mapping is read only and shared, so concurrent processes on one
+ * host share the page cache of a database.
+ */
+
+namespace Sherloc::DB {
+
+static_assert(std::endian::native == std::endian::little,
+  "flat database files are stored in little endian");
+
+/**
+ * @brief A read only, shared mapping of a whole file
+ */
+class MappedFile {
+private:
+  const std::byte* ptr = nullptr;
+  size_t length = 0;
+
+public:
+  MappedFile(const std::filesystem::path& file_name){
+    auto fd = ::open(file_name.c_str(), O_RDONLY);
+    if(fd < 0){
+      throw std::runtime_error(fmt::format("MappedFile: can't open '{}'", file_name.c_str()));
+    }
+    struct stat st{};
+    if(::fstat(fd, &st) != 0 or st.st_size == 0){
+      ::close(fd);
+      throw std::runtime_error(fmt::format("MappedFile: '{}' is empty", file_name.c_str()));
+    }
+    length = static_cast<size_t>(st.st_size);
+    auto addr = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if(addr == MAP_FAILED){
+      throw std::runtime_error(fmt::format("MappedFile: can't mmap '{}'", file_name.c_str()));
+    }
+    ptr = static_cast<const std::byte*>(addr);
+  }
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  ~MappedFile(){
+    if(ptr){
+      ::munmap(const_cast<std::byte*>(ptr), length);
+    }
+  }
+
+  [[nodiscard]] auto data() const { return ptr; }
+  [[nodiscard]] auto size() const { return length; }
+};
+
+/**
+ * @brief A vector of trivially copyable elements, either owned (while building a db)
+ * or pointing into a mapped flat file (after loading)
+ *
+ * The elements are read only once mapped, appending to a mapped array copies it first.
+ * In boost archives it is stored exactly as `std::vector<T>`, so the archives built
+ * before the flat format still load.
+ */
+template<class T>
+class FlatArray {
+  static_assert(std::is_trivially_copyable_v<T>);
+private:
+  std::vector<T> owned;
+  std::span<const T> mapped;
+  std::shared_ptr<const MappedFile> mapping;
+
+  void detach(){
+    if(mapping){
+      owned.assign(mapped.begin(), mapped.end());
+      mapped = {};
+      mapping.reset();
+    }
+  }
+
+public:
+  using value_type = T;
+  using const_iterator = const T*;
+  using iterator = const_iterator;
+
+  FlatArray() = default;
+  FlatArray(std::vector<T> vec): owned(std::move(vec)) {}
+
+  /**
+   * @brief Point to `size` elements in a mapped file, the mapping is kept alive by the array
+   */
+  void map(const T* data, size_t size, std::shared_ptr<const MappedFile> file){
+    owned = std::vector<T>{};
+    mapped = {data, size};
+    mapping = std::move(file);
+  }
+
+  [[nodiscard]] auto is_mapped() const { return mapping != nullptr; }
+
+  void reserve(size_t n){
+    detach();
+    owned.reserve(n);
+  }
+
+  template<class... Args>
+  auto& emplace_back(Args&&... args){
+    detach();
+    return owned.emplace_back(std::forward<Args>(args)...);
+  }
+
+  void push_back(const T& value){
+    emplace_back(value);
+  }
+
+  void append(const T* first, size_t n){
+    detach();
+    owned.insert(owned.end(), first, first + n);
+  }
+
+  void clear(){
+    mapped = {};
+    mapping.reset();
+    owned.clear();
+  }
+
+  [[nodiscard]] const T* data() const { return mapping ? mapped.data() : owned.data(); }
+  [[nodiscard]] size_t size() const { return mapping ? mapped.size() : owned.size(); }
+  [[nodiscard]] bool empty() const { return size() == 0; }
+  [[nodiscard]] const_iterator begin() const { return data(); }
+  [[nodiscard]] const_iterator end() const { return data() + size(); }
+  [[nodiscard]] const T& operator[](size_t idx) const { return data()[idx]; }
+  [[nodiscard]] const T& back() const { return data()[size() - 1]; }
+
+  template<class Archive>
+  void serialize(Archive& ar, const unsigned int){
+    if constexpr (Archive::is_saving::value){
+      if(mapping){
+        auto copied = std::vector<T>(begin(), end());
+        ar & copied;
+        return;
+      }
+      ar & owned;
+    }else{
+      clear();
+      ar & owned;
+    }
+  }
+};
+
+/**
+ * @brief A column of strings stored as one character pool plus end offsets,
+ * element `i` is `chars[ends[i-1], ends[i])`
+ *
+ * In boost archives it is stored exactly as `std::vector<std::string>`.
+ */
+class FlatStrings {
+  friend class FlatWriter;
+  friend class FlatReader;
+private:
+  FlatArray<char> chars;
+  FlatArray<uint64_t> ends;
+
+public:
+  using value_type = std::string_view;
+
+  FlatStrings() = default;
+
+  void reserve(size_t n){
+    ends.reserve(n);
+  }
+
+  void emplace_back(std::string_view str){
+    chars.append(str.data(), str.size());
+    ends.push_back(chars.size());
+  }
+
+  void push_back(std::string_view str){
+    emplace_back(str);
+  }
+
+  void clear(){
+    chars.clear();
+    ends.clear();
+  }
+
+  [[nodiscard]] size_t size() const { return ends.size(); }
+  [[nodiscard]] bool empty() const { return ends.empty(); }
+  [[nodiscard]] size_t bytes() const { return chars.size() + ends.size() * sizeof(uint64_t); }
+
+  [[nodiscard]] std::string_view operator[](size_t idx) const {
+    auto beg = idx == 0 ? uint64_t{0} : ends[idx - 1];
+    return {chars.data() + beg, static_cast<size_t>(ends[idx] - beg)};
+  }
+
+  template<class Archive>
+  void serialize(Archive& ar, const unsigned int){
+    if constexpr (Archive::is_saving::value){
+      auto strs = std::vector<std::string>{};
+      strs.reserve(size());
+      for(size_t idx = 0; idx < size(); ++idx){
+        strs.emplace_back((*this)[idx]);
+      }
+      ar & strs;
+    }else{
+      auto strs = std::vector<std::string>{};
+      ar & strs;
+      clear();
+      reserve(strs.size());
+      for(auto& str : strs){
+        emplace_back(str);
+      }
+    }
+  }
+};
+
+namespace flat_detail {
+  template<class T, template<class...> class Template>
+  struct is_specialization : std::false_type {};
+
+  template<template<class...> class Template, class... Args>
+  struct is_specialization<Template<Args...>, Template> : std::true_type {};
+
+  template<class T>
+  struct is_std_array : std::false_type {};
+
+  template<class T, size_t N>
+  struct is_std_array<std::array<T, N>> : std::true_type {};
+
+  template<class T>
+  concept Associative = requires(T t) {
+    typename T::key_type;
+    t.emplace_hint(t.end(), std::declval<typename T::value_type>());
+  };
+
+  // a mutable element to read an associative container node into
+  template<class T>
+  struct node_of { using type = typename T::value_type; };
+
+  template<class T> requires requires { typename T::mapped_type; }
+  struct node_of<T> { using type = std::pair<typename T::key_type, typename T::mapped_type>; };
+
+  template<class T>
+  concept Scalar = std::is_arithmetic_v<T> or std::is_enum_v<T>;
+
+  constexpr auto magic = std::string_view{"HOLMESFL"};
+  // 1: no class versions (all classes were at version 0)
+  // 2: each class member is preceded by its class version
+  constexpr uint32_t format_version = 2;
+  constexpr size_t alignment = 64;
+}
+
+/**
+ * @brief Checks whether a file is a flat database file
+ */
+inline bool is_flat_file(const std::filesystem::path& file_name){
+  auto is = std::ifstream(file_name, std::ios_base::in | std::ios_base::binary);
+  auto buffer = std::array<char, flat_detail::magic.size()>{};
+  is.read(buffer.data(), buffer.size());
+  return is and std::string_view{buffer.data(), buffer.size()} == flat_detail::magic;
+}
+
+/**
+ * @brief Archive writing a flat database file, used like a boost output archive
+ */
+class FlatWriter {
+private:
+  std::ofstream& os;
+  size_t offset = 0;
+
+  void write_raw(const void* src, size_t n){
+    os.write(static_cast<const char*>(src), static_cast<std::streamsize>(n));
+    offset += n;
+  }
+
+  void align(){
+    static constexpr auto zeros = std::array<char, flat_detail::alignment>{};
+    auto pad = (flat_detail::alignment - offset % flat_detail::alignment) % flat_detail::alignment;
+    write_raw(zeros.data(), pad);
+  }
+
+  void write_size(size_t n){
+    auto size = static_cast<uint64_t>(n);
+    write_raw(&size, sizeof(size));
+  }
+
+public:
+  using is_saving = boost::mpl::bool_<true>;
+  using is_loading = boost::mpl::bool_<false>;
+
+  FlatWriter(std::ofstream& os): os(os) {
+    write_raw(flat_detail::magic.data(), flat_detail::magic.size());
+    auto version = flat_detail::format_version;
+    auto reserved = uint32_t{0};
+    write_raw(&version, sizeof(version));
+    write_raw(&reserved, sizeof(reserved));
+  }
+
+  template<class T>
+  FlatWriter& operator&(const T& t){
+    using namespace flat_detail;
+    if constexpr (Scalar<T>){
+      write_raw(&t, sizeof(T));
+    }else if constexpr (is_specialization<T, FlatArray>::value){
+      write_size(t.size());
+      align();
+      write_raw(t.data(), t.size() * sizeof(typename T::value_type));
+    }else if constexpr (std::is_same_v<T, FlatStrings>){
+      *this & t.chars;
+      *this & t.ends;
+    }else if constexpr (std::is_same_v<T, std::string>){
+      write_size(t.size());
+      write_raw(t.data(), t.size());
+    }else if constexpr (is_specialization<T, std::pair>::value){
+      *this & t.first;
+      *this & t.second;
+    }else if constexpr (is_std_array<T>::value){
+      for(auto& elem : t){
+        *this & elem;
+      }
+    }else if constexpr (is_specialization<T, std::vector>::value){
+      write_size(t.size());
+      if constexpr (Scalar<typename T::value_type>){
+        write_raw(t.data(), t.size() * sizeof(typename T::value_type));
+      }else{
+        for(auto& elem : t){
+          *this & elem;
+        }
+      }
+    }else if constexpr (Associative<T>){
+      write_size(t.size());
+      for(auto& elem : t){
+        *this & elem;
+      }
+    }else{
+      // class types, reuse their boost `serialize` member
+      auto class_version = static_cast<uint32_t>(boost::serialization::version<T>::value);
+      write_raw(&class_version, sizeof(class_version));
+      boost::serialization::serialize(*this, const_cast<T&>(t), class_version);
+    }
+    return *this;
+  }
+
+  template<class T>
+  FlatWriter& operator<<(const T& t){
+    return *this & t;
+  }
+};
+
+/**
+ * @brief Archive reading a flat database file, used like a boost input archive
+ */
+class FlatReader {
+private:
+  std::shared_ptr<const MappedFile> file;
+  size_t offset = 0;
+  uint32_t version = 0;
+
+  const std::byte* take(size_t n){
+    if(n > file->size() - offset){
+      throw std::runtime_error("FlatReader: unexpected end of a flat database file");
+    }
+    auto ptr = file->data() + offset;
+    offset += n;
+    return ptr;
+  }
+
+  void read_raw(void* dst, size_t n){
+    std::memcpy(dst, take(n), n);
+  }
+
+  void align(){
+    auto pad = (flat_detail::alignment - offset % flat_detail::alignment) % flat_detail::alignment;
+    take(pad);
+  }
+
+  size_t read_size(){
+    auto size = uint64_t{0};
+    read_raw(&size, sizeof(size));
+    return static_cast<size_t>(size);
+  }
+
+public:
+  using is_saving = boost::mpl::bool_<false>;
+  using is_loading = boost::mpl::bool_<true>;
+
+  FlatReader(const std::filesystem::path& file_name):
+    file(std::make_shared<const MappedFile>(file_name))
+  {
+    auto magic = take(flat_detail::magic.size());
+    if(std::memcmp(magic, flat_detail::magic.data(), flat_detail::magic.size()) != 0){
+      throw std::runtime_error(
+        fmt::format("FlatReader: '{}' is not a flat database file", file_name.c_str()));
+    }
+    auto reserved = uint32_t{0};
+    read_raw(&version, sizeof(version));
+    read_raw(&reserved, sizeof(reserved));
+    if(version == 0 or version > flat_detail::format_version){
+      throw std::runtime_error(
+        fmt::format("FlatReader: '{}' has format version {}, expected up to {}",
+          file_name.c_str(), version, flat_detail::format_version));
+    }
+  }
+
+  template<class T>
+  FlatReader& operator&(T& t){
+    using namespace flat_detail;
+    if constexpr (Scalar<T>){
+      read_raw(&t, sizeof(T));
+    }else if constexpr (is_specialization<T, FlatArray>::value){
+      using Elem = typename T::value_type;
+      auto size = read_size();
+      align();
+      auto ptr = take(size * sizeof(Elem));
+      t.map(reinterpret_cast<const Elem*>(ptr), size, file);
+    }else if constexpr (std::is_same_v<T, FlatStrings>){
+      *this & t.chars;
+      *this & t.ends;
+    }else if constexpr (std::is_same_v<T, std::string>){
+      auto size = read_size();
+      t.assign(reinterpret_cast<const char*>(take(size)), size);
+    }else if constexpr (is_specialization<T, std::pair>::value){
+      *this & t.first;
+      *this & t.second;
+    }else if constexpr (is_std_array<T>::value){
+      for(auto& elem : t){
+        *this & elem;
+      }
+    }else if constexpr (is_specialization<T, std::vector>::value){
+      auto size = read_size();
+      t.clear();
+      t.resize(size);
+      if constexpr (Scalar<typename T::value_type>){
+        read_raw(t.data(), size * sizeof(typename T::value_type));
+      }else{
+        for(auto& elem : t){
+          *this & elem;
+        }
+      }
+    }else if constexpr (Associative<T>){
+      using Elem = typename node_of<T>::type;
+      auto size = read_size();
+      t.clear();
+      for(size_t idx = 0; idx < size; ++idx){
+        auto elem = Elem{};
+        *this & elem;
+        t.emplace_hint(t.end(), std::move(elem));
+      }
+    }else{
+      // class types, reuse their boost `serialize` member with the stored class version,
+      // the files of format 1 were written before the class versions
+      auto class_version = uint32_t{0};
+      if(version > 1){
+        read_raw(&class_version, sizeof(class_version));
+      }
+      auto current_version = static_cast<uint32_t>(boost::serialization::version<T>::value);
+      if(class_version > current_version){
+        throw std::runtime_error(fmt::format(
+          "FlatReader: class version {} is newer than this build ({})",
+          class_version, current_version));
+      }
+      boost::serialization::serialize(*this, t, class_version);
+    }
+    return *this;
+  }
+
+  template<class T>
+  FlatReader& operator>>(T& t){
+    return *this & t;
+  }
+};
+
+/**
+ * @brief Load a database from a flat file, `FlatArray` / `FlatStrings` members are
+ * mapped in place and stay valid as long as the database holds them
+ */
+template<class DataBase>
+inline void load_flat_from(DataBase& db, const std::filesystem::path& file_name){
+  auto reader = FlatReader(file_name);
+  reader & db;
+}
+
+/**
+ * @brief Save a database to a flat file
+ */
+template<class DataBase>
+inline void save_flat_to(DataBase& db, const std::filesystem::path& file_name){
+  auto os = std::ofstream(file_name, std::ios_base::out | std::ios_base::binary | std::ios_base::trunc);
+  if(!os){
+    throw std::runtime_error(fmt::format("save_flat_to: can't open '{}'", file_name.c_str()));
+  }
+  auto writer = FlatWriter(os);
+  writer & db;
+  os.flush();
+  if(!os){
+    throw std::runtime_error(fmt::format("save_flat_to: failed to write '{}'", file_name.c_str()));
+  }
+}
+
+}
+
+// stored without class information or tracking, so in boost archives
+// `FlatArray<T>` / `FlatStrings` are byte-identical to the std containers they replace
+namespace boost::serialization {
+
+template<class T>
+struct implementation_level<Sherloc::DB::FlatArray<T>> {
+  typedef mpl::integral_c_tag tag;
+  typedef mpl::int_<object_serializable> type;
+  BOOST_STATIC_CONSTANT(int, value = object_serializable);
+};
+
+template<class T>
+struct tracking_level<Sherloc::DB::FlatArray<T>> {
+  typedef mpl::integral_c_tag tag;
+  typedef mpl::int_<track_never> type;
+  BOOST_STATIC_CONSTANT(int, value = track_never);
+};
+
+}
+
+BOOST_CLASS_IMPLEMENTATION(Sherloc::DB::FlatStrings, boost::serialization::object_serializable)
+BOOST_CLASS_TRACKING(Sherloc::DB::FlatStrings, boost::serialization::track_never)
@@ -224,7 +224,7 @@ public:
   void save(const Path& filename) override {
     this->set_build_time();
     this->log_metadata("DataBaseGeneInfo");
-    save_archive_to(*this, filename);
+    save_flat_to(*this, filename);
   }
 
   void load(const Path& filename) override {
@@ -241,7 +241,7 @@ public:
    * @param sher_mem A SherlocMember object containing the variants for which to find the inheritance patterns.
    * @return A vector of characters representing the inheritance patterns of each variant in the SherlocMember.
    */
-  auto find(const SherlocMember& sher_mem) {
+  auto find(const SherlocMember& sher_mem) const {
     decltype(auto) vars = sher_mem.variants;
     auto inhe_patts = std::vector<char>(vars.size(), 'U');
     for(int idx = 0; idx < vars.size(); ++idx){
@@ -266,7 +266,7 @@ public:
     return inhe_patts;
   }
 
-  std::optional<std::vector<size_t>> find(const std::string& symbol){
+  std::optional<std::vector<size_t>> find(const std::string& symbol) const {
     auto it = symbol2index.find((symbol));
     if(it == symbol2index.end()){
       return std::nullopt;
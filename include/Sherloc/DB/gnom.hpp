@@ -12,9 +12,21 @@
 #include <vector>
 #include <string>
 #include <cstdlib>
+#include <exception>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <functional>
+#include <future>
+#include <list>
+#include <memory>
+#include <mutex>
 #include <Sherloc/DB/exac.hpp>
 #include <Sherloc/sherloc_member.hpp>
 #include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/batch.hpp>
+#include <Sherloc/DB/packed.hpp>
+#include <Sherloc/DB/allele_filter.hpp>
 #include <Sherloc/DB/vcf.hpp>
 #include <omp.h>
 
@@ -28,28 +40,28 @@ class Gnom_alt
     size_t chr;
     size_t pos;
     // for snp
-    std::vector< PositionType > db_vec_snp;
-    std::vector< StatusType >   db_vec_snp_status;
+    PackedPositions           db_vec_snp;
+    FlatArray< StatusType >   db_vec_snp_status;
 
     // for insertion
-    std::vector< PositionType > db_vec_ins;
-    std::vector< std::string >  db_vec_ins_alt;
-    std::vector< StatusType >   db_vec_ins_status;
+    PackedPositions           db_vec_ins;
+    FlatStrings               db_vec_ins_alt;
+    FlatArray< StatusType >   db_vec_ins_status;
 
     // for deletion
-    std::vector< PositionType > db_vec_del;
-    std::vector< std::string >  db_vec_del_ref;
-    std::vector< StatusType >   db_vec_del_status;
-
+    PackedPositions           db_vec_del;
+    FlatStrings               db_vec_del_ref;
+    FlatArray< StatusType >   db_vec_del_status;
 
+    // version 1: positions are packed, see `PackedPositions`
     HOLMES_SERIALIZE(ar, version){
         ar & db_vec_snp_status;
         ar & db_vec_ins_status;
         ar & db_vec_del_status;
 
-        ar & db_vec_snp;
-        ar & db_vec_ins;
-        ar & db_vec_del;
+        serialize_packed(ar, db_vec_snp, version);
+        serialize_packed(ar, db_vec_ins, version);
+        serialize_packed(ar, db_vec_del, version);
 
         ar & db_vec_ins_alt;
         ar & db_vec_del_ref;
@@ -63,28 +75,43 @@ class Gnom_alt
         static constexpr size_t ins_capacity = 300000;
         static constexpr size_t del_capacity = 300000;
         
-        db_vec_snp.reserve(snp_capacity);
         db_vec_snp_status.reserve(snp_capacity);
 
-        db_vec_ins.reserve(ins_capacity);
         db_vec_ins_status.reserve(ins_capacity);
         db_vec_ins_alt.reserve(ins_capacity);
 
-        db_vec_del.reserve(del_capacity);
         db_vec_del_status.reserve(del_capacity);
         db_vec_del_ref.reserve(del_capacity);
     }
 
-    void add_allele(HTS_VCF& vcf, bool pass){
-        auto pos = (PositionType)vcf.record.pos;
+    /**
+     * @brief Bytes held by the allele arrays (mapped or owned)
+     */
+    [[nodiscard]] size_t bytes() const {
+        return db_vec_snp.bytes() + db_vec_ins.bytes() + db_vec_del.bytes()
+            + (db_vec_snp_status.size() + db_vec_ins_status.size() + db_vec_del_status.size()) * sizeof(StatusType)
+            + db_vec_ins_alt.bytes() + db_vec_del_ref.bytes();
+    }
+
+    // header ids of the INFO tags used by `add_allele`, resolved once per vcf
+    struct InfoIds {
+        int an, af, nhomalt;
+        InfoIds(const HTS_VCF& vcf):
+            an(vcf.info2id("AN")), af(vcf.info2id("AF")),
+            nhomalt(vcf.info2id("nhomalt")) {}
+    };
+
+    void add_allele(HTS_VCF& vcf, bool pass, const InfoIds& info_ids){
+        auto pos = (PositionType)vcf.view.pos();
         char status = '0';
         char hom = '0';
 
         if(pass){
-            auto an = vcf.info_int("AN").value();
-            auto ac = vcf.info_int("AC").value();
-            auto af = an != 0 ? vcf.info_float("AF").value() : 0.f;
-            auto nhom = vcf.info_int("nhomalt").value();
+            // a missing ('.') or absent value counts as 0, e.g. a record without AN is
+            // classified as low coverage instead of aborting the build
+            auto an = vcf.info_int(info_ids.an).value_or(0);
+            auto af = an != 0 ? vcf.info_float(info_ids.af).value_or(0.f) : 0.f;
+            auto nhom = vcf.info_int(info_ids.nhomalt).value_or(0);
             hom += std::min(nhom, (decltype(nhom))2);
             if      ( an < 15000 ) status = '2';
             else if ( af > 0.01  ) status = '7';
@@ -97,24 +124,24 @@ class Gnom_alt
             status = '1';
         }
 
-        if(vcf.record.ref.size() > vcf.record.alt.size()){ // deletion
+        if(vcf.view.ref.size() > vcf.view.alt.size()){ // deletion
             db_vec_del.emplace_back(pos + 1);
-            db_vec_del_ref.emplace_back(vcf.record.ref.substr(1));
+            db_vec_del_ref.emplace_back(vcf.view.ref.substr(1));
             db_vec_del_status.emplace_back(compress_status(
-                vcf.record.ref[0], status, hom));
-        }else if(vcf.record.ref.size() < vcf.record.alt.size()){ // insertion
+                vcf.view.ref[0], status, hom));
+        }else if(vcf.view.ref.size() < vcf.view.alt.size()){ // insertion
             db_vec_ins.emplace_back(pos + 1);
-            db_vec_ins_alt.emplace_back(vcf.record.alt.substr(1));
+            db_vec_ins_alt.emplace_back(vcf.view.alt.substr(1));
             db_vec_ins_status.emplace_back(compress_status(
-                vcf.record.alt[0], status, hom));
-        }else if(vcf.record.ref.size() == 1){ // snp
+                vcf.view.alt[0], status, hom));
+        }else if(vcf.view.ref.size() == 1){ // snp
             db_vec_snp.emplace_back(pos);
             db_vec_snp_status.emplace_back(compress_status(
-                vcf.record.alt[0], status, hom));
+                vcf.view.alt[0], status, hom));
         }
     }
 
-    StatusType compress_status(char alt, char status, char hom){
+    static StatusType compress_status(char alt, char status, char hom){
         char compressed_alt;
         switch (alt) {
             case 'A': 
@@ -133,7 +160,7 @@ class Gnom_alt
             | (((hom    - '0') << 6) & 0b11000000);
     }
 
-    auto decompress_status(StatusType status){
+    static auto decompress_status(StatusType status){
         char alt, st, hom;
         switch (status & 0b00000011) {
             case 0b00000000: 
@@ -152,11 +179,46 @@ class Gnom_alt
         return std::make_tuple(alt, st, hom);
     }
 
-    Exac find_snp( std::uint32_t pos0, char alt0 ){
-        auto&& [begin_it, end_it] = std::equal_range(db_vec_snp.begin(), db_vec_snp.end(), pos0);
+    /**
+     * @brief Hash of the key of an allele, see `AlleleFilter`
+     */
+    static uint64_t key_hash(size_t pos0, const std::string& ref0, const std::string& alt0){
+        auto pos = static_cast<PositionType>(pos0);
+        if(ref0 != "-" and alt0 != "-"){ // snp
+            return allele_key_hash('S', pos, std::string_view{alt0}.substr(0, 1));
+        }
+        else if(ref0 == "-"){ // insertion
+            return allele_key_hash('I', pos, alt0);
+        }
+        // deletion
+        return allele_key_hash('D', pos, ref0);
+    }
+
+    /**
+     * @brief Hashes of the keys of all the alleles, see `AlleleFilter`
+     */
+    [[nodiscard]] std::vector<uint64_t> key_hashes() const {
+        auto hashes = std::vector<uint64_t>{};
+        hashes.reserve(db_vec_snp.size() + db_vec_ins.size() + db_vec_del.size());
+        for(size_t idx = 0; idx < db_vec_snp.size(); ++idx){
+            auto alt = std::get<0>(decompress_status(db_vec_snp_status[idx]));
+            hashes.emplace_back(allele_key_hash('S', db_vec_snp[idx], {&alt, 1}));
+        }
+        for(size_t idx = 0; idx < db_vec_ins.size(); ++idx){
+            hashes.emplace_back(allele_key_hash('I', db_vec_ins[idx], db_vec_ins_alt[idx]));
+        }
+        for(size_t idx = 0; idx < db_vec_del.size(); ++idx){
+            hashes.emplace_back(allele_key_hash('D', db_vec_del[idx], db_vec_del_ref[idx]));
+        }
+        return hashes;
+    }
+
+    /**
+     * @brief The matching allele among the index `range`, the equal range of its position
+     */
+    Exac match_snp(std::pair<size_t, size_t> range, std::uint32_t pos0, char alt0) const {
         Exac exac;
-        for(auto it = begin_it; it != end_it; ++it){
-            auto idx = std::distance(db_vec_snp.begin(), it);
+        for(auto idx = range.first; idx != range.second; ++idx){
             std::tie(exac.alt, exac.status, exac.hom) = decompress_status(db_vec_snp_status[idx]);
             if(exac.alt[0] == alt0){
                 exac.pos = pos0;
@@ -165,13 +227,11 @@ class Gnom_alt
         }
         return {};
     }
-    
-    Exac find_insertion(std::uint32_t pos0, const std::string& ins_alt){
-        auto&& [begin_it, end_it] = std::ranges::equal_range(db_vec_ins, pos0);
+
+    Exac match_insertion(std::pair<size_t, size_t> range, std::uint32_t pos0, const std::string& ins_alt) const {
         Exac exac;
         char discard;
-        for(auto it = begin_it; it != end_it; ++it){
-            auto idx = std::distance(std::begin(db_vec_ins), it);
+        for(auto idx = range.first; idx != range.second; ++idx){
             exac.alt = db_vec_ins_alt[idx];
             if(exac.alt == ins_alt){
                 std::tie(discard, exac.status, exac.hom) = decompress_status(db_vec_ins_status[idx]);
@@ -182,12 +242,10 @@ class Gnom_alt
         return {};
     }
 
-    Exac find_deletion(std::uint32_t pos0, const std::string& del_ref){
-        auto&& [begin_it, end_it] = std::equal_range(db_vec_del.begin(), db_vec_del.end(), pos0);
+    Exac match_deletion(std::pair<size_t, size_t> range, std::uint32_t pos0, const std::string& del_ref) const {
         Exac exac;
         char discard;
-        for(auto it = begin_it; it != end_it; ++it){
-            auto idx = std::distance(db_vec_del.begin(), it);
+        for(auto idx = range.first; idx != range.second; ++idx){
             exac.ref = db_vec_del_ref[idx];
             if(exac.ref == del_ref){
                 std::tie(discard, exac.status, exac.hom) = decompress_status(db_vec_del_status[idx]);
@@ -198,12 +256,24 @@ class Gnom_alt
         return {};
     }
 
-    inline Exac find( const SherlocMember& sher_mem )
+    Exac find_snp( std::uint32_t pos0, char alt0 ) const {
+        return match_snp(db_vec_snp.equal_range(pos0), pos0, alt0);
+    }
+    
+    Exac find_insertion(std::uint32_t pos0, const std::string& ins_alt) const {
+        return match_insertion(db_vec_ins.equal_range(pos0), pos0, ins_alt);
+    }
+
+    Exac find_deletion(std::uint32_t pos0, const std::string& del_ref) const {
+        return match_deletion(db_vec_del.equal_range(pos0), pos0, del_ref);
+    }
+
+    inline Exac find( const SherlocMember& sher_mem ) const
     {
         return find(sher_mem.pos, sher_mem.ref, sher_mem.alt);
     }
 
-    inline Exac find( size_t pos0, const std::string& ref0, const std::string& alt0 )
+    inline Exac find( size_t pos0, const std::string& ref0, const std::string& alt0 ) const
     {
         if(ref0 != "-" and alt0 != "-"){ // snp
             return find_snp(pos0, alt0[0]);
@@ -215,6 +285,189 @@ class Gnom_alt
         return find_deletion(pos0, ref0);
     }
 
+    /**
+     * @brief `find` of the alleles of this chunk, merged with the position arrays
+     * in one pass (see `GallopCursor`). The alleles should be sorted by position.
+     */
+    std::vector<Exac> find_batch(std::span<const SherlocMember> sher_mems) const {
+        auto snp = PackedCursor(db_vec_snp);
+        auto ins = PackedCursor(db_vec_ins);
+        auto del = PackedCursor(db_vec_del);
+        auto ret = std::vector<Exac>();
+        ret.reserve(sher_mems.size());
+        for(auto& sher_mem : sher_mems){
+            auto pos0 = static_cast<PositionType>(sher_mem.pos);
+            if(sher_mem.ref != "-" and sher_mem.alt != "-"){ // snp
+                ret.emplace_back(match_snp(snp.equal_range(pos0), pos0, sher_mem.alt[0]));
+            }else if(sher_mem.ref == "-"){ // insertion
+                ret.emplace_back(match_insertion(ins.equal_range(pos0), pos0, sher_mem.alt));
+            }else{ // deletion
+                ret.emplace_back(match_deletion(del.equal_range(pos0), pos0, sher_mem.ref));
+            }
+        }
+        return ret;
+    }
+
+};
+
+/**
+ * @brief LRU cache of gnomAD chunks keyed by (chr, chunk index), bounded by the bytes
+ * of the cached chunks
+ *
+ * The cache is thread safe. Chunks are handed out as `shared_ptr<const Gnom_alt>`, so an
+ * evicted chunk stays valid for the threads still querying it. A chunk is decoded by one
+ * thread only, the other threads asking for it wait for that load.
+ * The most recently used chunk is never evicted, so a single chunk larger than the budget
+ * still works. `prefetch` loads a chunk on a background thread.
+ */
+class GnomChunkCache {
+public:
+  using Key = std::pair<size_t, size_t>;
+  using ChunkPtr = std::shared_ptr<const Gnom_alt>;
+  using Loader = std::function<ChunkPtr(const Key&)>;
+
+  struct Stats {
+    size_t hits = 0;
+    size_t misses = 0;
+    size_t evictions = 0;
+    size_t prefetches = 0;
+    size_t prefetch_hits = 0;
+  };
+
+private:
+  struct Entry {
+    ChunkPtr chunk; // nullptr if the chunk file doesn't exist
+    size_t bytes;
+    std::list<Key>::iterator lru_it;
+  };
+
+  struct Pending {
+    std::shared_future<ChunkPtr> chunk;
+    bool prefetched;
+  };
+
+  Loader loader;
+  size_t budget;
+  size_t used = 0;
+  std::list<Key> lru; // front is the most recently used
+  std::map<Key, Entry> entries;
+  std::map<Key, Pending> pending; // chunks being loaded
+  Stats stats;
+  mutable std::mutex mutex;
+
+  // with the lock held
+  void insert(const Key& key, ChunkPtr chunk){
+    auto bytes = chunk ? chunk->bytes() : size_t{0};
+    lru.push_front(key);
+    entries[key] = Entry{std::move(chunk), bytes, lru.begin()};
+    used += bytes;
+    while(used > budget and lru.size() > 1){
+      auto victim = entries.find(lru.back());
+      used -= victim->second.bytes;
+      entries.erase(victim);
+      lru.pop_back();
+      ++stats.evictions;
+    }
+  }
+
+public:
+  static constexpr size_t default_budget = size_t{1} << 30; // 1 GiB
+
+  GnomChunkCache(Loader loader, size_t budget = default_budget):
+    loader(std::move(loader)), budget(budget) {}
+
+  ~GnomChunkCache(){
+    clear();
+  }
+
+  void set_budget(size_t bytes){
+    auto lock = std::lock_guard{mutex};
+    budget = bytes;
+  }
+
+  [[nodiscard]] auto get_budget() const { auto lock = std::lock_guard{mutex}; return budget; }
+  [[nodiscard]] auto bytes_used() const { auto lock = std::lock_guard{mutex}; return used; }
+  [[nodiscard]] auto size() const { auto lock = std::lock_guard{mutex}; return entries.size(); }
+  [[nodiscard]] auto get_stats() const { auto lock = std::lock_guard{mutex}; return stats; }
+
+  ChunkPtr get(const Key& key){
+    auto future = std::shared_future<ChunkPtr>{};
+    auto promise = std::promise<ChunkPtr>{};
+    auto load_here = false;
+    {
+      auto lock = std::lock_guard{mutex};
+      if(auto it = entries.find(key); it != entries.end()){
+        ++stats.hits;
+        lru.splice(lru.begin(), lru, it->second.lru_it);
+        return it->second.chunk;
+      }
+      if(auto it = pending.find(key); it != pending.end()){
+        ++(it->second.prefetched ? stats.prefetch_hits : stats.hits);
+        future = it->second.chunk;
+      }else{
+        ++stats.misses;
+        future = promise.get_future().share();
+        pending.emplace(key, Pending{future, false});
+        load_here = true;
+      }
+    }
+
+    if(load_here){
+      try{
+        promise.set_value(loader(key));
+      }catch(...){
+        promise.set_exception(std::current_exception());
+      }
+    }
+
+    try{
+      auto chunk = future.get();
+      auto lock = std::lock_guard{mutex};
+      if(auto it = pending.find(key); it != pending.end()){ // the first waiter moves it into the cache
+        pending.erase(it);
+        insert(key, chunk);
+      }
+      return chunk;
+    }catch(...){
+      auto lock = std::lock_guard{mutex};
+      pending.erase(key);
+      throw;
+    }
+  }
+
+  /**
+   * @brief Start loading a chunk in the background, do nothing if it's cached or already loading
+   */
+  void prefetch(const Key& key){
+    auto lock = std::lock_guard{mutex};
+    if(entries.contains(key) or pending.contains(key)){
+      return;
+    }
+    ++stats.prefetches;
+    pending.emplace(key, Pending{std::async(std::launch::async, loader, key).share(), true});
+  }
+
+  void clear(){
+    auto loading = std::map<Key, Pending>{};
+    {
+      auto lock = std::lock_guard{mutex};
+      loading.swap(pending);
+      entries.clear();
+      lru.clear();
+      used = 0;
+    }
+    for(auto& [key, load] : loading){ // wait for the running loads
+      load.chunk.wait();
+    }
+  }
+
+  void log_stats(std::string_view name) const {
+    auto lock = std::lock_guard{mutex};
+    SPDLOG_INFO("<{}> chunk cache: {} hits, {} misses, {} prefetched ({} used), {} evictions, "
+      "{} chunks / {:.1f} MB cached (budget {:.1f} MB)",
+      name, stats.hits, stats.misses, stats.prefetches, stats.prefetch_hits, stats.evictions,
+      entries.size(), used / 1048576., budget / 1048576.);
+  }
 };
 
 class DataBaseGnomAD : public BaseDB {
@@ -222,15 +475,58 @@ public:
   static constexpr size_t chunk_size = 10000000;
   Path gnom_dir;
   std::vector<std::vector<std::string>> db_file;
-  Gnom_alt gnom;
-  size_t current_chr;
-  size_t current_chunk;
   int thread_num = 4;
-  bool loaded = false;
 
+  // load the next chunk along the chromosome in the background while querying the current one
+  bool prefetch_next = false;
+
+  static constexpr std::string_view filter_name = "filter.arc";
+
+private:
+  // presence filters of the chromosomes, the chromosomes built without one are not filtered
+  std::map<ChrIndexType, AlleleFilter> filters;
+
+  /**
+   * @return false if the allele is surely not in gnomAD, so its chunk needn't be loaded
+   */
+  bool may_contain(size_t chr, size_t pos0, const std::string& ref0, const std::string& alt0) const {
+    auto it = filters.find(chr);
+    return it == filters.end() or
+      it->second.may_contain(pos0 / chunk_size, Gnom_alt::key_hash(pos0, ref0, alt0));
+  }
+
+  mutable GnomChunkCache cache{[this](const GnomChunkCache::Key& key){ return load_chunk(key); }};
+
+  GnomChunkCache::ChunkPtr load_chunk(const GnomChunkCache::Key& key) const {
+    auto& [chr, arc_idx] = key;
+    auto arc_file = gnom_dir / Attr::ChrMap::idx2chr(chr) / get_arc_name(arc_idx);
+    if (!std::filesystem::exists(arc_file)) {
+      return nullptr;
+    }
+    auto chunk = std::make_shared<Gnom_alt>();
+    load_archive_from(*chunk, arc_file);
+    return chunk;
+  }
+
+public:
   DataBaseGnomAD(const Path& gnom_dir = std::filesystem::temp_directory_path()): gnom_dir(gnom_dir) {}
 
-  inline static auto get_arc_name(size_t current_arc_idx){
+  DataBaseGnomAD(const DataBaseGnomAD&) = delete;
+  DataBaseGnomAD& operator=(const DataBaseGnomAD&) = delete;
+
+  /**
+   * @brief Set the memory budget (bytes of the cached chunks) and the prefetching
+   */
+  void set_cache(size_t budget_bytes, bool prefetch){
+    cache.set_budget(budget_bytes);
+    prefetch_next = prefetch;
+  }
+
+  [[nodiscard]] const auto& get_cache() const {
+    return cache;
+  }
+
+  inline static std::string get_arc_name(size_t current_arc_idx){
     return fmt::format("gnomAD-{}.arc", current_arc_idx);
   }
 
@@ -239,25 +535,35 @@ public:
     auto current_arc_idx = size_t{0};
     auto built_gnom = Gnom_alt{};
     built_gnom.reserve();
+    auto filter = AlleleFilter{};
 
     auto AC0_filter_idx = gnomad_vcf.filter2id("AC0");
     auto AS_VQSR_filter_idx = gnomad_vcf.filter2id("AS_VQSR");
+    auto info_ids = Gnom_alt::InfoIds{gnomad_vcf};
 
     auto save_file = [&](){
-      auto chr_idx = Attr::ChrMap::chr2idx(gnomad_vcf.record.chr);
+      auto chr_idx = gnomad_vcf.view.chr_idx;
       built_gnom.pos = current_arc_idx;
       built_gnom.chr = chr_idx;
       auto chr_dir = out_dir / Attr::ChrMap::idx2chr(chr_idx);
       std::filesystem::create_directories(chr_dir);
 
       auto output_file = chr_dir / get_arc_name(current_arc_idx);
-      save_archive_to(built_gnom, output_file);
+      save_flat_to(built_gnom, output_file);
+      filter.add_chunk(current_arc_idx, built_gnom.key_hashes());
       SPDLOG_LOGGER_INFO(spdlog::get("gnomAD-builder"),
         "{} is saved.", output_file.c_str());
     };
 
+    auto save_filter = [&](){
+      auto filter_file = out_dir / Attr::ChrMap::idx2chr(gnomad_vcf.view.chr_idx) / filter_name;
+      save_flat_to(filter, filter_file);
+      SPDLOG_LOGGER_INFO(spdlog::get("gnomAD-builder"),
+        "{} is saved ({:.1f} MB).", filter_file.c_str(), filter.bytes() / 1048576.);
+    };
+
     while(true){
-      switch (gnomad_vcf.parse_line()) {
+      switch (gnomad_vcf.parse_view()) {
         using enum HTS_VCF::VCF_Status;
         case OK:
           break;
@@ -269,25 +575,115 @@ public:
           continue;
         case VCF_EOF:
             save_file();
+            save_filter();
             return;
         default:
             throw std::runtime_error("unknown status");
       }
 
-      size_t arc_idx = gnomad_vcf.record.pos / chunk_size;
+      size_t arc_idx = gnomad_vcf.view.pos() / chunk_size;
       if(arc_idx != current_arc_idx){
         save_file();
         
         built_gnom = Sherloc::DB::Gnom_alt();
         built_gnom.reserve();
-        ++current_arc_idx;
+        current_arc_idx = arc_idx; // chunks without alleles (e.g. centromeres) are skipped
+      }
+
+      if(gnomad_vcf.has_filter_id(AC0_filter_idx)) continue;
+      built_gnom.add_allele(gnomad_vcf, !gnomad_vcf.has_filter_id(AS_VQSR_filter_idx), info_ids);
+    }
+  }
+
+  /**
+   * @brief Build chunk `arc_idx` of a chromosome from a region query, and save it if the
+   * region has alleles. Tabix also returns the records overlapping the region from the
+   * previous chunk (deletions), they are skipped so each allele is in one chunk only.
+   *
+   * @return the presence filter blocks of the chunk (see `AlleleFilter::make_blocks`)
+   */
+  static std::vector<uint64_t> build_chunk(
+    HTS_VCF& gnomad_vcf, size_t chr_idx, size_t arc_idx, const Path& out_dir
+  ){
+    auto built_gnom = Gnom_alt{};
+    built_gnom.reserve();
+    auto found = false;
+
+    auto AC0_filter_idx = gnomad_vcf.filter2id("AC0");
+    auto AS_VQSR_filter_idx = gnomad_vcf.filter2id("AS_VQSR");
+    auto info_ids = Gnom_alt::InfoIds{gnomad_vcf};
+
+    // chunk `arc_idx` holds the 1-based positions [arc_idx * chunk_size, (arc_idx + 1) * chunk_size)
+    auto beg = std::max<hts_pos_t>(1, arc_idx * chunk_size);
+    auto end = static_cast<hts_pos_t>((arc_idx + 1) * chunk_size - 1);
+    gnomad_vcf.query(Attr::ChrMap::idx2chr(chr_idx), beg, end);
+    while(true){
+      auto status = gnomad_vcf.parse_view();
+      if(status == HTS_VCF::VCF_Status::VCF_EOF) break;
+      switch (status) {
+        using enum HTS_VCF::VCF_Status;
+        case OK:
+          break;
+        case READ_RECORD_FAILED:
+          throw std::runtime_error("vcf record unpacking error");
+        case UNPACK_FAILED:
+          throw std::runtime_error("vcf header parsing error");
+        case RECORD_NO_ALT:
+          continue;
+        default:
+          throw std::runtime_error("unknown status");
       }
+      if(static_cast<size_t>(gnomad_vcf.view.pos()) / chunk_size != arc_idx) continue;
+      found = true;
 
       if(gnomad_vcf.has_filter_id(AC0_filter_idx)) continue;
-      built_gnom.add_allele(gnomad_vcf, !gnomad_vcf.has_filter_id(AS_VQSR_filter_idx));
+      built_gnom.add_allele(gnomad_vcf, !gnomad_vcf.has_filter_id(AS_VQSR_filter_idx), info_ids);
+    }
+    if(!found){
+      return {};
+    }
+
+    built_gnom.pos = arc_idx;
+    built_gnom.chr = chr_idx;
+    auto output_file = out_dir / Attr::ChrMap::idx2chr(chr_idx) / get_arc_name(arc_idx);
+    save_flat_to(built_gnom, output_file);
+    SPDLOG_LOGGER_INFO(spdlog::get("gnomAD-builder"), "{} is saved.", output_file.c_str());
+    return AlleleFilter::make_blocks(built_gnom.key_hashes());
+  }
+
+  /**
+   * @brief The chromosome and the number of chunks of a gnomAD file, std::nullopt if it
+   * can't be split by regions (no index, or no contig length in the header)
+   */
+  static std::optional<std::pair<size_t, size_t>> plan_chromosome(const std::string& url){
+    auto gnomad_vcf = HTS_VCF{url, true, true, true, false};
+    if(!gnomad_vcf.has_index()){
+      return std::nullopt;
+    }
+    // a gnomAD file holds one chromosome, the one of its first record
+    auto status = gnomad_vcf.parse_view();
+    while(status == HTS_VCF::VCF_Status::RECORD_NO_ALT){
+      status = gnomad_vcf.parse_view();
+    }
+    if(status != HTS_VCF::VCF_Status::OK or !gnomad_vcf.view.accepted_chr()){
+      return std::nullopt;
+    }
+    auto length = gnomad_vcf.contig_length(gnomad_vcf.view.chr);
+    if(!length.has_value()){
+      return std::nullopt;
     }
+    return std::pair{gnomad_vcf.view.chr_idx, static_cast<size_t>(*length) / chunk_size + 1};
   }
 
+  /**
+   * @brief Build the chunks of all chromosomes from a work queue
+   *
+   * Each indexed file is split into its chunks, and the chunks of all files are built by
+   * `thread_num` threads, so the number of chromosomes doesn't bound the parallelism and a
+   * large chromosome is not built by one thread. A chunk is written as soon as it is built,
+   * each thread opens its own reader of a file. The files that can't be split are built as
+   * a whole by `build_chromosome`. The layout of the output is the same.
+   */
   void from(const Path& urls_filename) override {
     auto is = std::ifstream{urls_filename};
     auto urls = std::vector<std::string>{};
@@ -297,14 +693,90 @@ public:
     }
 
     auto err_mt_logger = spdlog::stdout_color_mt("gnomAD-builder");
+    auto threads = std::max(1, thread_num);
 
-    auto file_size = urls.size();
-    omp_set_num_threads(thread_num);
-    #pragma omp parallel for
-    for(int idx = 0; idx < file_size; ++idx){
-      SPDLOG_LOGGER_INFO(err_mt_logger, "Building file: `{}`",
-        urls[idx]);
-      build_chromosome(urls[idx], gnom_dir);
+    // exceptions can't leave the omp loops, keep the first one
+    auto error = std::exception_ptr{};
+    auto keep_error = [&error](){
+      #pragma omp critical(gnomad_builder_error)
+      if(!error) error = std::current_exception();
+    };
+
+    auto plans = std::vector<std::optional<std::pair<size_t, size_t>>>(urls.size());
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for(size_t idx = 0; idx < urls.size(); ++idx){
+      try {
+        plans[idx] = plan_chromosome(urls[idx]);
+      } catch (...) {
+        keep_error();
+      }
+    }
+    if(error){
+      std::rethrow_exception(error);
+    }
+
+    // a task is a chunk of a file, or the whole file if it can't be split (first, they're long)
+    static constexpr auto whole_file = std::numeric_limits<size_t>::max();
+    struct Task {
+      size_t url_idx;
+      size_t arc_idx;
+    };
+    auto tasks = std::vector<Task>{};
+    auto chunk_blocks = std::vector<std::vector<std::vector<uint64_t>>>(urls.size());
+    for(size_t idx = 0; idx < urls.size(); ++idx){
+      if(!plans[idx].has_value()){
+        SPDLOG_LOGGER_INFO(err_mt_logger, "Building file: `{}` (no index or contig length, "
+          "the file is built sequentially)", urls[idx]);
+        tasks.push_back({idx, whole_file});
+      }
+    }
+    for(size_t idx = 0; idx < urls.size(); ++idx){
+      if(plans[idx].has_value()){
+        auto [chr_idx, chunks] = *plans[idx];
+        SPDLOG_LOGGER_INFO(err_mt_logger, "Building file: `{}` ({} chunks)", urls[idx], chunks);
+        std::filesystem::create_directories(gnom_dir / Attr::ChrMap::idx2chr(chr_idx));
+        chunk_blocks[idx].resize(chunks);
+        for(size_t arc_idx = 0; arc_idx < chunks; ++arc_idx){
+          tasks.push_back({idx, arc_idx});
+        }
+      }
+    }
+
+    // the readers of each thread, by file
+    auto readers = std::vector<std::map<size_t, std::unique_ptr<HTS_VCF>>>(threads);
+    #pragma omp parallel for schedule(dynamic) num_threads(threads)
+    for(size_t task_idx = 0; task_idx < tasks.size(); ++task_idx){
+      auto [url_idx, arc_idx] = tasks[task_idx];
+      try {
+        if(arc_idx == whole_file){
+          build_chromosome(urls[url_idx], gnom_dir);
+          continue;
+        }
+        auto& reader = readers[omp_get_thread_num()][url_idx];
+        if(!reader){
+          reader = std::make_unique<HTS_VCF>(urls[url_idx], true, true, true, false);
+        }
+        chunk_blocks[url_idx][arc_idx] = build_chunk(*reader, plans[url_idx]->first, arc_idx, gnom_dir);
+      } catch (...) {
+        keep_error();
+      }
+    }
+    readers.clear();
+    if(error){
+      std::rethrow_exception(error);
+    }
+
+    // the presence filters are assembled in chunk order once all chunks are built
+    for(size_t idx = 0; idx < urls.size(); ++idx){
+      if(!plans[idx].has_value()) continue;
+      auto filter = AlleleFilter{};
+      for(size_t arc_idx = 0; arc_idx < chunk_blocks[idx].size(); ++arc_idx){
+        filter.append_blocks(arc_idx, chunk_blocks[idx][arc_idx]);
+      }
+      auto filter_file = gnom_dir / Attr::ChrMap::idx2chr(plans[idx]->first) / filter_name;
+      save_flat_to(filter, filter_file);
+      SPDLOG_LOGGER_INFO(err_mt_logger,
+        "{} is saved ({:.1f} MB).", filter_file.c_str(), filter.bytes() / 1048576.);
     }
   }
 
@@ -313,33 +785,122 @@ public:
   }
 
   void load(const Path& filename) override {
+    cache.clear();
     gnom_dir = filename;
+
+    filters.clear();
+    auto filter_bytes = size_t{0};
+    for(size_t chr = 0; chr < Attr::ChrMap::approved_chr.size(); ++chr){
+      auto filter_file = gnom_dir / Attr::ChrMap::idx2chr(chr) / filter_name;
+      if(std::filesystem::exists(filter_file)){
+        auto& filter = filters[chr];
+        load_archive_from(filter, filter_file);
+        filter_bytes += filter.bytes();
+      }
+    }
+    if(filters.empty()){
+      SPDLOG_INFO("<DataBaseGnomAD> No presence filter, rebuild the database to skip the chunk "
+        "loads of the alleles not in gnomAD");
+    }else{
+      SPDLOG_INFO("<DataBaseGnomAD> Presence filters of {} chromosomes ({:.1f} MB)",
+        filters.size(), filter_bytes / 1048576.);
+    }
   }
 
-  Exac find(const std::string& chr0, size_t pos0, const std::string& ref0, const std::string& alt0) {
+  /**
+   * @brief Thread safe, the chunks are shared by the threads through the cache.
+   * The alleles rejected by the presence filter are answered without loading their chunk.
+   */
+  Exac find(const std::string& chr0, size_t pos0, const std::string& ref0, const std::string& alt0) const {
     auto chr = Attr::ChrMap::chr2idx(chr0);
     auto chr_dir = gnom_dir / Attr::ChrMap::idx2chr(chr);
     if(!std::filesystem::exists(chr_dir)){
       SPDLOG_WARN("chromosome dir: `{}` not exist!", chr_dir.c_str());
       return {};
     }
+    if(!may_contain(chr, pos0, ref0, alt0)){
+      return {};
+    }
     size_t arc_idx = pos0 / chunk_size;
-    if (chr != current_chr or arc_idx != current_chunk or !loaded) {
-      auto arc_file = chr_dir / get_arc_name(arc_idx);
-      if (!std::filesystem::exists(arc_file)) {
-        return {};
-      }
-      load_archive_from(gnom, arc_file);
-      current_chr = gnom.chr;
-      current_chunk = gnom.pos;
-      loaded = true;
+    auto chunk = cache.get({chr, arc_idx});
+    if (prefetch_next) {
+      cache.prefetch({chr, arc_idx + 1});
+    }
+    if (!chunk) {
+      return {};
     }
-    return gnom.find(pos0, ref0, alt0);
+    return chunk->find(pos0, ref0, alt0);
   }
 
-  inline Exac find(const SherlocMember& sher_mem) {
+  inline Exac find(const SherlocMember& sher_mem) const {
     return find(sher_mem.chr, sher_mem.pos, sher_mem.ref, sher_mem.alt);
   }
+
+  /**
+   * @brief `find` of a batch of alleles, one column of results in the same order.
+   * Each run of alleles in the same chunk takes the chunk once from the cache and is
+   * merged with it in one pass, the chunk isn't loaded if the presence filter rejects
+   * all of them. The runs are answered on `threads` threads, so the chunks are decoded
+   * in parallel.
+   */
+  std::vector<Exac> find_batch(std::span<const SherlocMember> sher_mems, int threads = 1) const {
+    struct ChunkRun {
+      size_t chr;
+      size_t arc_idx;
+      size_t offset;
+      std::span<const SherlocMember> run;
+    };
+    auto chunk_runs = std::vector<ChunkRun>{};
+    for_each_chr_run(sher_mems, [&](auto chr, auto offset, auto run){
+      auto chr_dir = gnom_dir / Attr::ChrMap::idx2chr(chr);
+      if(!std::filesystem::exists(chr_dir)){
+        SPDLOG_WARN("chromosome dir: `{}` not exist!", chr_dir.c_str());
+        return;
+      }
+      auto begin = size_t{0};
+      while(begin < run.size()){
+        auto arc_idx = run[begin].pos / chunk_size;
+        auto end = begin + 1;
+        while(end < run.size() and run[end].pos / chunk_size == arc_idx){
+          ++end;
+        }
+        auto chunk_run = run.subspan(begin, end - begin);
+        if(std::ranges::any_of(chunk_run, [&](auto& sher_mem){
+          return may_contain(chr, sher_mem.pos, sher_mem.ref, sher_mem.alt);
+        })){
+          chunk_runs.emplace_back(ChunkRun{chr, arc_idx, offset + begin, chunk_run});
+        }
+        begin = end;
+      }
+    });
+
+    auto ret = std::vector<Exac>(sher_mems.size());
+    // exceptions can't leave the omp loop, keep the first one
+    auto error = std::exception_ptr{};
+    #pragma omp parallel for schedule(dynamic, 1) num_threads(std::max(1, threads))
+    for(size_t idx = 0; idx < chunk_runs.size(); ++idx){
+      try{
+        auto& chunk_run = chunk_runs[idx];
+        auto chunk = cache.get({chunk_run.chr, chunk_run.arc_idx});
+        if (prefetch_next) {
+          cache.prefetch({chunk_run.chr, chunk_run.arc_idx + 1});
+        }
+        if (chunk) {
+          std::ranges::move(chunk->find_batch(chunk_run.run),
+            ret.begin() + chunk_run.offset);
+        }
+      }catch(...){
+        #pragma omp critical(gnom_find_batch_error)
+        if(!error) error = std::current_exception();
+      }
+    }
+    if(error){
+      std::rethrow_exception(error);
+    }
+    return ret;
+  }
 };
 
-}
\ No newline at end of file
+}
+
+BOOST_CLASS_VERSION(Sherloc::DB::Gnom_alt, 1)
@@ -147,7 +147,7 @@ class DataBaseGTF : public BaseDB {
     void save(const Path& filename) override {
         this->set_build_time();
         this->log_metadata("DataBaseGTF");
-        save_archive_to(*this, filename);
+        save_flat_to(*this, filename);
     }
 
     void load(const Path& filename) override {
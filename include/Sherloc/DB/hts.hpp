@@ -1,8 +1,14 @@
 #pragma once
 
+#include <cstdlib>
+#include <optional>
+#include <string>
 #include <string_view>
+#include <vector>
 #include <filesystem>
 #include <htslib/hts.h>
+#include <htslib/tbx.h>
+#include <Sherloc/DB/hts_thread_pool.hpp>
 
 namespace Sherloc::DB {
 
@@ -12,6 +18,14 @@ class HTS_File {
 protected:
   kstring_t ks = KS_INITIALIZE;
   htsFile *hts_file;
+
+  // region query (see `query`), the tabix index is loaded lazily
+  Path file_path;
+  std::optional<bool> indexed;
+  tbx_t *tbx_idx = nullptr;
+  hts_itr_t *region_itr = nullptr;
+  bool region_empty = false;
+
 public:
   /**
    * @brief Construct a new hts file reader
@@ -19,11 +33,12 @@ public:
    * @param file 
    */
   HTS_File(const Path& file):
-    hts_file(hts_open(file.c_str(), "r"))
+    hts_file(hts_open(file.c_str(), "r")), file_path(file)
   {
     if(hts_file == nullptr) {
       throw std::runtime_error("Unable to open file.");
     }
+    HTSThreadPool::get().attach(hts_file);
   }
 
   enum HTS_Status{
@@ -32,7 +47,12 @@ public:
     READ_RECORD_FAILED
   };
 
+  HTS_File(const HTS_File&) = delete;
+  HTS_File& operator=(const HTS_File&) = delete;
+
   ~HTS_File(){
+    if(region_itr) hts_itr_destroy(region_itr);
+    if(tbx_idx) tbx_destroy(tbx_idx);
     ks_free(&ks);
     hts_close(hts_file);
   }
@@ -50,7 +70,12 @@ public:
    * @return HTS_File::HTS_Status 
    */
   auto parse_line(){
-    auto status = hts_getline(hts_file, '\n', &ks);
+    if(region_empty){
+      return HTS_EOF;
+    }
+    auto status = region_itr ?
+      tbx_itr_next(hts_file, tbx_idx, region_itr, &ks) :
+      hts_getline(hts_file, '\n', &ks);
     if(status <= -2){
       return READ_RECORD_FAILED;
     }
@@ -62,6 +87,53 @@ public:
     line = std::string_view{ks_str(&ks), ks_len(&ks)};
     return OK;
   }
+
+  /**
+   * @brief Check if the file has a tabix index, the index is loaded on the first call.
+   */
+  bool has_index(){
+    if(!indexed.has_value()){
+      tbx_idx = tbx_index_load3(file_path.c_str(), nullptr, HTS_IDX_SILENT_FAIL);
+      indexed = tbx_idx != nullptr;
+    }
+    return indexed.value();
+  }
+
+  /**
+   * @brief The sequence names of the tabix index, empty if there is no index
+   */
+  std::vector<std::string> index_seqnames(){
+    auto names = std::vector<std::string>{};
+    if(!has_index()){
+      return names;
+    }
+    auto n = 0;
+    auto seqnames = tbx_seqnames(tbx_idx, &n);
+    for(auto idx = 0; idx < n; ++idx){
+      names.emplace_back(seqnames[idx]);
+    }
+    std::free(seqnames);
+    return names;
+  }
+
+  /**
+   * @brief Restrict the following `parse_line` calls to a region of the tabix index,
+   * e.g. "chr1" or "chr1:10000-20000"
+   *
+   * @return false if there is no index or the region is not in it (parse_line will return HTS_EOF)
+   */
+  bool query(const std::string& region){
+    if(region_itr){
+      hts_itr_destroy(region_itr);
+      region_itr = nullptr;
+    }
+    region_empty = false;
+    if(has_index()){
+      region_itr = tbx_itr_querys(tbx_idx, region.c_str());
+    }
+    region_empty = region_itr == nullptr;
+    return !region_empty;
+  }
 };
 
 }
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdexcept>
+#include <spdlog/spdlog.h>
+#include <htslib/hts.h>
+#include <htslib/faidx.h>
+#include <htslib/thread_pool.h>
+
+namespace Sherloc::DB {
+
+/**
+ * @brief The process wide htslib thread pool for BGZF decompression.
+ *
+ * Call `init` once (before opening files), then every HTS_VCF / HTS_File / FaidxWrapper
+ * opened afterwards decodes its blocks on this pool. The readers share the workers,
+ * so parallel readers (e.g. gnomAD builder) don't multiply the thread count.
+ * Without `init` (or with <= 1 thread) the readers stay single threaded.
+ */
+class HTSThreadPool {
+private:
+  htsThreadPool pool = {nullptr, 0};
+  int n_threads = 0;
+
+  HTSThreadPool() = default;
+
+public:
+  HTSThreadPool(const HTSThreadPool&) = delete;
+  HTSThreadPool& operator=(const HTSThreadPool&) = delete;
+
+  ~HTSThreadPool(){
+    if(pool.pool){
+      hts_tpool_destroy(pool.pool);
+    }
+  }
+
+  static HTSThreadPool& get(){
+    static HTSThreadPool instance;
+    return instance;
+  }
+
+  /**
+   * @brief Create the pool, it can be created only once
+   *
+   * @param threads number of worker threads, <= 1 disables the pool
+   */
+  void init(int threads){
+    if(pool.pool){
+      SPDLOG_WARN("HTSThreadPool: already initialized with {} threads", n_threads);
+      return;
+    }
+    if(threads <= 1){
+      return;
+    }
+    pool.pool = hts_tpool_init(threads);
+    if(pool.pool == nullptr){
+      throw std::runtime_error("Unable to create htslib thread pool.");
+    }
+    n_threads = threads;
+    SPDLOG_INFO("HTSThreadPool: {} IO threads", n_threads);
+  }
+
+  [[nodiscard]] auto enabled() const {
+    return pool.pool != nullptr;
+  }
+
+  [[nodiscard]] auto size() const {
+    return n_threads;
+  }
+
+  /**
+   * @brief Decode the file on the pool, do nothing if the pool is disabled
+   * or the file is not BGZF compressed
+   *
+   * @param file
+   */
+  void attach(htsFile* file){
+    if(enabled() and hts_set_thread_pool(file, &pool) != 0){
+      SPDLOG_WARN("HTSThreadPool: failed to attach the pool to a file, read it single threaded");
+    }
+  }
+
+  /**
+   * @brief Decode the bgzipped fasta on the pool, do nothing if the pool is disabled
+   *
+   * @param fai
+   */
+  void attach(faidx_t* fai){
+    if(enabled() and fai_thread_pool(fai, pool.pool, 0) != 0){
+      SPDLOG_WARN("HTSThreadPool: failed to attach the pool to a fasta, read it single threaded");
+    }
+  }
+};
+
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <fmt/format.h>
+#include <Sherloc/DB/db.hpp>
+
+namespace Sherloc::DB {
+
+/**
+ * @brief A pool of distinct strings, each referred to by a 32 bit id
+ *
+ * The repeated values of a column (clinical significances, genes, alleles) are stored
+ * once, the column keeps their ids. The id lookup of `intern` is only built while
+ * appending, a loaded pool is read in place.
+ */
+class InternedStrings {
+public:
+  using IdType = uint32_t;
+
+private:
+  struct Hash {
+    using is_transparent = void;
+    size_t operator()(std::string_view str) const { return std::hash<std::string_view>{}(str); }
+  };
+
+  FlatStrings strings;
+  std::unordered_map<std::string, IdType, Hash, std::equal_to<>> ids;
+
+public:
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & strings;
+    if constexpr (Archive::is_loading::value){
+      ids.clear();
+    }
+  }
+
+  /**
+   * @brief The id of `str`, added to the pool if it's new
+   */
+  IdType intern(std::string_view str){
+    if(ids.size() != strings.size()){ // loaded, index the pool before appending
+      ids.clear();
+      for(size_t idx = 0; idx < strings.size(); ++idx){
+        ids.emplace(strings[idx], static_cast<IdType>(idx));
+      }
+    }
+    if(auto it = ids.find(str); it != ids.end()){
+      return it->second;
+    }
+    if(strings.size() > std::numeric_limits<IdType>::max()){
+      throw std::length_error(fmt::format("InternedStrings: more than {} strings", strings.size()));
+    }
+    auto id = static_cast<IdType>(strings.size());
+    strings.emplace_back(str);
+    ids.emplace(str, id);
+    return id;
+  }
+
+  [[nodiscard]] std::string_view operator[](IdType id) const {
+    return strings[id];
+  }
+
+  [[nodiscard]] size_t size() const { return strings.size(); }
+  [[nodiscard]] size_t bytes() const { return strings.bytes(); }
+};
+
+}
@@ -8,6 +8,8 @@
 #include <Sherloc/sherloc_member.hpp>
 #include <cstdlib>
 #include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/batch.hpp>
+#include <Sherloc/DB/packed.hpp>
 #include <Sherloc/DB/vcf.hpp>
 
 namespace Sherloc::DB {
@@ -19,93 +21,91 @@ class K
     size_t chr;
 
     // for snp
-    std::vector< PositionType > db_vec_snp;
-    std::vector< char >         db_vec_snp_alt;
-    std::vector< StatusType >   db_vec_snp_status;
+    PackedPositions           db_vec_snp;
+    PackedBases               db_vec_snp_alt;
+    FlatArray< StatusType >   db_vec_snp_status;
 
     // for insertion
-    std::vector< PositionType > db_vec_ins;
-    std::vector< std::string >  db_vec_ins_alt;
-    std::vector< StatusType >   db_vec_ins_status;
+    PackedPositions           db_vec_ins;
+    FlatStrings               db_vec_ins_alt;
+    FlatArray< StatusType >   db_vec_ins_status;
 
     // for deletion
-    std::vector< PositionType > db_vec_del;
-    std::vector< std::string >  db_vec_del_ref;
-    std::vector< StatusType >   db_vec_del_status;
+    PackedPositions           db_vec_del;
+    FlatStrings               db_vec_del_ref;
+    FlatArray< StatusType >   db_vec_del_status;
+
+    // version 1: positions and snp alts are packed, see `PackedPositions`
     HOLMES_SERIALIZE(ar, version){
         ar & db_vec_snp_status;
         ar & db_vec_ins_status;
         ar & db_vec_del_status;
 
-        ar & db_vec_snp;
-        ar & db_vec_ins;
-        ar & db_vec_del;
+        serialize_packed(ar, db_vec_snp, version);
+        serialize_packed(ar, db_vec_ins, version);
+        serialize_packed(ar, db_vec_del, version);
 
-        ar & db_vec_snp_alt;
+        serialize_packed(ar, db_vec_snp_alt, version);
         ar & db_vec_ins_alt;
         ar & db_vec_del_ref;
 
         ar & chr;
     }
 
-    K(size_t chr = 0): chr(chr){ reserve(); }
-
-    void reserve(){
-        static constexpr size_t snp_capacity = 7000000;
-        static constexpr size_t ins_capacity = 600000;
-        static constexpr size_t del_capacity = 600000;
-        
-        db_vec_snp.reserve(snp_capacity);
-        db_vec_snp_status.reserve(snp_capacity);
-        db_vec_snp_alt.reserve(snp_capacity);
+    K(size_t chr = 0): chr(chr){}
 
-        db_vec_ins.reserve(ins_capacity);
-        db_vec_ins_status.reserve(ins_capacity);
-        db_vec_ins_alt.reserve(ins_capacity);
-
-        db_vec_del.reserve(del_capacity);
-        db_vec_del_status.reserve(del_capacity);
-        db_vec_del_ref.reserve(del_capacity);
+    /**
+     * @brief Bytes held by the allele columns (mapped or owned)
+     */
+    [[nodiscard]] size_t bytes() const {
+        return db_vec_snp.bytes() + db_vec_ins.bytes() + db_vec_del.bytes()
+            + db_vec_snp_alt.bytes() + db_vec_ins_alt.bytes() + db_vec_del_ref.bytes()
+            + (db_vec_snp_status.size() + db_vec_ins_status.size() + db_vec_del_status.size())
+                * sizeof(StatusType);
     }
 
-    void add_allele(HTS_VCF& vcf){
-        auto pos = (PositionType)vcf.record.pos;
+    /**
+     * @param vcf 
+     * @param af_id header id of INFO AF, see HTS_VCF::info2id
+     */
+    void add_allele(HTS_VCF& vcf, int af_id){
+        auto pos = (PositionType)vcf.view.pos();
         float status = 0.f;
 
-        status = vcf.info_float("AF").value_or(0.f);
+        status = vcf.info_float(af_id).value_or(0.f);
 
-        if(vcf.record.ref.size() > vcf.record.alt.size()){ // deletion
+        if(vcf.view.ref.size() > vcf.view.alt.size()){ // deletion
             db_vec_del.emplace_back(pos + 1);
-            db_vec_del_ref.emplace_back(vcf.record.ref.substr(1));
+            db_vec_del_ref.emplace_back(vcf.view.ref.substr(1));
             db_vec_del_status.emplace_back(status);
-        }else if(vcf.record.ref.size() < vcf.record.alt.size()){ // insertion
+        }else if(vcf.view.ref.size() < vcf.view.alt.size()){ // insertion
             db_vec_ins.emplace_back(pos + 1);
-            db_vec_ins_alt.emplace_back(vcf.record.alt.substr(1));
+            db_vec_ins_alt.emplace_back(vcf.view.alt.substr(1));
             db_vec_ins_status.emplace_back(status);
-        }else if(vcf.record.ref.size() == 1){ // snp
+        }else if(vcf.view.ref.size() == 1){ // snp
             db_vec_snp.emplace_back(pos);
-            db_vec_snp_alt.emplace_back(vcf.record.alt[0]);
+            db_vec_snp_alt.emplace_back(vcf.view.alt[0]);
             db_vec_snp_status.emplace_back(status);
         }else{
-            SPDLOG_CRITICAL("WEIRD VARIANT! ref: {}, alt {}", vcf.record.ref, vcf.record.alt);
+            SPDLOG_CRITICAL("WEIRD VARIANT! ref: {}, alt {}", vcf.view.ref, vcf.view.alt);
         }
     }
 
-    float find_snp( std::uint32_t pos0, char alt0 ) const {
-        auto&& [begin_it, end_it] = std::ranges::equal_range(db_vec_snp, pos0);
-        for(auto it = begin_it; it != end_it; ++it){
-            auto idx = std::distance(db_vec_snp.begin(), it);
+    /**
+     * @brief Status of the matching allele among the index `range`, the equal range of
+     * its position
+     */
+    float match_snp(std::pair<size_t, size_t> range, char alt0) const {
+        for(auto idx = range.first; idx != range.second; ++idx){
             if(db_vec_snp_alt[idx] == alt0){
                 return db_vec_snp_status[idx];
             }
         }
         return 0.f;
     }
-    
-    float find_insertion(std::uint32_t pos0, const std::string& ins_alt) const {
-        auto&& [begin_it, end_it] = std::ranges::equal_range(db_vec_ins, pos0);
-        for(auto it = begin_it; it != end_it; ++it){
-            auto idx = std::distance(db_vec_ins.begin(), it);
+
+    float match_insertion(std::pair<size_t, size_t> range, const std::string& ins_alt) const {
+        for(auto idx = range.first; idx != range.second; ++idx){
             if(db_vec_ins_alt[idx] == ins_alt){
                 return db_vec_ins_status[idx];
             }
@@ -113,10 +113,8 @@ class K
         return 0.f;
     }
 
-    float find_deletion(std::uint32_t pos0, const std::string& del_ref) const {
-        auto&& [begin_it, end_it] = std::ranges::equal_range(db_vec_del, pos0);
-        for(auto it = begin_it; it != end_it; ++it){
-            auto idx = std::distance(db_vec_del.begin(), it);
+    float match_deletion(std::pair<size_t, size_t> range, const std::string& del_ref) const {
+        for(auto idx = range.first; idx != range.second; ++idx){
             if(db_vec_del_ref[idx] == del_ref){
                 return db_vec_del_status[idx];
             }
@@ -124,6 +122,18 @@ class K
         return 0.f;
     }
 
+    float find_snp( std::uint32_t pos0, char alt0 ) const {
+        return match_snp(db_vec_snp.equal_range(pos0), alt0);
+    }
+    
+    float find_insertion(std::uint32_t pos0, const std::string& ins_alt) const {
+        return match_insertion(db_vec_ins.equal_range(pos0), ins_alt);
+    }
+
+    float find_deletion(std::uint32_t pos0, const std::string& del_ref) const {
+        return match_deletion(db_vec_del.equal_range(pos0), del_ref);
+    }
+
     inline float find( const SherlocMember& sher_mem ) const {
         return find(sher_mem.pos, sher_mem.ref, sher_mem.alt);
     }
@@ -139,6 +149,29 @@ class K
         return find_deletion(pos0, ref0);
     }
 
+    /**
+     * @brief `find` of the alleles of this chromosome, merged with the position arrays
+     * in one pass (see `GallopCursor`). The alleles should be sorted by position.
+     */
+    std::vector<float> find_batch(std::span<const SherlocMember> sher_mems) const {
+        auto snp = PackedCursor(db_vec_snp);
+        auto ins = PackedCursor(db_vec_ins);
+        auto del = PackedCursor(db_vec_del);
+        auto ret = std::vector<float>();
+        ret.reserve(sher_mems.size());
+        for(auto& sher_mem : sher_mems){
+            auto pos0 = static_cast<PositionType>(sher_mem.pos);
+            if(sher_mem.ref != "-" and sher_mem.alt != "-"){ // snp
+                ret.emplace_back(match_snp(snp.equal_range(pos0), sher_mem.alt[0]));
+            }else if(sher_mem.ref == "-"){ // insertion
+                ret.emplace_back(match_insertion(ins.equal_range(pos0), sher_mem.alt));
+            }else{ // deletion
+                ret.emplace_back(match_deletion(del.equal_range(pos0), sher_mem.ref));
+            }
+        }
+        return ret;
+    }
+
 };
 
 class DataBase1KG : public BaseDB {
@@ -160,10 +193,11 @@ public:
     db_version = k_vcf
       .get_generic_header_value("fileDate")
       .value_or("None");
+    auto af_id = k_vcf.info2id("AF");
     
     auto eof = false;
     while (true) {
-      switch (k_vcf.parse_line()) {
+      switch (k_vcf.parse_view()) {
         using enum HTS_VCF::VCF_Status;
         case OK:
           break;
@@ -182,15 +216,18 @@ public:
       if(eof){
         break;
       }
-      chr = Attr::ChrMap::chr2idx(k_vcf.record.chr);
-      db_map[chr].add_allele(k_vcf);
+      if(!k_vcf.view.accepted_chr()){
+        throw std::out_of_range(fmt::format("DB<K> unaccepted chr: {}", k_vcf.view.chr));
+      }
+      chr = k_vcf.view.chr_idx;
+      db_map[chr].add_allele(k_vcf, af_id);
       ++line_num;
       if(line_num % 1000000 == 0){
         SPDLOG_INFO("DB<K> chr{} parsed {} records.",
-         k_vcf.record.chr, line_num);
+         k_vcf.view.chr, line_num);
       }
     }
-    SPDLOG_INFO("Chr{} Total variant statistics:", k_vcf.record.chr);
+    SPDLOG_INFO("Chr{} Total variant statistics:", Attr::ChrMap::idx2chr(chr));
     SPDLOG_INFO("SNP count: {}", db_map[chr].db_vec_snp.size());
     SPDLOG_INFO("Insertion count: {}", db_map[chr].db_vec_ins.size());
     SPDLOG_INFO("Deletion count: {}", db_map[chr].db_vec_del.size());
@@ -214,7 +251,7 @@ public:
   void save(const Path& filename) override {
     this->set_build_time();
     log_metadata("DataBase1KG");
-    save_archive_to(*this, filename);
+    save_flat_to(*this, filename);
   }
 
   inline float find(
@@ -229,6 +266,19 @@ public:
   inline float find(const SherlocMember& sher_mem) const {
     return find(sher_mem.chr, sher_mem.pos, sher_mem.ref, sher_mem.alt);
   }
+
+  /**
+   * @brief `find` of a batch of alleles, one column of results in the same order
+   */
+  std::vector<float> find_batch(std::span<const SherlocMember> sher_mems) const {
+    auto ret = std::vector<float>(sher_mems.size());
+    for_each_chr_run(sher_mems, [&](auto chr, auto offset, auto run){
+      std::ranges::copy(db_map.at(chr).find_batch(run), ret.begin() + offset);
+    });
+    return ret;
+  }
 };
 
 }
+
+BOOST_CLASS_VERSION(Sherloc::DB::K, 1)
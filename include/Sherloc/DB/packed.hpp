@@ -0,0 +1,303 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <ranges>
+#include <stdexcept>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <fmt/format.h>
+#include <boost/serialization/access.hpp>
+#include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/batch.hpp>
+
+/**
+ * Packed columns of the allele tables (1KG, gnomAD)
+ *
+ * Both columns keep their last, unfinished block plain (`tail`) and pack it once it's full,
+ * so they are built by appending and never rewrite packed data. The packed parts are
+ * `FlatArray`s, mapped in place from flat files like the other columns.
+ */
+
+namespace Sherloc::DB {
+
+/**
+ * @brief Sorted positions in blocks of `block_size`
+ *
+ * Each block keeps its first position in the skip index `firsts`, the other positions are
+ * stored as deltas from it with the bit width of the largest one, starting at a word
+ * boundary of `words`. A lookup is a binary search on `firsts` then on one block, any
+ * element is decoded in O(1).
+ */
+class PackedPositions {
+public:
+  using value_type = uint32_t;
+  static constexpr size_t block_size = 128;
+
+private:
+  FlatArray<uint32_t> firsts;  // skip index, first position of each block
+  FlatArray<uint64_t> offsets; // first word of each block in `words`
+  FlatArray<uint8_t>  widths;  // delta bit width of each block
+  FlatArray<uint64_t> words;   // packed deltas
+  FlatArray<uint32_t> tail;    // positions after the last full block
+
+  static constexpr size_t words_of(unsigned width){
+    return ((block_size - 1) * width + 63) / 64;
+  }
+
+  void seal(){
+    auto first = tail[0];
+    auto width = static_cast<unsigned>(std::bit_width(tail.back() - first));
+    auto block = std::vector<uint64_t>(words_of(width), 0);
+    for(size_t idx = 1; idx < block_size && width > 0; ++idx){
+      auto delta = static_cast<uint64_t>(tail[idx] - first);
+      auto bit = (idx - 1) * width;
+      auto word = bit / 64;
+      auto shift = bit % 64;
+      block[word] |= delta << shift;
+      if(shift + width > 64){
+        block[word + 1] |= delta >> (64 - shift);
+      }
+    }
+    firsts.push_back(first);
+    offsets.push_back(words.size());
+    widths.push_back(static_cast<uint8_t>(width));
+    words.append(block.data(), block.size());
+    tail.clear();
+  }
+
+  /**
+   * @brief The first index whose position doesn't satisfy `pred` (true then false)
+   */
+  template<class Pred>
+  size_t partition_point(Pred&& pred) const {
+    auto block = static_cast<size_t>(std::ranges::partition_point(firsts, pred) - firsts.begin());
+    auto lo = block == 0 ? size_t{0} : (block - 1) * block_size;
+    auto hi = block < firsts.size() ? block * block_size : size();
+    while(lo < hi){
+      auto mid = lo + (hi - lo) / 2;
+      if(pred((*this)[mid])){
+        lo = mid + 1;
+      }else{
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+public:
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & firsts;
+    ar & offsets;
+    ar & widths;
+    ar & words;
+    ar & tail;
+  }
+
+  /**
+   * @param pos not smaller than the last position
+   */
+  void push_back(value_type pos){
+    if(!empty() and pos < back()){
+      throw std::invalid_argument(
+        fmt::format("PackedPositions: position {} after {} is not sorted", pos, back()));
+    }
+    tail.push_back(pos);
+    if(tail.size() == block_size){
+      seal();
+    }
+  }
+
+  void emplace_back(value_type pos){
+    push_back(pos);
+  }
+
+  void clear(){
+    firsts.clear();
+    offsets.clear();
+    widths.clear();
+    words.clear();
+    tail.clear();
+  }
+
+  [[nodiscard]] size_t size() const { return firsts.size() * block_size + tail.size(); }
+  [[nodiscard]] bool empty() const { return size() == 0; }
+  [[nodiscard]] value_type back() const { return (*this)[size() - 1]; }
+
+  [[nodiscard]] size_t bytes() const {
+    return (firsts.size() + tail.size()) * sizeof(uint32_t)
+      + (offsets.size() + words.size()) * sizeof(uint64_t) + widths.size();
+  }
+
+  [[nodiscard]] value_type operator[](size_t idx) const {
+    auto block = idx / block_size;
+    if(block >= firsts.size()){
+      return tail[idx - firsts.size() * block_size];
+    }
+    auto first = firsts[block];
+    auto width = widths[block];
+    auto in_block = idx % block_size;
+    if(in_block == 0 or width == 0){
+      return first;
+    }
+    auto block_words = words.data() + offsets[block];
+    auto bit = (in_block - 1) * width;
+    auto word = bit / 64;
+    auto shift = bit % 64;
+    auto delta = block_words[word] >> shift;
+    if(shift + width > 64){
+      delta |= block_words[word + 1] << (64 - shift);
+    }
+    return first + static_cast<value_type>(delta & ((uint64_t{1} << width) - 1));
+  }
+
+  /**
+   * @brief Index range of the elements equal to `pos`
+   */
+  [[nodiscard]] std::pair<size_t, size_t> equal_range(size_t pos) const {
+    return {
+      partition_point([pos](value_type value){ return value < pos; }),
+      partition_point([pos](value_type value){ return value <= pos; })
+    };
+  }
+
+  /**
+   * @brief The positions as a random access range of values
+   */
+  [[nodiscard]] auto view() const {
+    return std::views::iota(uint32_t{0}, static_cast<uint32_t>(size()))
+      | std::views::transform([this](uint32_t idx){ return (*this)[idx]; });
+  }
+};
+
+/**
+ * @brief `GallopCursor` on a `PackedPositions`, giving index ranges
+ */
+class PackedCursor {
+private:
+  using View = decltype(std::declval<const PackedPositions&>().view());
+  View view;
+  GallopCursor<std::ranges::iterator_t<View>> cursor;
+
+public:
+  explicit PackedCursor(const PackedPositions& positions):
+    view(positions.view()), cursor(std::ranges::begin(view), std::ranges::end(view)) {}
+
+  // the cursor points into `view`
+  PackedCursor(const PackedCursor&) = delete;
+  PackedCursor& operator=(const PackedCursor&) = delete;
+
+  std::pair<size_t, size_t> equal_range(size_t pos){
+    auto range = cursor.equal_range(pos);
+    return {
+      static_cast<size_t>(range.begin() - std::ranges::begin(view)),
+      static_cast<size_t>(range.end() - std::ranges::begin(view))
+    };
+  }
+};
+
+/**
+ * @brief Bases packed in 2 bits, 32 per word. The rare bases other than ACGT are packed
+ * as 'A' and kept aside in `others`.
+ */
+class PackedBases {
+public:
+  using value_type = char;
+  static constexpr size_t block_size = 32;
+
+private:
+  static constexpr auto bases = std::string_view{"ACGT"};
+
+  FlatArray<uint64_t> words;
+  FlatArray<uint64_t> other_idx; // sorted indices of the bases other than ACGT
+  FlatArray<char>     others;
+  FlatArray<char>     tail;      // bases after the last full word
+
+  void seal(){
+    auto word = uint64_t{0};
+    for(size_t idx = 0; idx < block_size; ++idx){
+      auto code = bases.find(tail[idx]);
+      if(code == std::string_view::npos){
+        other_idx.push_back(words.size() * block_size + idx);
+        others.push_back(tail[idx]);
+        code = 0;
+      }
+      word |= static_cast<uint64_t>(code) << (idx * 2);
+    }
+    words.push_back(word);
+    tail.clear();
+  }
+
+public:
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & words;
+    ar & other_idx;
+    ar & others;
+    ar & tail;
+  }
+
+  void push_back(char base){
+    tail.push_back(base);
+    if(tail.size() == block_size){
+      seal();
+    }
+  }
+
+  void emplace_back(char base){
+    push_back(base);
+  }
+
+  void clear(){
+    words.clear();
+    other_idx.clear();
+    others.clear();
+    tail.clear();
+  }
+
+  [[nodiscard]] size_t size() const { return words.size() * block_size + tail.size(); }
+  [[nodiscard]] bool empty() const { return size() == 0; }
+
+  [[nodiscard]] size_t bytes() const {
+    return (words.size() + other_idx.size()) * sizeof(uint64_t) + others.size() + tail.size();
+  }
+
+  [[nodiscard]] char operator[](size_t idx) const {
+    auto word = idx / block_size;
+    if(word >= words.size()){
+      return tail[idx - words.size() * block_size];
+    }
+    auto code = (words[word] >> (idx % block_size * 2)) & 0b11;
+    if(code == 0 and !other_idx.empty()){
+      auto it = std::ranges::lower_bound(other_idx, uint64_t{idx});
+      if(it != other_idx.end() and *it == idx){
+        return others[it - other_idx.begin()];
+      }
+    }
+    return bases[code];
+  }
+};
+
+/**
+ * @brief (De)serialize a packed column. The archives of class version 0 (before packing)
+ * hold it as a plain array, which is packed on load.
+ */
+template<class Archive, class Packed>
+inline void serialize_packed(Archive& ar, Packed& column, unsigned int version){
+  if constexpr (Archive::is_loading::value){
+    if(version == 0){
+      auto plain = FlatArray<typename Packed::value_type>{};
+      ar & plain;
+      column.clear();
+      for(auto value : plain){
+        column.push_back(value);
+      }
+      return;
+    }
+  }
+  ar & column;
+}
+
+}
@@ -109,7 +109,7 @@ class DataBaseUniprot : public BaseDB {
     void save(const Path& filename) override {
         this->set_build_time();
         this->log_metadata("DataBaseUniprot");
-        save_archive_to(*this, filename);
+        save_flat_to(*this, filename);
     }
 
     void load(const Path& filename) override {
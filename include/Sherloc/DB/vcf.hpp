@@ -6,10 +6,16 @@
 #include <boost/algorithm/string.hpp>
 #include <Sherloc/sherloc_member.hpp>
 #include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/hts_thread_pool.hpp>
 #include <htslib/vcf.h>
 #include <htslib/vcfutils.h>
+#include <htslib/tbx.h>
 #include <spdlog/spdlog.h>
 #include <optional>
+#include <charconv>
+#include <limits>
+#include <span>
+#include <cstring>
 
 namespace Sherloc::DB {
 
@@ -20,6 +26,217 @@ private:
   bcf1_t *vcf_record;
 
   int unpack_flg = 0;
+
+  // reused between records, htslib grows them on demand
+  int32_t *gt_buf = nullptr;
+  int gt_buf_size = 0;
+  std::vector<std::array<int32_t, 2>> genotype_buf;
+  // ChrMap index of each contig id, resolved on the first record of the contig
+  std::vector<std::optional<size_t>> rid2chr_idx;
+
+  // FORMAT keys of `get_fmt`, and their header ids (-1 if not defined in the header)
+  static constexpr auto fmt_keys = Attr::make_sv_array("GT","AD","DP","GQ","PL");
+  std::array<int, fmt_keys.size()> fmt_ids;
+
+  // region query (see `query`), the index is loaded lazily on the first query
+  Path vcf_path;
+  std::optional<bool> indexed;
+  hts_idx_t *bcf_idx = nullptr;
+  tbx_t *tbx_idx = nullptr;
+  hts_itr_t *region_itr = nullptr;
+  kstring_t tbx_line = KS_INITIALIZE;
+  bool region_empty = false;
+
+  // fallback of region query when the file has no index
+  struct RegionFilter {
+    std::vector<std::string> chr_names;
+    hts_pos_t beg; // 0-based, inclusive
+    hts_pos_t end; // 0-based, exclusive
+  };
+  std::optional<RegionFilter> region_filter;
+
+  static auto chr_aliases(std::string_view chr){
+    return std::vector<std::string>{
+      std::string{chr},
+      chr.starts_with("chr") ? std::string{chr.substr(3)} : fmt::format("chr{}", chr)
+    };
+  }
+
+  [[nodiscard]] auto in_region_filter() const {
+    auto& filter = region_filter.value();
+    auto chr = std::string_view{bcf_hdr_id2name(vcf_header, vcf_record->rid)};
+    return
+      std::ranges::find(filter.chr_names, chr) != filter.chr_names.end() and
+      vcf_record->pos >= filter.beg and
+      vcf_record->pos < filter.end;
+  }
+
+  /**
+   * @brief read the next record, from the region iterator if a region is queried
+   * 
+   * @return 0 on success, -1 on EOF (or end of region), < -1 on error
+   */
+  int read_record(){
+    if(region_empty){
+      return -1;
+    }
+    if(region_itr){
+      if(tbx_idx){
+        auto ret = tbx_itr_next(hts_file, tbx_idx, region_itr, &tbx_line);
+        if(ret < 0) return ret;
+        return vcf_parse1(&tbx_line, vcf_header, vcf_record) == 0 ? 0 : -2;
+      }
+      auto ret = bcf_itr_next(hts_file, region_itr, vcf_record);
+      return ret < 0 ? ret : 0;
+    }
+    while(true){
+      auto ret = bcf_read(hts_file, vcf_header, vcf_record);
+      if(ret != 0 or !region_filter.has_value() or in_region_filter())
+        return ret;
+    }
+  }
+
+  /**
+   * @brief reopen the file and skip its header, so the next read starts from the first record.
+   * The header read in the constructor is kept, the ids of the same file are unchanged.
+   */
+  void rewind(){
+    vcf_close(hts_file);
+    hts_file = vcf_open(vcf_path.c_str(), "r");
+    if(hts_file == nullptr) {
+      throw std::runtime_error("Unable to reopen file.");
+    }
+    HTSThreadPool::get().attach(hts_file);
+    auto header = vcf_hdr_read(hts_file);
+    if(header == nullptr){
+      throw std::runtime_error("Unable to read header.");
+    }
+    bcf_hdr_destroy(header);
+  }
+
+  void reset_region(){
+    if(region_itr){
+      hts_itr_destroy(region_itr);
+      region_itr = nullptr;
+    }
+    region_filter = std::nullopt;
+    region_empty = false;
+  }
+  size_t chr_idx_of(int32_t rid){
+    if(rid2chr_idx.size() <= static_cast<size_t>(rid)){
+      rid2chr_idx.resize(rid + 1);
+    }
+    auto& chr_idx = rid2chr_idx[rid];
+    if(!chr_idx.has_value()){
+      try{
+        chr_idx = Attr::ChrMap::chr2idx(bcf_hdr_id2name(vcf_header, rid));
+      }catch(std::out_of_range& e){
+        chr_idx = RecordView::unaccepted_chr;
+      }
+    }
+    return chr_idx.value();
+  }
+
+  /**
+   * @brief decode the GT of every sample into genotype_buf
+   */
+  void decode_genotypes(){
+    auto n_sample = static_cast<size_t>(bcf_hdr_nsamples(vcf_header));
+    auto n = bcf_get_genotypes(vcf_header, vcf_record, &gt_buf, &gt_buf_size);
+    if(n <= 0 or n_sample == 0){ // no GT infomation
+      genotype_buf.assign(std::max(n_sample, size_t{1}), {-1, -1});
+      return;
+    }
+    // ex. in htslib parse 1/1 as {4,4}, 1/0 as {4,2}, 1/. as {4,0}
+    // each sample has `ploidy` values, padded by vector_end for the lower ploidy samples.
+    // Only the first two alleles are taken, a haploid call keeps 0 as its second allele.
+    // TODO: currently we don't take the phased information ('cause we don't have it)
+    auto ploidy = static_cast<size_t>(n) / n_sample;
+    genotype_buf.assign(n_sample, {0, 0});
+    for(auto s = size_t{0}; s < n_sample; ++s){
+      auto sample_gt = gt_buf + s * ploidy;
+      for(auto i = size_t{0}; i < std::min(ploidy, size_t{2}); ++i){
+        if(sample_gt[i] == bcf_int32_vector_end)
+          break;
+        genotype_buf[s][i] = bcf_gt_is_missing(sample_gt[i]) ?
+          -1 : bcf_gt_allele(sample_gt[i]);
+      }
+    }
+  }
+
+  bcf_info_t* get_info(int id){
+    if(id < 0){
+      return nullptr;
+    }
+    if(!(unpack_flg&BCF_UN_INFO)){
+      bcf_unpack(vcf_record, BCF_UN_INFO);
+    }
+    return bcf_get_info_id(vcf_record, id);
+  }
+
+  // the data of vector info is in vptr (v1 is only set for a single value)
+  template<class T>
+  static T first_info_value(const bcf_info_t& info){
+    auto value = T{};
+    std::memcpy(&value, info.vptr, sizeof(T));
+    return value;
+  }
+
+  template<class T>
+  static void append_int_values(
+    std::string& out, const T* values, int n, T missing, T vector_end, bool is_gt
+  ){
+    for(int i = 0; i < n and values[i] != vector_end; ++i){
+      if(is_gt){
+        // htslib encodes allele as (idx + 1) << 1 | phased, 0 is missing
+        if(i != 0) out += (values[i] & 1) ? '|' : '/';
+        if(bcf_gt_is_missing(values[i])) out += '.';
+        else fmt::format_to(std::back_inserter(out), "{}", bcf_gt_allele(values[i]));
+        continue;
+      }
+      if(i != 0) out += ',';
+      if(values[i] == missing) out += '.';
+      else fmt::format_to(std::back_inserter(out), "{}", values[i]);
+    }
+  }
+
+  /**
+   * @brief append the values of a FORMAT field of one sample, in VCF text style
+   */
+  static void append_fmt_values(std::string& out, const bcf_fmt_t& fmt, size_t sample_idx, bool is_gt){
+    auto data = fmt.p + sample_idx * fmt.size;
+    switch(fmt.type){
+      case BCF_BT_INT8:
+        append_int_values(out, reinterpret_cast<const int8_t*>(data), fmt.n,
+          int8_t{bcf_int8_missing}, int8_t{bcf_int8_vector_end}, is_gt);
+        break;
+      case BCF_BT_INT16:
+        append_int_values(out, reinterpret_cast<const int16_t*>(data), fmt.n,
+          int16_t{bcf_int16_missing}, int16_t{bcf_int16_vector_end}, is_gt);
+        break;
+      case BCF_BT_INT32:
+        append_int_values(out, reinterpret_cast<const int32_t*>(data), fmt.n,
+          int32_t{bcf_int32_missing}, int32_t{bcf_int32_vector_end}, is_gt);
+        break;
+      case BCF_BT_FLOAT: {
+        auto values = reinterpret_cast<const float*>(data);
+        for(int i = 0; i < fmt.n and !bcf_float_is_vector_end(values[i]); ++i){
+          if(i != 0) out += ',';
+          if(bcf_float_is_missing(values[i])) out += '.';
+          else fmt::format_to(std::back_inserter(out), "{}", values[i]);
+        }
+        break;
+      }
+      case BCF_BT_CHAR: {
+        auto chars = reinterpret_cast<const char*>(data);
+        out.append(chars, std::find(chars, chars + fmt.size, '\0'));
+        break;
+      }
+      default:
+        break;
+    }
+  }
+
 public:
   enum VCF_Status{
     OK,
@@ -35,9 +252,68 @@ public:
     std::string alt;
     int64_t pos = 0;
     std::array<int32_t, 2> genotype;
+    // genotype of every sample (in header order), `genotype` is the first one
+    std::vector<std::array<int32_t, 2>> sample_genotypes;
     std::vector<std::string> other_alt;
     bool phased = false;
   } record;
+
+  /**
+   * @brief A view of the current record, filled by `parse_view`.
+   *
+   * The strings point to the memory of htslib record (or header),
+   * so they are only valid until the next `parse_view` / `parse_line`.
+   */
+  struct RecordView {
+    static constexpr auto unaccepted_chr = std::numeric_limits<size_t>::max();
+    // Attr::ChrMap index, `unaccepted_chr` if the chromosome is not approved
+    size_t chr_idx = unaccepted_chr;
+    std::string_view chr;
+    int64_t pos0 = 0; // 0-based
+    std::string_view ref;
+    std::string_view alt;
+    std::array<int32_t, 2> genotype = {-1, -1};
+    std::span<const std::array<int32_t, 2>> sample_genotypes;
+    char** alleles = nullptr;
+    int n_allele = 0;
+
+    [[nodiscard]] auto pos() const {
+      return pos0 + 1;
+    }
+
+    [[nodiscard]] auto accepted_chr() const {
+      return chr_idx != unaccepted_chr;
+    }
+
+    /**
+     * @brief allele by index, 0 is ref, 1 is alt, and the others are `other_alt`
+     */
+    [[nodiscard]] std::string_view allele(int idx) const {
+      return alleles[idx];
+    }
+
+    /**
+     * @brief Converts the indel alleles to VEP-style, see HTS_VCF::to_vep_style
+     * 
+     * @return 1-based position in VEP-style
+     */
+    auto to_vep_style(){
+      using namespace std::literals;
+      auto vep_pos = pos();
+      if(ref.size() != alt.size() and 
+        (ref.size() == 1 or alt.size() == 1)){
+        ++vep_pos;
+        if(ref.size() == 1){ // insertion
+          ref = "-"sv;
+          alt.remove_prefix(1);
+        }else{ // deletion
+          alt = "-"sv;
+          ref.remove_prefix(1);
+        }
+      }
+      return vep_pos;
+    }
+  } view;
   
   /**
    * @brief Construct a new hts vcf object
@@ -48,12 +324,13 @@ public:
    * @param unpack_format 
    */
   HTS_VCF(const Path& vcf_file, bool unpack_alt = true, bool unpack_flt = true, bool unpack_info = true, bool unpack_format = true):
-    hts_file(vcf_open(vcf_file.c_str(), "r")), vcf_record(bcf_init())
+    hts_file(vcf_open(vcf_file.c_str(), "r")), vcf_record(bcf_init()), vcf_path(vcf_file)
   {
     SPDLOG_INFO("HTS_VCF: parsing {} header...", vcf_file.c_str());
     if(hts_file == nullptr) {
       throw std::runtime_error("Unable to open file.");
     }
+    HTSThreadPool::get().attach(hts_file);
     SPDLOG_DEBUG("HTS_VCF: can open file, try header");
     vcf_header = vcf_hdr_read(hts_file);
     if(vcf_header == nullptr){
@@ -66,129 +343,337 @@ public:
       (unpack_flt     ? BCF_UN_FLT : 0) |
       (unpack_info    ? BCF_UN_INFO: 0) |
       (unpack_format  ? BCF_UN_FMT : 0);
+
+    for(auto idx = size_t{0}; idx < fmt_keys.size(); ++idx){
+      auto id = bcf_hdr_id2int(vcf_header, BCF_DT_ID, std::string{fmt_keys[idx]}.c_str());
+      fmt_ids[idx] = bcf_hdr_idinfo_exists(vcf_header, BCF_HL_FMT, id) ? id : -1;
+    }
   }
 
   ~HTS_VCF(){
+    reset_region();
+    if(bcf_idx) hts_idx_destroy(bcf_idx);
+    if(tbx_idx) tbx_destroy(tbx_idx);
+    ks_free(&tbx_line);
+    free(gt_buf);
     bcf_hdr_destroy(vcf_header);
     bcf_destroy(vcf_record); 
     vcf_close(hts_file);
   }
 
   /**
-   * @brief Retrieves the FORMAT field from a VCF record.
+   * @brief number of samples in the header
+   */
+  [[nodiscard]] auto n_samples() const {
+    return static_cast<size_t>(bcf_hdr_nsamples(vcf_header));
+  }
+
+  /**
+   * @brief sample names in the header order
+   */
+  [[nodiscard]] auto sample_names() const {
+    auto names = std::vector<std::string>{};
+    for(auto i = size_t{0}; i < n_samples(); ++i){
+      names.emplace_back(vcf_header->samples[i]);
+    }
+    return names;
+  }
+
+  /**
+   * @brief Check if the vcf has a tabix (.tbi) or CSI (.csi) index,
+   * the index is loaded on the first call.
+   * 
+   * @return true if region queries can use the index
+   */
+  bool has_index(){
+    if(!indexed.has_value()){
+      if(hts_get_format(hts_file)->format == htsExactFormat::bcf){
+        bcf_idx = bcf_index_load3(vcf_path.c_str(), nullptr, HTS_IDX_SILENT_FAIL);
+      }else{
+        tbx_idx = tbx_index_load3(vcf_path.c_str(), nullptr, HTS_IDX_SILENT_FAIL);
+      }
+      indexed = (bcf_idx != nullptr or tbx_idx != nullptr);
+      SPDLOG_DEBUG("HTS_VCF: {} index: {}", vcf_path.c_str(), indexed.value());
+    }
+    return indexed.value();
+  }
+
+  /**
+   * @brief Sequence names of the index, in the order of the index: the order they first appear
+   * in the file for tabix, the header contig order for BCF (the order of a sorted BCF).
+   * Empty if the file has no index.
+   */
+  std::vector<std::string> index_seqnames(){
+    auto names = std::vector<std::string>{};
+    if(!has_index()){
+      return names;
+    }
+    auto n = 0;
+    auto seqs = tbx_idx ?
+      tbx_seqnames(tbx_idx, &n) :
+      bcf_index_seqnames(bcf_idx, vcf_header, &n);
+    for(auto i = 0; i < n; ++i){
+      names.emplace_back(seqs[i]);
+    }
+    free(seqs);
+    return names;
+  }
+
+  /**
+   * @brief Restrict the following `parse_line` calls to a region.
+   * 
+   * With an index, htslib region iterator is used so only the bytes of the region are decoded.
+   * Otherwise, it falls back to a sequential scan from the start of the file (it is reopened)
+   * which skips the records outside the region.
+   * Both "chr1" and "1" naming are tried for the chromosome.
+   * 
+   * @param chr chromosome name
+   * @param beg 1-based start position (inclusive)
+   * @param end 1-based end position (inclusive), default to the end of chromosome
+   * @return false if the chromosome is not in the index (parse_line will return VCF_EOF)
+   */
+  bool query(std::string_view chr, hts_pos_t beg, hts_pos_t end = std::numeric_limits<int32_t>::max()){
+    reset_region();
+    auto names = chr_aliases(chr);
+    if(!has_index()){
+      rewind();
+      region_filter = RegionFilter{std::move(names), beg - 1, end};
+      return true;
+    }
+    for(auto& name : names){
+      auto region = fmt::format("{}:{}-{}", name, beg, end);
+      region_itr = tbx_idx ?
+        tbx_itr_querys(tbx_idx, region.c_str()) :
+        bcf_itr_querys(bcf_idx, vcf_header, region.c_str());
+      if(region_itr) return true;
+    }
+    region_empty = true;
+    return false;
+  }
+
+  /**
+   * @brief Restrict the following `parse_line` calls to a region string,
+   * e.g. "chr1" or "chr1:10000-20000" (1-based, inclusive)
+   * 
+   * @param region 
+   * @return false if the chromosome is not in the index or the region string is malformed
+   */
+  bool query(std::string_view region){
+    auto colon = region.rfind(':');
+    if(colon == std::string_view::npos){
+      return query(region, 1);
+    }
+    auto range = region.substr(colon + 1);
+    auto dash = range.find('-');
+    auto beg = hts_pos_t{1}, end = hts_pos_t{std::numeric_limits<int32_t>::max()};
+    auto beg_str = range.substr(0, dash);
+    if(std::from_chars(beg_str.data(), beg_str.data() + beg_str.size(), beg).ec != std::errc{}){
+      SPDLOG_ERROR("HTS_VCF: malformed region '{}'", region);
+      return false;
+    }
+    if(dash != std::string_view::npos){
+      auto end_str = range.substr(dash + 1);
+      if(std::from_chars(end_str.data(), end_str.data() + end_str.size(), end).ec != std::errc{}){
+        SPDLOG_ERROR("HTS_VCF: malformed region '{}'", region);
+        return false;
+      }
+    }
+    return query(region.substr(0, colon), beg, end);
+  }
+
+  /**
+   * @brief Retrieves the FORMAT field of a sample from a VCF record.
    *
-   * This function uses the HTSlib library to parse the FORMAT field of a VCF record.
-   * It then constructs a string representation of the FORMAT field by joining the field values with colons.
-   * If the FORMAT field cannot be parsed, the function returns a string of all emtpy format.
+   * The values are read from the binary record (by the header ids resolved in constructor),
+   * and formatted as the VCF text would be, e.g. missing value as '.' and phased GT as "0|1".
+   * A key not in the FORMAT of this record is left empty.
+   * If the record has no SAMPLE column, the function returns a string of all emtpy format.
    *
+   * @param sample_idx index of the sample column
    * @return A string representation of the FORMAT field, order is "GT:AD:DP:GQ:PL"
    */
-  inline auto get_fmt() {
-    using namespace std::literals;
-    static constexpr auto fmt_keys = Attr::make_sv_array("GT","AD","DP","GQ","PL");
-    static constexpr auto colon_delimiter = Attr::delimiter(':');
-    static const auto empty_ret = "::::"s;
-    kstring_t str = KS_INITIALIZE;
-    auto vcf_line = ""sv;
-    if(vcf_format1(vcf_header, vcf_record, &str) != 0){
-      ks_free(&str);
-      return empty_ret;
-    }else{
-      vcf_line = {str.s, str.l - 1}; // ignore '\n'
-    }
-
-    for(int i = 0; i < 8; ++i){
-      vcf_line.remove_prefix(vcf_line.find('\t') + 1);
-    } // assert atleast 8 cols (to INFO) in a line
-    
-    auto pos = vcf_line.find('\t');
-    if(pos == std::string_view::npos){ // no SAMPLE col. FORMAT col is already the last col
-      ks_free(&str);
-      return empty_ret;
+  inline auto get_fmt(size_t sample_idx = 0) {
+    auto ret = std::string{};
+    if(!(unpack_flg&BCF_UN_FMT)){
+      bcf_unpack(vcf_record, BCF_UN_FMT);
     }
-
-    auto fmt_idx = Attr::make_header_index(vcf_line.substr(0, pos), colon_delimiter);
-    vcf_line.remove_prefix(pos + 1);
-    auto cols = std::vector<std::string>{};
-    boost::split(cols, vcf_line, colon_delimiter);
-    
-    ks_free(&str);
-    return fmt::format("{}",
-      fmt::join(fmt_keys |
-        std::views::transform([&](auto key){
-          auto it = fmt_idx.find(key);
-          return it != fmt_idx.end() ?
-            cols[it->second] :
-            ""s;
-        }),
-      ":"));
+    if(sample_idx >= vcf_record->n_sample){
+      ret.assign(fmt_keys.size() - 1, ':');
+      return ret;
+    }
+    for(auto idx = size_t{0}; idx < fmt_keys.size(); ++idx){
+      if(idx != 0){
+        ret += ':';
+      }
+      if(fmt_ids[idx] < 0){
+        continue;
+      }
+      if(auto fmt = bcf_get_fmt_id(vcf_record, fmt_ids[idx]); fmt != nullptr){
+        append_fmt_values(ret, *fmt, sample_idx, idx == 0);
+      }
+    }
+    return ret;
   }
 
   /**
-   * @brief parse a vcf record and return the status of parser 
+   * @brief parse a vcf record into `view` without copying its strings,
+   * `record` is not updated
    * 
    * @return HTS_VCF::VCF_Status 
    */
-  auto parse_line(){
-    SPDLOG_DEBUG("HTS_VCF: start parse_line");
-    if(auto ret = bcf_read(hts_file, vcf_header, vcf_record); ret != 0){
+  auto parse_view(){
+    SPDLOG_DEBUG("HTS_VCF: start parse_view");
+    if(auto ret = read_record(); ret != 0){
       if(ret == -1)
         return VCF_Status::VCF_EOF;
       else // ret < -1
         return VCF_Status::READ_RECORD_FAILED;
     }
-    SPDLOG_DEBUG("HTS_VCF: parse_line try unpack record");
+    SPDLOG_DEBUG("HTS_VCF: parse_view try unpack record");
     if(bcf_unpack(vcf_record, unpack_flg) != 0)
       return VCF_Status::UNPACK_FAILED;
     SPDLOG_DEBUG("HTS_VCF: can unpack");
-    int *gt = nullptr;
-    int n = 0;
-    record = {};
-    record.chr = std::string{bcf_hdr_id2name(vcf_header, vcf_record->rid)};
-    record.pos = vcf_record->pos + 1; // htslib vcf pos is 0 based!!
-    record.ref = std::string{vcf_record->d.allele[0]};
+    view = {};
+    view.chr_idx = chr_idx_of(vcf_record->rid);
+    view.chr = bcf_hdr_id2name(vcf_header, vcf_record->rid);
+    view.pos0 = vcf_record->pos; // htslib vcf pos is 0 based!!
+    view.alleles = vcf_record->d.allele;
+    view.n_allele = vcf_record->n_allele;
+    view.ref = vcf_record->d.allele[0];
     
-    // FIXME: doesnot consider about multiple sample vcf
     if(unpack_flg&BCF_UN_STR){ // parse alt allele
-      auto n_al = vcf_record->n_allele;
-      if(n_al > 2){
-        for(int i = 2; i < n_al; ++i){
-          record.other_alt.emplace_back(vcf_record->d.allele[i]);
-        }
-      }else if (n_al < 2){
+      if(view.n_allele < 2){
         return VCF_Status::RECORD_NO_ALT;
       }
-      record.alt = std::string{vcf_record->d.allele[1]};
+      view.alt = vcf_record->d.allele[1];
     }
     if(unpack_flg&BCF_UN_FMT){
-      bcf_get_genotypes(vcf_header, vcf_record, &gt, &n);
-      int pause;
-      if(n > 2){ // which is not a normal situation
-        std::string fmt = this->get_fmt();
-        SPDLOG_CRITICAL("vcf fmt of this record = {}", fmt);
-        SPDLOG_CRITICAL("vcf record chr: {}, pos: {}, ref: {}, alt: {}",
-          record.chr, record.pos, record.ref, record.alt); 
-        std::cin >> pause;
-      }
-      // assert(n <= 2); // FIXME: assume one sample
-      if(n == 0){ // no GT infomation
-        record.genotype = {-1, -1};
-      }
-      else{
-        // ex. in htslib parse 1/1 as {4,4}, 1/0 as {4,2}, 1/. as {4,0}
-        // TODO: currently we don't take the phased information ('cause we don't have it)
-        for(int i = 0; i < n; ++i){
-          if(gt[i] == 0)
-            record.genotype[i] = -1;
-          else{
-            record.genotype[i] = (gt[i] >> 1) - 1;
-          }
-        }
+      decode_genotypes();
+      view.sample_genotypes = genotype_buf;
+      view.genotype = genotype_buf.front();
+    }
+    return VCF_Status::OK;
+  }
+
+  /**
+   * @brief parse a vcf record and return the status of parser 
+   * 
+   * @return HTS_VCF::VCF_Status 
+   */
+  auto parse_line(){
+    auto status = parse_view();
+    if(status != VCF_Status::OK and status != VCF_Status::RECORD_NO_ALT){
+      return status;
+    }
+    // keep the capacity of the per sample genotypes between records
+    auto sample_genotypes = std::move(record.sample_genotypes);
+    record = {};
+    record.chr = std::string{view.chr};
+    record.pos = view.pos();
+    record.ref = std::string{view.ref};
+    if(status == VCF_Status::RECORD_NO_ALT){
+      return status;
+    }
+    
+    if(unpack_flg&BCF_UN_STR){ // parse alt allele
+      for(int i = 2; i < view.n_allele; ++i){
+        record.other_alt.emplace_back(view.allele(i));
       }
+      record.alt = std::string{view.alt};
+    }
+    sample_genotypes.assign(view.sample_genotypes.begin(), view.sample_genotypes.end());
+    if(unpack_flg&BCF_UN_FMT){
+      record.genotype = view.genotype;
     }
+    record.sample_genotypes = std::move(sample_genotypes);
     return VCF_Status::OK;
   }
 
+  /**
+   * @brief Resolve an INFO tag to its header id, resolve it once and use the id for each record
+   * 
+   * @param key 
+   * @return the id, or -1 if the tag is not defined in the header
+   */
+  inline int info2id(const char* key) const {
+    auto id = bcf_hdr_id2int(vcf_header, BCF_DT_ID, key);
+    return bcf_hdr_idinfo_exists(vcf_header, BCF_HL_INFO, id) ? id : -1;
+  }
+
+  /**
+   * @brief get integer info by header id (the first value if it has many)
+   * 
+   * @param id see `info2id`
+   * @return std::optional<int64_t>, nullopt if the tag is absent or missing ('.')
+   */
+  inline std::optional<int64_t> info_int(int id){
+    auto info = get_info(id);
+    if(info == nullptr or info->len < 1){
+      return std::nullopt;
+    }
+    auto value = int64_t{};
+    switch(info->type){
+      case BCF_BT_INT8:
+        value = first_info_value<int8_t>(*info);
+        if(value == bcf_int8_missing) return std::nullopt;
+        break;
+      case BCF_BT_INT16:
+        value = first_info_value<int16_t>(*info);
+        if(value == bcf_int16_missing) return std::nullopt;
+        break;
+      case BCF_BT_INT32:
+        value = first_info_value<int32_t>(*info);
+        if(value == bcf_int32_missing) return std::nullopt;
+        break;
+      case BCF_BT_INT64: // only from vcf text with large values
+        value = first_info_value<int64_t>(*info);
+        if(value == bcf_int64_missing) return std::nullopt;
+        break;
+      default:
+        return std::nullopt;
+    }
+    return value;
+  }
+
+  /**
+   * @brief get floating point info by header id (the first value if it has many)
+   * 
+   * @param id see `info2id`
+   * @return std::optional<float>, nullopt if the tag is absent or missing ('.')
+   */
+  inline std::optional<float> info_float(int id){
+    auto info = get_info(id);
+    if(info == nullptr or info->len < 1 or info->type != BCF_BT_FLOAT){
+      return std::nullopt;
+    }
+    auto value = first_info_value<float>(*info);
+    if(bcf_float_is_missing(value)){
+      return std::nullopt;
+    }
+    return value;
+  }
+
+  /**
+   * @brief get string info by header id without copying
+   * 
+   * @param id see `info2id`
+   * @return std::optional<std::string_view>, valid until the next record is parsed,
+   * std::nullopt for a missing ('.') value as for the numeric infos
+   */
+  inline std::optional<std::string_view> info_view(int id){
+    auto info = get_info(id);
+    if(info == nullptr or info->type != BCF_BT_CHAR){
+      return std::nullopt;
+    }
+    auto str = std::string_view{reinterpret_cast<const char*>(info->vptr), info->vptr_len};
+    // strings may be padded by '\0'
+    str = str.substr(0, str.find('\0'));
+    if(str == "." or (str.size() == 1 and str.front() == bcf_str_missing)){
+      return std::nullopt;
+    }
+    return str;
+  }
+
   /**
    * @brief get integer info by key
    * 
@@ -196,15 +681,7 @@ public:
    * @return std::optional<int64_t>
    */
   inline auto info_int(const char* key){
-    int64_t *val = nullptr;
-    int n = 0;
-    auto status_code = bcf_get_info_int64(vcf_header, vcf_record, key, &val, &n);
-    if(status_code < 0){ // failed
-      return std::optional<int64_t>(std::nullopt);
-    }
-    auto ret = val[0];
-    if(val) free(val);
-    return std::optional<int64_t>(ret);
+    return info_int(info2id(key));
   }
 
   /**
@@ -214,15 +691,7 @@ public:
    * @return std::optional<float> 
    */
   inline auto info_float(const char* key){
-    float *val = nullptr;
-    int n = 0;
-    auto status_code = bcf_get_info_float(vcf_header, vcf_record, key, &val, &n);
-    if(status_code < 0){ // failed
-      return std::optional<float>(std::nullopt);
-    }
-    auto ret = val[0];
-    if(val) free(val);
-    return std::optional<float>(ret);
+    return info_float(info2id(key));
   }
 
   /**
@@ -232,15 +701,10 @@ public:
    * @return std::optional<std::string>
    */
   inline auto info_str(const char* key){
-    char *val = nullptr;
-    int n = 0;
-    auto status_code = bcf_get_info_string(vcf_header, vcf_record, key, &val, &n);
-    if(status_code < 0){
-      return std::optional<std::string>(std::nullopt);
-    }
-    auto&& ret = std::string{val};
-    if(val) free(val);
-    return std::optional<std::string>(std::forward<std::string>(ret));
+    auto str = info_view(info2id(key));
+    return str.has_value() ?
+      std::optional<std::string>{std::string{*str}} :
+      std::optional<std::string>{std::nullopt};
   }
 
   /**
@@ -280,6 +744,28 @@ public:
     return std::string{hrec->vals[desc_idx]};
   }
 
+  /**
+   * @brief Length of a contig in the header (##contig=<ID=...,length=...>),
+   * both "chr1" and "1" naming are tried
+   * @return std::nullopt if the contig or its length is not in the header
+   */
+  [[nodiscard]] std::optional<hts_pos_t> contig_length(std::string_view chr) const {
+    for(auto& name : chr_aliases(chr)){
+      auto hrec = bcf_hdr_get_hrec(vcf_header, BCF_HL_CTG, "ID", name.c_str(), nullptr);
+      if(!hrec) continue;
+      auto length_idx = bcf_hrec_find_key(hrec, "length");
+      auto length = hts_pos_t{0};
+      if(length_idx >= 0){
+        auto value = std::string_view{hrec->vals[length_idx]};
+        if(std::from_chars(value.data(), value.data() + value.size(), length).ec == std::errc{}
+          and length > 0){
+          return length;
+        }
+      }
+    }
+    return std::nullopt;
+  }
+
   /**
    * @brief Get the value of a generic VCF header field.
    * @param header_name The name of the header field.
@@ -306,7 +792,7 @@ public:
   }
 
   inline void print() const {
-    fmt::print("{}\t{}\t'{}'\t'{}'\tGT={}/{}\n", record.chr, record.pos, record.ref, record.alt, record.genotype[0], record.genotype[1]);
+    fmt::print("{}\t{}\t'{}'\t'{}'\tGT={}/{}\n", view.chr, view.pos(), view.ref, view.alt, view.genotype[0], view.genotype[1]);
   }
 
   /**
@@ -417,7 +903,7 @@ public:
     load_archive_from(*this, file_name);
   }
   void save(const Path& file_name) override {
-    save_archive_to(*this, file_name);
+    save_flat_to(*this, file_name);
   }
 
   VCF* find(const std::string& chr0, size_t pos0, const std::string& ref0, const std::string& alt0) {
@@ -1,17 +1,40 @@
 #pragma once
 
+#include <array>
 #include <ranges>
 #include <iostream>
 #include <vector>
 #include <map>
 #include <string>
 #include <optional>
+#include <span>
+#include <limits>
+#include <list>
+#include <memory>
+#include <stdexcept>
+#include <charconv>
+#include <cerrno>
+#include <cstring>
+#include <tuple>
+#include <csignal>
+#include <thread>
+#include <utility>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/file.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
 #include <boost/algorithm/string/split.hpp>
 #include <Sherloc/Attr/utils.hpp>
 #include <Sherloc/Attr/allele.hpp>
 #include <Sherloc/variant.hpp>
 #include <Sherloc/DB/vcf.hpp>
 #include <Sherloc/DB/db.hpp>
+#include <Sherloc/DB/batch.hpp>
+#include <Sherloc/DB/interned.hpp>
 #include <Sherloc/sherloc_member.hpp>
 #include <spdlog/spdlog.h>
 #include <nlohmann/json.hpp>
@@ -23,22 +46,188 @@ using Path = std::filesystem::path;
 class VEP : BaseDB {
 public:
     struct Table;
+    struct BlockWriter;
 
     using PosType = u_int32_t;
     using IndexType = size_t;
-    using CacheType = std::map<size_t, Table>;
+    using CacheType = std::map<size_t, BlockWriter>;
+    using TablesType = std::map<size_t, Table>; // unsorted rows of each chromosome
+    using TablePtr = std::shared_ptr<const Table>;
+
+    /**
+     * @brief The `Variant`s of the cached records, parsed when the cache is built
+     *
+     * One row per transcript, `record_ends` splits the rows into records. The scores are
+     * stored typed, the strings and consequence terms as ids of `strings`, so a cache hit
+     * only copies them into `Variant`s.
+     */
+    struct ParsedVariants{
+        using IdType = InternedStrings::IdType;
+
+        // bits of `flags`
+        static constexpr uint8_t feature_strand   = 1;
+        static constexpr uint8_t sift             = 2;
+        static constexpr uint8_t poly             = 4;
+        static constexpr uint8_t mes_empty        = 8;
+        static constexpr uint8_t mes              = 16;
+        static constexpr uint8_t might_escape_nmd = 32;
+        static constexpr uint8_t has_sub_feat     = 64;
+        static constexpr uint8_t sub_feat_is_exon = 128;
+
+        // the string members stored per row, in `string_ids`
+        static constexpr auto string_members = std::array{
+            &Variant::gene_name, &Variant::gene, &Variant::trans,
+            &Variant::hgvsc, &Variant::hgvsp, &Variant::hgvsg, &Variant::codon
+        };
+
+        FlatArray<uint64_t> record_ends;
+        FlatArray<uint8_t> flags;
+        FlatArray<double> mes_scores;
+        FlatArray<double> plis;
+        FlatArray<double> revel_scores;
+        FlatArray<double> cadd_phred_scores;
+        FlatArray<uint64_t> cds_positions;
+        FlatArray<uint64_t> aa_positions;
+        FlatArray<uint32_t> sub_feat_idxs;
+        FlatArray<uint32_t> sub_feat_totals;
+        FlatArray<IdType> string_ids;     // `string_members.size()` per row
+        FlatArray<IdType> extra_info_ids; // `Variant::extra_info_cols.size()` per row
+        FlatArray<uint64_t> type_ends;    // the consequences of row `i` are `type_ids[type_ends[i-1], type_ends[i])`
+        FlatArray<IdType> type_ids;
+        InternedStrings strings;
+
+        HOLMES_SERIALIZE(ar, version){
+            ar & record_ends;
+            ar & flags;
+            ar & mes_scores;
+            ar & plis;
+            ar & revel_scores;
+            ar & cadd_phred_scores;
+            ar & cds_positions;
+            ar & aa_positions;
+            ar & sub_feat_idxs;
+            ar & sub_feat_totals;
+            ar & string_ids;
+            ar & extra_info_ids;
+            ar & type_ends;
+            ar & type_ids;
+            ar & strings;
+        }
+
+        /**
+         * @brief Number of records
+         */
+        [[nodiscard]] size_t size() const { return record_ends.size(); }
+        [[nodiscard]] bool empty() const { return record_ends.empty(); }
+
+        /**
+         * @brief Appends the variants of one record
+         */
+        void push_back(std::span<const Variant> variants){
+            for(auto& variant : variants){
+                flags.push_back(static_cast<uint8_t>(
+                    (variant.feature_strand   ? feature_strand   : 0) |
+                    (variant.sift             ? sift             : 0) |
+                    (variant.poly             ? poly             : 0) |
+                    (variant.mes_empty        ? mes_empty        : 0) |
+                    (variant.mes              ? mes              : 0) |
+                    (variant.might_escape_nmd ? might_escape_nmd : 0) |
+                    (variant.sub_feat.has     ? has_sub_feat     : 0) |
+                    (variant.sub_feat.is_exon ? sub_feat_is_exon : 0)));
+                mes_scores.push_back(variant.mes_score);
+                plis.push_back(variant.pli);
+                revel_scores.push_back(variant.revel_score);
+                cadd_phred_scores.push_back(variant.cadd_phred_score);
+                cds_positions.push_back(variant.cds_pos);
+                aa_positions.push_back(variant.aa_pos);
+                sub_feat_idxs.push_back(variant.sub_feat.idx);
+                sub_feat_totals.push_back(variant.sub_feat.total);
+                for(auto member : string_members){
+                    string_ids.push_back(strings.intern(variant.*member));
+                }
+                for(auto& col : Variant::extra_info_cols){
+                    auto it = variant.extra_info.find(col);
+                    extra_info_ids.push_back(
+                        strings.intern(it != variant.extra_info.end() ? it->second : ""));
+                }
+                for(auto& term : variant.type){
+                    type_ids.push_back(strings.intern(term));
+                }
+                type_ends.push_back(type_ids.size());
+            }
+            record_ends.push_back(flags.size());
+        }
+
+        /**
+         * @brief The variants of record `idx`, as `Variant::make_variants` parsed them
+         */
+        [[nodiscard]] auto variants(size_t idx) const {
+            auto first = idx == 0 ? 0 : record_ends[idx - 1];
+            auto last = record_ends[idx];
+
+            auto ret = std::vector<Variant>(last - first);
+            for(auto row = first; row != last; ++row){
+                auto& variant = ret[row - first];
+                auto row_flags = flags[row];
+                variant.feature_strand   = row_flags & feature_strand;
+                variant.sift             = row_flags & sift;
+                variant.poly             = row_flags & poly;
+                variant.mes_empty        = row_flags & mes_empty;
+                variant.mes              = row_flags & mes;
+                variant.might_escape_nmd = row_flags & might_escape_nmd;
+                variant.sub_feat.has     = row_flags & has_sub_feat;
+                variant.sub_feat.is_exon = row_flags & sub_feat_is_exon;
+                variant.sub_feat.idx     = sub_feat_idxs[row];
+                variant.sub_feat.total   = sub_feat_totals[row];
+                variant.mes_score        = mes_scores[row];
+                variant.pli              = plis[row];
+                variant.revel_score      = revel_scores[row];
+                variant.cadd_phred_score = cadd_phred_scores[row];
+                variant.cds_pos          = cds_positions[row];
+                variant.aa_pos           = aa_positions[row];
+
+                auto ids = string_ids.begin() + row * string_members.size();
+                for(auto member : string_members){
+                    variant.*member = strings[*ids++];
+                }
+                ids = extra_info_ids.begin() + row * Variant::extra_info_cols.size();
+                for(auto& col : Variant::extra_info_cols){
+                    variant.extra_info.emplace(col, strings[*ids++]);
+                }
+                auto type_first = row == 0 ? 0 : type_ends[row - 1];
+                for(auto i = type_first; i != type_ends[row]; ++i){
+                    variant.type.emplace_back(strings[type_ids[i]]);
+                }
+            }
+            return ret;
+        }
+
+        [[nodiscard]] size_t bytes() const {
+            return record_ends.size() * sizeof(uint64_t)
+                + flags.size() * sizeof(uint8_t)
+                + (mes_scores.size() + plis.size() + revel_scores.size() + cadd_phred_scores.size()) * sizeof(double)
+                + (cds_positions.size() + aa_positions.size() + type_ends.size()) * sizeof(uint64_t)
+                + (sub_feat_idxs.size() + sub_feat_totals.size()) * sizeof(uint32_t)
+                + (string_ids.size() + extra_info_ids.size() + type_ids.size()) * sizeof(IdType)
+                + strings.bytes();
+        }
+    };
 
     struct Table{
-        std::vector<PosType> positions;
-        std::vector<std::string> refs;
-        std::vector<std::string> alts;
-        std::vector<std::string> records;
+        FlatArray<PosType> positions;
+        FlatStrings refs;
+        FlatStrings alts;
+        FlatStrings records;
+        ParsedVariants variants; // empty unless the cache is built with the parsed variants
 
         HOLMES_SERIALIZE(ar, version){
             ar & positions;
             ar & refs;
             ar & alts;
             ar & records;
+            if(version > 0){
+                ar & variants;
+            }
         }
 
         Table() = default;
@@ -62,6 +251,114 @@ public:
         [[nodiscard]] auto is_sorted() const {
             return std::ranges::is_sorted(positions);
         }
+
+        [[nodiscard]] size_t size() const { return positions.size(); }
+
+        [[nodiscard]] size_t bytes() const {
+            return positions.size() * sizeof(PosType)
+                + refs.bytes() + alts.bytes() + records.bytes() + variants.bytes();
+        }
+    };
+
+    /**
+     * @brief The cache of one chromosome as position sorted blocks of rows, each a `Table`
+     * compressed on its own
+     *
+     * The first / last positions of the blocks are the index, a lookup decompresses only
+     * the block that may hold the position. An allele position never spans two blocks.
+     */
+    struct BlockedTable{
+        FlatArray<PosType> first_positions;
+        FlatArray<PosType> last_positions;
+        FlatArray<uint64_t> block_ends; // block `i` is `blocks[block_ends[i-1], block_ends[i])`
+        FlatArray<char> blocks;
+
+        HOLMES_SERIALIZE(ar, version){
+            ar & first_positions;
+            ar & last_positions;
+            ar & block_ends;
+            ar & blocks;
+        }
+
+        [[nodiscard]] size_t size() const { return block_ends.size(); }
+        [[nodiscard]] bool empty() const { return block_ends.empty(); }
+
+        /**
+         * @brief Compresses and appends a block, it should be sorted and after the last block
+         */
+        void push_back(const Table& block){
+            if(block.size() == 0){
+                return;
+            }
+            if(!block.is_sorted() or (!empty() and block.positions[0] <= last_positions.back())){
+                throw std::invalid_argument("VEP::BlockedTable: the rows are not sorted by position");
+            }
+
+            auto compressed = std::string{};
+            {
+                auto out = bios::filtering_ostream{};
+                out.push(bios::zstd_compressor());
+                out.push(bios::back_inserter(compressed));
+                auto arc = boost::archive::binary_oarchive(out);
+                arc & block;
+            }
+            first_positions.push_back(block.positions[0]);
+            last_positions.push_back(block.positions.back());
+            blocks.append(compressed.data(), compressed.size());
+            block_ends.push_back(blocks.size());
+        }
+
+        [[nodiscard]] auto block(size_t idx) const {
+            auto first = idx == 0 ? 0 : block_ends[idx - 1];
+            auto in = bios::filtering_istream{};
+            in.push(bios::zstd_decompressor());
+            in.push(bios::array_source(blocks.data() + first, block_ends[idx] - first));
+
+            auto table = Table{};
+            auto arc = boost::archive::binary_iarchive(in);
+            arc & table;
+            return table;
+        }
+
+        /**
+         * @brief Index of the block whose position range holds `pos`
+         */
+        [[nodiscard]] auto find_block(PosType pos) const -> std::optional<size_t> {
+            auto it = std::ranges::upper_bound(first_positions, pos);
+            if(it == first_positions.begin()){
+                return std::nullopt;
+            }
+            size_t idx = std::distance(first_positions.begin(), it) - 1;
+            if(last_positions[idx] < pos){
+                return std::nullopt;
+            }
+            return idx;
+        }
+    };
+
+    /**
+     * @brief Cuts the rows of a chromosome into the blocks of a `BlockedTable` while parsing
+     */
+    struct BlockWriter{
+        BlockedTable table;
+        Table pending;
+        size_t block_rows;
+
+        BlockWriter(size_t block_rows): pending(block_rows), block_rows(block_rows) {}
+
+        template<class Str>
+        void add_row(const HTS_VCF::VCF_Record& allele, Str&& record){
+            // never cut between the alleles of one position
+            if(pending.size() >= block_rows and allele.pos != pending.positions.back()){
+                flush();
+            }
+            pending.add_row(allele, std::forward<Str>(record));
+        }
+
+        void flush(){
+            table.push_back(pending);
+            pending = Table(block_rows);
+        }
     };
 
     struct CacheMeta{
@@ -70,25 +367,319 @@ public:
             ar & meta;
         }
     };
+
+    /**
+     * @brief LRU cache of the decoded blocks of the current chromosome, keyed by
+     * (segment, block index) and bounded by their bytes
+     *
+     * The most recently used block is never evicted, an evicted block stays valid for the
+     * holders of its pointer.
+     */
+    class BlockCache {
+    public:
+        using Key = std::pair<size_t, size_t>;
+
+    private:
+        struct Entry {
+            TablePtr table;
+            std::list<Key>::iterator lru_it;
+        };
+        size_t budget;
+        size_t used = 0;
+        std::list<Key> lru; // front is the most recently used
+        std::map<Key, Entry> entries;
+
+    public:
+        static constexpr size_t default_budget = size_t{256} << 20; // 256 MiB
+
+        BlockCache(size_t budget = default_budget): budget(budget) {}
+
+        void set_budget(size_t bytes){ budget = bytes; }
+        [[nodiscard]] auto bytes_used() const { return used; }
+        [[nodiscard]] auto size() const { return entries.size(); }
+
+        void clear(){
+            entries.clear();
+            lru.clear();
+            used = 0;
+        }
+
+        TablePtr get(const BlockedTable& blocked, const Key& key){
+            if(auto it = entries.find(key); it != entries.end()){
+                lru.splice(lru.begin(), lru, it->second.lru_it);
+                return it->second.table;
+            }
+            auto table = std::make_shared<const Table>(blocked.block(key.second));
+            lru.push_front(key);
+            entries.emplace(key, Entry{table, lru.begin()});
+            used += table->bytes();
+            while(used > budget and lru.size() > 1){
+                auto victim = entries.find(lru.back());
+                used -= victim->second.table->bytes();
+                entries.erase(victim);
+                lru.pop_back();
+            }
+            return table;
+        }
+    };
+
+    /**
+     * @brief `flock` on the lock file of a cache directory, released on destruction
+     *
+     * Writers (write-back, compaction) hold it exclusively, readers hold it shared while
+     * loading the files of a chromosome. A cache never written back has no lock file and
+     * is read without the lock.
+     */
+    class DirLock {
+    private:
+        int fd = -1;
+
+    public:
+        DirLock(const Path& dir, bool exclusive){
+            auto file = dir / lock_filename;
+            fd = exclusive ?
+                ::open(file.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0664) :
+                ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+            if(fd < 0){
+                if(exclusive){
+                    throw std::runtime_error(fmt::format(
+                        "VEP: can't open the lock file '{}': {}", file.c_str(), std::strerror(errno)));
+                }
+                return;
+            }
+            while(::flock(fd, exclusive ? LOCK_EX : LOCK_SH) != 0){
+                if(errno != EINTR){
+                    auto err = errno;
+                    ::close(fd);
+                    throw std::runtime_error(fmt::format(
+                        "VEP: can't lock '{}': {}", file.c_str(), std::strerror(err)));
+                }
+            }
+        }
+
+        DirLock(const DirLock&) = delete;
+        DirLock& operator=(const DirLock&) = delete;
+
+        ~DirLock(){
+            if(fd >= 0){
+                ::close(fd); // releases the lock
+            }
+        }
+    };
+
+    /**
+     * @brief A row of a decoded table, the unit merged into new blocks
+     */
+    struct RowRef{
+        const Table* table;
+        size_t row;
+    };
+
+    /**
+     * @brief Sorts rows into a `BlockedTable`, an allele found in several rows keeps the
+     * first one. The variants are stored parsed (parsing the rows without them) if
+     * `parse_with` is given.
+     */
+    static auto merge_rows(
+        std::vector<RowRef> rows,
+        size_t block_rows,
+        const Attr::HeaderIndexType* parse_with
+    ){
+        auto key = [](const RowRef& ref){
+            return std::tuple{ref.table->positions[ref.row], ref.table->refs[ref.row], ref.table->alts[ref.row]};
+        };
+        std::ranges::stable_sort(rows, std::less{}, key);
+        auto duplicates = std::ranges::unique(rows, std::equal_to{}, key);
+        rows.erase(duplicates.begin(), duplicates.end());
+
+        auto writer = BlockWriter(block_rows);
+        auto record = HTS_VCF::VCF_Record{};
+        for(auto& [table, row] : rows){
+            record.pos = table->positions[row];
+            record.ref = table->refs[row];
+            record.alt = table->alts[row];
+            auto csq = table->records[row];
+            writer.add_row(record, csq);
+            if(parse_with){
+                writer.pending.variants.push_back(table->variants.empty() ?
+                    Variant::make_variants(*parse_with, csq) :
+                    table->variants.variants(row));
+            }
+        }
+        writer.flush();
+        return std::move(writer.table);
+    }
+
 private:
     Attr::HeaderIndexType header_index;
     CacheMeta cache_meta;
     Path out_dir;
-    Table current_table;
+    TablePtr whole_table; // chromosome cache built before the blocks, loaded whole
+    BlockedTable current_blocks;
+    std::vector<BlockedTable> current_deltas; // segments written back, searched after the base
+    BlockCache block_cache;
+    std::vector<TablePtr> pinned; // blocks the returned views point into
     std::string current_chr = "";
-    static constexpr int reserve_size = 100000;
+    bool store_parsed = false;
+    size_t block_rows = default_block_rows;
     static constexpr std::string_view meta_filename = "meta.arc";
+    static constexpr std::string_view lock_filename = ".lock";
+    static constexpr std::string_view parsed_key = "parsed_variants";
+
+    auto blocks_file(std::string_view normed_chr) const { return out_dir / fmt::format("{}.blocks.arc", normed_chr); }
+    auto whole_file(std::string_view normed_chr) const { return out_dir / fmt::format("{}.arc", normed_chr); }
+    auto delta_file(std::string_view normed_chr, size_t k) const {
+        return out_dir / fmt::format("{}.delta.{}.arc", normed_chr, k);
+    }
+
+    /**
+     * @brief The delta segments (`<chr>.delta.<k>.arc`) of every chromosome, by chromosome then k
+     */
+    auto list_deltas() const {
+        auto ret = std::map<std::string, std::map<size_t, Path>>{};
+        if(!std::filesystem::is_directory(out_dir)){
+            return ret;
+        }
+        constexpr auto infix = std::string_view{".delta."};
+        constexpr auto suffix = std::string_view{".arc"};
+        for(auto& entry : std::filesystem::directory_iterator(out_dir)){
+            auto name = entry.path().filename().string();
+            auto infix_pos = name.find(infix);
+            if(infix_pos == std::string::npos or !name.ends_with(suffix)){
+                continue;
+            }
+            auto k_str = std::string_view{name}.substr(
+                infix_pos + infix.size(), name.size() - infix_pos - infix.size() - suffix.size());
+            size_t k = 0;
+            auto [ptr, ec] = std::from_chars(k_str.data(), k_str.data() + k_str.size(), k);
+            if(ec != std::errc{} or ptr != k_str.data() + k_str.size()){
+                continue;
+            }
+            ret[name.substr(0, infix_pos)].emplace(k, entry.path());
+        }
+        return ret;
+    }
+
+    /**
+     * @brief If the cache stores the parsed variants. The meta of a cache built before
+     * `parsed_key` has no such key, it's parsed if its base blocks carry the variants.
+     */
+    [[nodiscard]] auto is_parsed() const {
+        if(auto it = cache_meta.meta.find(std::string{parsed_key}); it != cache_meta.meta.end()){
+            return it->second == "true";
+        }
+        if(!std::filesystem::is_directory(out_dir)){
+            return false;
+        }
+        for(auto& entry : std::filesystem::directory_iterator(out_dir)){
+            if(!entry.path().filename().string().ends_with(".blocks.arc")){
+                continue;
+            }
+            auto blocked = BlockedTable{};
+            load_archive_from(blocked, entry.path());
+            if(!blocked.empty()){
+                return !blocked.block(0).variants.empty();
+            }
+        }
+        return false;
+    }
+
+    /**
+     * @brief Drops the loaded chromosome
+     */
+    void unload(){
+        current_chr = "";
+        whole_table.reset();
+        current_blocks = BlockedTable{};
+        current_deltas.clear();
+        block_cache.clear();
+        pinned.clear();
+    }
+
+    static void save_atomic(const BlockedTable& table, const Path& file){
+        auto tmp_file = Path{file.string() + ".tmp"};
+        save_flat_to(table, tmp_file);
+        std::filesystem::rename(tmp_file, file);
+    }
 
     auto try_load_chr(const std::string& normed_chr){
         // assume the chr is normalized
-        auto target_chr_file = out_dir / fmt::format("{}.arc", normed_chr);
-        if(!std::filesystem::exists(target_chr_file)){
-            return false;
+        unload();
+        auto lock = DirLock(out_dir, false);
+
+        auto loaded = true;
+        if(std::filesystem::exists(blocks_file(normed_chr))){
+            load_archive_from(current_blocks, blocks_file(normed_chr));
+        }else if(std::filesystem::exists(whole_file(normed_chr))){
+            auto table = std::make_shared<Table>();
+            load_archive_from(*table, whole_file(normed_chr));
+            whole_table = std::move(table);
+        }else{
+            loaded = false;
         }
-        load_archive_from(current_table, target_chr_file);
-        return true;
+
+        auto deltas = list_deltas();
+        if(auto it = deltas.find(normed_chr); it != deltas.end()){
+            for(auto& [k, file] : it->second){
+                load_archive_from(current_deltas.emplace_back(), file);
+            }
+            loaded = true;
+        }
+        if(loaded){
+            current_chr = normed_chr;
+        }
+        return loaded;
+    }
+
+    /**
+     * @brief The table (block) of segment `segment` of the current chromosome that may
+     * hold `pos`, the segment 0 is the base, the others the deltas
+     */
+    auto table_of(size_t segment, PosType pos) -> TablePtr {
+        if(segment == 0 and whole_table){
+            return whole_table;
+        }
+        auto& blocked = segment == 0 ? current_blocks : current_deltas[segment - 1];
+        auto idx = blocked.find_block(pos);
+        if(!idx.has_value()){
+            return nullptr;
+        }
+        return block_cache.get(blocked, {segment, *idx});
+    }
+
+    static auto match_row(const Table& table, auto first, auto last, const SherlocMember& sher_mem)
+        -> std::optional<size_t>
+    {
+        for(auto it = first; it != last; ++it){
+            size_t idx = std::distance(table.positions.begin(), it);
+            if(table.refs[idx] == sher_mem.ref and table.alts[idx] == sher_mem.alt){
+                return idx;
+            }
+        }
+        return std::nullopt;
+    }
+
+    /**
+     * @brief `find_row` in the delta segments
+     */
+    auto find_delta_row(const SherlocMember& sher_mem)
+        -> std::optional<std::pair<TablePtr, size_t>>
+    {
+        for(size_t segment = 1; segment <= current_deltas.size(); ++segment){
+            auto table = table_of(segment, sher_mem.pos);
+            if(!table){
+                continue;
+            }
+            auto [s_it, e_it] = std::ranges::equal_range(table->positions, sher_mem.pos);
+            if(auto row = match_row(*table, s_it, e_it, sher_mem)){
+                return std::pair{std::move(table), *row};
+            }
+        }
+        return std::nullopt;
     }
 public:
+    static constexpr size_t default_block_rows = 512;
+
     HOLMES_SERIALIZE(ar, version){
         ar & db_version;
         ar & db_build_time;
@@ -130,11 +721,37 @@ public:
         out_dir = dir;
     }
 
+    /**
+     * @brief Also store the parsed `Variant`s in the built cache, so a cache hit skips
+     * parsing the CSQ string (at the cost of a larger cache)
+     */
+    void set_store_parsed(bool store){
+        store_parsed = store;
+    }
+
+    /**
+     * @brief Number of alleles per compressed block of the built cache
+     */
+    void set_block_rows(size_t rows){
+        if(rows == 0){
+            throw std::invalid_argument("VEP: the blocks should hold at least one row");
+        }
+        block_rows = rows;
+    }
+
+    /**
+     * @brief Memory budget of the decoded blocks kept while querying
+     */
+    void set_block_cache(size_t bytes){
+        block_cache.set_budget(bytes);
+    }
+
     template <class Container>
     static auto parse_vcf_into(
         HTS_VCF& vcf,
         Container& container,
-        int reserved_size = 0 /* this variable is not used if not parsing into cache */
+        size_t block_rows = default_block_rows, /* this variable is not used if not parsing into cache */
+        bool parse_variants = false /* also store the parsed variants into the cache */
     ){
         constexpr auto pipe_delimiter = Attr::delimiter('|');
         HTS_VCF::VCF_Status vcf_status;
@@ -148,6 +765,7 @@ public:
             desc.substr(start_pos, end_pos - start_pos), pipe_delimiter);
 
         // add records
+        auto csq_id = vcf.info2id("CSQ");
         int line = 0;
         while((vcf_status = vcf.parse_line()) != HTS_VCF::VCF_Status::VCF_EOF){
             switch (vcf_status) {
@@ -164,18 +782,26 @@ public:
             if constexpr (std::is_same_v<Container, CacheType>){ // parsing vcf into vep cache
                 auto [it, success] = container.emplace(
                     Attr::ChrMap::chr2idx(vcf.record.chr),
-                    reserved_size);
+                    block_rows);
 
-                it->second.add_row(
+                auto csq = vcf.info_view(csq_id).value_or("");
+                it->second.add_row(vcf.record, csq);
+                if(parse_variants){
+                    it->second.pending.variants.push_back(
+                        Variant::make_variants(vep_header_index, csq));
+                }
+            } else if constexpr (std::is_same_v<Container, TablesType>){ // rows to be written back
+                container[Attr::ChrMap::chr2idx(vcf.record.chr)].add_row(
                     vcf.record,
-                    vcf.info_str("CSQ")
-                       .value_or("")
-                );
+                    vcf.info_view(csq_id).value_or(""));
+            } else if constexpr (requires { container.at(vcf.record.chr, size_t{}); }){ // alleles of several chromosomes
+                container.at(vcf.record.chr, std::stoul(vcf.get_ID())).variants =
+                    Variant::make_variants(vep_header_index, vcf.info_view(csq_id).value_or(""));
             } else { // parsing into sherloc_member vector
                 container.at(std::stoul(vcf.get_ID())).variants = 
                     Variant::make_variants(
                         vep_header_index,
-                        vcf.info_str("CSQ")
+                        vcf.info_view(csq_id)
                            .value_or("") // views::split ranges will have 0 size given an empty string
                     );
             }
@@ -194,29 +820,28 @@ public:
             .get_generic_header_value("VEP")
             .value_or("None");
         CacheType cache;
+        cache_meta.meta[std::string{parsed_key}] = store_parsed ? "true" : "false";
 
-        header_index = parse_vcf_into(vep_vcf, cache, reserve_size);
-
-        // check all chromosome are sorted by position
-        for(auto& [chr, table] : cache){
-            auto chr_str = Attr::ChrMap::idx2chr(chr);
-            if(!table.is_sorted()){
-                SPDLOG_ERROR(
-                    "chr{} is not sorted! pleaset sort the vcf first.",
-                    chr_str);
-                exit(1);
-            }else{
-                SPDLOG_DEBUG("chr{} is sorted.", chr_str);
+        // the blocks are compressed while parsing, so each chromosome has to be sorted by position
+        try{
+            header_index = parse_vcf_into(vep_vcf, cache, block_rows, store_parsed);
+            for(auto& [chr, writer] : cache){
+                writer.flush();
             }
+        }catch(const std::invalid_argument& e){
+            SPDLOG_ERROR("{}! pleaset sort the vcf first.", e.what());
+            exit(1);
         }
 
         // save to out dir
         if(!std::filesystem::exists(out_dir)){
             std::filesystem::create_directories(out_dir);
         }
-        for(auto& [chr, table] : cache){
+        for(auto& [chr, writer] : cache){
             auto chr_str = Attr::ChrMap::idx2chr(chr);
-            save_archive_to(table, out_dir / fmt::format("{}.arc", chr_str));
+            SPDLOG_DEBUG("chr{}: {} blocks, {} bytes.",
+                chr_str, writer.table.size(), writer.table.blocks.size());
+            save_flat_to(writer.table, out_dir / fmt::format("{}.blocks.arc", chr_str));
         }
     }
 
@@ -224,7 +849,7 @@ public:
         set_output_dir(dirname);
         load_archive_from(*this, dirname / meta_filename);
         this->log_metadata("VEPCache");
-        current_chr = ""; // clean the current chr
+        unload(); // clean the current chr
     }
 
     void save(const Path& dirname) override {
@@ -233,50 +858,475 @@ public:
         }
         this->set_build_time();
         this->log_metadata("VEPCache");
-        save_archive_to(*this, dirname / meta_filename);
+        save_flat_to(*this, dirname / meta_filename);
     }
 
-    [[nodiscard]] auto find(const SherlocMember& sher_mem) 
-        -> std::optional<std::vector<std::string>::const_iterator>
+    /**
+     * @brief The table (block) holding the allele and its row, the chromosome is loaded if needed
+     */
+    [[nodiscard]] auto find_row(const SherlocMember& sher_mem)
+        -> std::optional<std::pair<TablePtr, size_t>>
     {
         if(sher_mem.chr != current_chr){
             if(!try_load_chr(sher_mem.chr)){ // can't not load the cache chr
                 return std::nullopt;
             }
-            current_chr = sher_mem.chr;
         }
 
-        auto [s_it, e_it] = std::ranges::equal_range(current_table.positions, sher_mem.pos);
-        if(s_it == e_it){
+        if(auto table = table_of(0, sher_mem.pos)){
+            auto [s_it, e_it] = std::ranges::equal_range(table->positions, sher_mem.pos);
+            if(auto row = match_row(*table, s_it, e_it, sher_mem)){
+                return std::pair{std::move(table), *row};
+            }
+        }
+        return find_delta_row(sher_mem);
+    }
+
+    /**
+     * @brief The cached CSQ string of the allele, valid until the next `find` / `find_batch`
+     */
+    [[nodiscard]] auto find(const SherlocMember& sher_mem) 
+        -> std::optional<std::string_view>
+    {
+        pinned.clear();
+        auto found = find_row(sher_mem);
+        if(!found.has_value()){
             return std::nullopt;
         }
+        auto& [table, row] = *found;
+        pinned.push_back(table);
+        return table->records[row];
+    }
 
-        auto s_idx = std::distance(current_table.positions.begin(), s_it);
-        auto e_idx = std::distance(current_table.positions.begin(), e_it);
+    /**
+     * @brief `find_row` of a batch of alleles of one chromosome, merged with the cache blocks
+     * in one pass (see `GallopCursor`), each overlapped block is decompressed once
+     */
+    [[nodiscard]] auto find_rows_batch(std::span<const SherlocMember> sher_mems)
+        -> std::vector<std::optional<std::pair<TablePtr, size_t>>>
+    {
+        auto ret = std::vector<std::optional<std::pair<TablePtr, size_t>>>(sher_mems.size());
+        if(sher_mems.empty()){
+            return ret;
+        }
+        auto& chr = sher_mems.front().chr;
+        if(!std::ranges::all_of(sher_mems, [&chr](auto& sher_mem){ return sher_mem.chr == chr; })){
+            throw std::invalid_argument("VEP::find_batch: the alleles are not on one chromosome");
+        }
+        if(chr != current_chr){
+            if(!try_load_chr(chr)){ // can't not load the cache chr
+                return ret;
+            }
+        }
 
-        for(auto idx = s_idx; idx != e_idx; ++idx){
-            if(current_table.refs[idx] == sher_mem.ref and current_table.alts[idx] == sher_mem.alt){
-                return current_table.records.cbegin() + idx;
+        auto table = TablePtr{};
+        auto cursor = std::optional<GallopCursor<FlatArray<PosType>::const_iterator>>{};
+        for(size_t idx = 0; idx < sher_mems.size(); ++idx){
+            auto& sher_mem = sher_mems[idx];
+            if(auto block = table_of(0, sher_mem.pos)){
+                if(block != table){
+                    table = std::move(block);
+                    cursor.emplace(table->positions);
+                }
+                auto range = cursor->equal_range(sher_mem.pos);
+                if(auto row = match_row(*table, range.begin(), range.end(), sher_mem)){
+                    ret[idx].emplace(table, *row);
+                    continue;
+                }
+            }
+            if(!current_deltas.empty()){
+                ret[idx] = find_delta_row(sher_mem);
             }
         }
-        return std::nullopt;
+        return ret;
+    }
+
+    /**
+     * @brief `find` of a batch of alleles of one chromosome, see `find_rows_batch`. The views
+     * are valid until the next `find` / `find_batch`.
+     */
+    [[nodiscard]] auto find_batch(std::span<const SherlocMember> sher_mems)
+        -> std::vector<std::optional<std::string_view>>
+    {
+        pinned.clear();
+        auto ret = std::vector<std::optional<std::string_view>>(sher_mems.size());
+        for(size_t idx = 0; auto& found : find_rows_batch(sher_mems)){
+            if(found.has_value()){
+                auto& [table, row] = *found;
+                ret[idx] = table->records[row];
+                if(pinned.empty() or pinned.back() != table){
+                    pinned.push_back(std::move(table));
+                }
+            }
+            ++idx;
+        }
+        return ret;
+    }
+
+    /**
+     * @brief The variants of a cached row, copied if the cache stores them parsed, else parsed
+     * from the CSQ string
+     */
+    [[nodiscard]] auto variants_of(const Table& table, size_t row) const {
+        return table.variants.empty() ?
+            Variant::make_variants(header_index, table.records[row]) :
+            table.variants.variants(row);
     }
     
     /**
      * @brief Tries to find if a SherlocMember allele is in the cache. 
      * If found, they will be inserted into SherlocMember and return true, else return false.
+     * The parsed variants are copied if the cache stores them, else the CSQ string is parsed.
      * 
      * @param sher_mem The SherlocMember object to insert the variant into.
      * @return true If the allele is found in the cache and inserted into SherlocMember.
      * @return false If the allele is not found in the cache.
      */
     auto try_insert_into(SherlocMember& sher_mem) {
-        auto it = find(sher_mem);
-        if(it.has_value()){
-            sher_mem.variants = Variant::make_variants(header_index, *(it.value()));
-            return true;
+        auto found = find_row(sher_mem);
+        if(!found.has_value()){
+            return false;
         }
-        return false;
+        auto& [table, row] = *found;
+        sher_mem.variants = variants_of(*table, row);
+        return true;
+    }
+
+    /**
+     * @brief `try_insert_into` of a batch of alleles of one chromosome, looked up by
+     * `find_rows_batch`. Returns which alleles are found.
+     */
+    auto try_insert_batch(std::span<SherlocMember> sher_mems) {
+        auto hits = std::vector<bool>(sher_mems.size(), false);
+        for(size_t idx = 0; auto& found : find_rows_batch(sher_mems)){
+            if(found.has_value()){
+                auto& [table, row] = *found;
+                sher_mems[idx].variants = variants_of(*table, row);
+                hits[idx] = true;
+            }
+            ++idx;
+        }
+        return hits;
+    }
+
+    /**
+     * @brief Adds the alleles annotated by a VEP run to the cache directory, as one delta
+     * segment (`<chr>.delta.<k>.arc`) per chromosome
+     *
+     * The segments are searched after the base blocks until `compact` folds them in.
+     * Writers of one cache directory are serialized by a `DirLock`. The output is skipped
+     * if its CSQ format differs from the cache.
+     */
+    void write_back(const Path& vep_output){
+        if(out_dir.empty()){
+            SPDLOG_WARN("[vep cache] no cache loaded, nothing written back");
+            return;
+        }
+        HTS_VCF vep_vcf{vep_output, true, false, true, false};
+        auto tables = TablesType{};
+        if(parse_vcf_into(vep_vcf, tables) != header_index){
+            SPDLOG_WARN("[vep cache] the CSQ format of '{}' differs from the cache, not written back",
+                vep_output.c_str());
+            return;
+        }
+        write_back(tables);
+    }
+
+    /**
+     * @brief `write_back` of rows already parsed, in the CSQ format of the cache
+     */
+    void write_back(const TablesType& tables){
+        auto lock = DirLock(out_dir, true);
+        auto parse_with = is_parsed() ? &header_index : nullptr;
+        auto deltas = list_deltas();
+        for(auto& [chr, table] : tables){
+            auto chr_str = Attr::ChrMap::idx2chr(chr);
+            auto rows = std::vector<RowRef>{};
+            for(size_t row = 0; row < table.size(); ++row){
+                rows.push_back({&table, row});
+            }
+            auto& chr_deltas = deltas[std::string{chr_str}];
+            auto k = chr_deltas.empty() ? size_t{0} : chr_deltas.rbegin()->first + 1;
+            save_atomic(merge_rows(std::move(rows), block_rows, parse_with), delta_file(chr_str, k));
+            SPDLOG_INFO("[vep cache] chr{}: {} alleles written back", chr_str, table.size());
+        }
+        unload(); // reload the chromosome with its new segment
+    }
+
+    /**
+     * @brief Folds the delta segments of every chromosome into its base blocks
+     */
+    void compact(){
+        auto lock = DirLock(out_dir, true);
+        auto parse_with = is_parsed() ? &header_index : nullptr; // before any base is rewritten
+        for(auto& [chr_str, files] : list_deltas()){
+            // the rows of the base first, so they are kept over the deltas
+            auto tables = std::vector<Table>{};
+            auto add_blocks = [&tables](const Path& file){
+                auto blocked = BlockedTable{};
+                load_archive_from(blocked, file);
+                for(size_t idx = 0; idx < blocked.size(); ++idx){
+                    tables.emplace_back(blocked.block(idx));
+                }
+            };
+            auto had_whole = false;
+            if(std::filesystem::exists(blocks_file(chr_str))){
+                add_blocks(blocks_file(chr_str));
+            }else if(std::filesystem::exists(whole_file(chr_str))){
+                load_archive_from(tables.emplace_back(), whole_file(chr_str));
+                had_whole = true;
+            }
+            for(auto& [k, file] : files){
+                add_blocks(file);
+            }
+
+            auto rows = std::vector<RowRef>{};
+            for(auto& table : tables){
+                for(size_t row = 0; row < table.size(); ++row){
+                    rows.push_back({&table, row});
+                }
+            }
+            auto merged = merge_rows(std::move(rows), block_rows, parse_with);
+            save_atomic(merged, blocks_file(chr_str));
+            if(had_whole){
+                std::filesystem::remove(whole_file(chr_str));
+            }
+            for(auto& [k, file] : files){
+                std::filesystem::remove(file);
+            }
+            SPDLOG_INFO("[vep cache] chr{}: {} segments folded, {} blocks",
+                chr_str, files.size(), merged.size());
+        }
+        unload();
+    }
+
+    [[nodiscard]] auto block_cache_bytes() const { return block_cache.bytes_used(); }
+};
+
+/**
+ * @brief A VEP pipeline (VEP, then `filter_vep` if any) with the stdin of its first command
+ * and the stdout of its last one connected to pipes
+ *
+ * Each command is run by `/bin/sh` in its own process, connected to the next one by a pipe,
+ * so `wait` sees the status of every command, not only the last. The input VCF is written
+ * with `write` (from another thread than the one reading the output, VEP answers while it
+ * reads) and ended by `close_input`. The output is read by opening `output_path`, e.g. with
+ * `HTS_VCF`. If `copy_file` is given, a thread copies the output into it on the way.
+ */
+class VEPProcess {
+private:
+    std::vector<pid_t> pids;
+    int in_fd = -1;  // write end of the stdin of the first command
+    int out_fd = -1; // read end of the output
+    std::thread copier;
+    std::string copy_error; // set by the copier
+
+    static void close_fd(int& fd){
+        if(fd >= 0){
+            ::close(fd);
+            fd = -1;
+        }
+    }
+
+    static auto make_pipe(){
+        auto fds = std::array<int, 2>{};
+        if(::pipe2(fds.data(), O_CLOEXEC) != 0){
+            throw std::runtime_error(fmt::format("VEPProcess: pipe: {}", std::strerror(errno)));
+        }
+        return fds;
+    }
+
+    static bool write_all(int fd, std::string_view data){
+        while(!data.empty()){
+            auto written = ::write(fd, data.data(), data.size());
+            if(written < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                return false;
+            }
+            data.remove_prefix(written);
+        }
+        return true;
+    }
+
+    static auto spawn_one(const std::string& cmd, int stdin_fd, int stdout_fd){
+        posix_spawn_file_actions_t actions;
+        posix_spawn_file_actions_init(&actions);
+        posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+        posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+        posix_spawnattr_t attr;
+        posix_spawnattr_init(&attr);
+        sigset_t default_signals;
+        sigemptyset(&default_signals);
+        sigaddset(&default_signals, SIGPIPE);
+        posix_spawnattr_setsigdefault(&attr, &default_signals);
+        posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSIGDEF);
+        char sh[] = "/bin/sh";
+        char c_flag[] = "-c";
+        auto cmd_buf = std::vector<char>(cmd.begin(), cmd.end());
+        cmd_buf.push_back('\0');
+        char* argv[] = {sh, c_flag, cmd_buf.data(), nullptr};
+        pid_t pid = -1;
+        auto ret = posix_spawn(&pid, sh, &actions, &attr, argv, environ);
+        posix_spawn_file_actions_destroy(&actions);
+        posix_spawnattr_destroy(&attr);
+        if(ret != 0){
+            throw std::runtime_error(fmt::format("VEPProcess: can't run '{}': {}", cmd, std::strerror(ret)));
+        }
+        return pid;
+    }
+
+    /**
+     * @brief Copies `from` into `file` and `to` until `from` ends, then closes them
+     */
+    void copy_output(int from, int to, int file){
+        auto buffer = std::vector<char>(size_t{1} << 16);
+        while(true){
+            auto got = ::read(from, buffer.data(), buffer.size());
+            if(got < 0 and errno == EINTR){
+                continue;
+            }
+            if(got < 0){
+                copy_error = fmt::format("read: {}", std::strerror(errno));
+                break;
+            }
+            if(got == 0){
+                break;
+            }
+            auto data = std::string_view{buffer.data(), static_cast<size_t>(got)};
+            if(!write_all(file, data)){
+                copy_error = fmt::format("write: {}", std::strerror(errno));
+                break;
+            }
+            if(!write_all(to, data)){ // the reader is gone, the output is not needed
+                break;
+            }
+        }
+        ::close(from); // a command still writing gets SIGPIPE
+        ::close(to);
+        if(::close(file) != 0 and copy_error.empty()){
+            copy_error = fmt::format("close: {}", std::strerror(errno));
+        }
+    }
+
+public:
+    explicit VEPProcess(const std::vector<std::string>& cmds, const Path& copy_file = {}){
+        if(cmds.empty()){
+            throw std::invalid_argument("VEPProcess: no command to run");
+        }
+        // a command exiting early makes `write` fail with EPIPE instead of killing us,
+        // the commands themselves get the default SIGPIPE back (see `spawn_one`)
+        std::signal(SIGPIPE, SIG_IGN);
+
+        auto in_pipe = make_pipe();
+        in_fd = in_pipe[1];
+        auto stdin_fd = in_pipe[0];
+        try{
+            for(auto& cmd : cmds){
+                auto out_pipe = make_pipe();
+                try{
+                    pids.push_back(spawn_one(cmd, stdin_fd, out_pipe[1]));
+                }catch(...){
+                    ::close(out_pipe[0]);
+                    ::close(out_pipe[1]);
+                    throw;
+                }
+                ::close(stdin_fd);
+                ::close(out_pipe[1]);
+                stdin_fd = out_pipe[0];
+            }
+            out_fd = std::exchange(stdin_fd, -1);
+
+            if(!copy_file.empty()){
+                auto file = ::open(copy_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+                if(file < 0){
+                    throw std::runtime_error(fmt::format(
+                        "VEPProcess: can't open '{}': {}", copy_file.c_str(), std::strerror(errno)));
+                }
+                auto copy_pipe = std::array<int, 2>{};
+                try{
+                    copy_pipe = make_pipe();
+                }catch(...){
+                    ::close(file);
+                    throw;
+                }
+                copier = std::thread(&VEPProcess::copy_output, this, out_fd, copy_pipe[1], file);
+                out_fd = copy_pipe[0];
+            }
+        }catch(...){
+            close_fd(stdin_fd);
+            wait();
+            throw;
+        }
+    }
+
+    explicit VEPProcess(const std::string& cmd, const Path& copy_file = {})
+    : VEPProcess(std::vector{cmd}, copy_file) {}
+
+    VEPProcess(const VEPProcess&) = delete;
+    VEPProcess& operator=(const VEPProcess&) = delete;
+
+    ~VEPProcess(){
+        if(!pids.empty() or copier.joinable()){
+            try{
+                wait();
+            }catch(const std::exception& e){
+                SPDLOG_ERROR("{}", e.what());
+            }
+        }
+    }
+
+    void write(std::string_view data){
+        if(!write_all(in_fd, data)){
+            throw std::runtime_error(fmt::format("VEPProcess: write: {}", std::strerror(errno)));
+        }
+    }
+
+    void close_input(){
+        close_fd(in_fd);
+    }
+
+    /**
+     * @brief Stops reading the output, the commands get SIGPIPE once they write more
+     */
+    void close_output(){
+        close_fd(out_fd);
+    }
+
+    [[nodiscard]] auto output_path() const {
+        return Path(fmt::format("/dev/fd/{}", out_fd));
+    }
+
+    /**
+     * @brief Waits for the commands, returns the wait status of the first one that failed
+     * (0 if none), as `std::system` does. Throws if the output couldn't be copied.
+     */
+    int wait(){
+        close_input();
+        close_output();
+        if(copier.joinable()){
+            copier.join();
+        }
+        auto ret = 0;
+        for(auto pid : pids){
+            auto status = 0;
+            while(::waitpid(pid, &status, 0) < 0){
+                if(errno != EINTR){
+                    status = -1;
+                    break;
+                }
+            }
+            if(ret == 0){
+                ret = status;
+            }
+        }
+        pids.clear();
+        if(!copy_error.empty()){
+            throw std::runtime_error(fmt::format("VEPProcess: can't copy the output: {}",
+                std::exchange(copy_error, {})));
+        }
+        return ret;
     }
 };
 
@@ -290,6 +1340,48 @@ private:
     Path vep_executable;
     Path filter_vep_executable;
     Path assembly_file;
+
+    // assembly file is either absolute path or relative path under vep_repo_dir
+    [[nodiscard]] auto make_vep_cmd(
+        const Path& vep_inputfile,
+        const Path& vep_outputfile,
+        int thread_num,
+        bool is_grch37,
+        std::string_view extra_args
+    ) const {
+        auto vep_args = options;
+
+        // input / output / assembly file / thread
+        vep_args.emplace_back(
+            fmt::format("-i {} -o {} --assembly {} --fasta {} --fork {}",
+                vep_inputfile.c_str(),
+                vep_outputfile.c_str(),
+                is_grch37 ? "GRCh37" : "GRCh38",
+                assembly_file.c_str(),
+                std::max(thread_num, 1) // positive value
+            )
+        );
+        if(!extra_args.empty()){
+            vep_args.emplace_back(extra_args);
+        }
+
+        // push vep plugins command
+        for(auto&& [plugin, cmd] : plugins) {
+            SPDLOG_INFO("[run vep] VEP uses {} plugin", plugin);
+            vep_args.emplace_back(cmd);
+        }
+        return fmt::format("{} {}", vep_executable.c_str(), fmt::join(vep_args, " "));
+    }
+
+    [[nodiscard]] auto make_filter_cmd(const Path& vep_outputfile, const std::vector<std::string>& gene_list) const {
+        return fmt::format(
+            "{} -o {} --filter \"SYMBOL {} {}\" --force_overwrite",
+                filter_vep_executable.c_str(),
+                vep_outputfile.c_str(),
+                (gene_list.size() == 1 ? "is" : "in"),
+                fmt::join(gene_list, ",")
+        );
+    }
 public:
     VEPRunner() = default;
 
@@ -352,52 +1444,55 @@ public:
         const Path& vep_outputfile,
         const std::vector<std::string>& gene_list,
         int thread_num,
-        bool is_grch37 = false
+        bool is_grch37 = false,
+        std::string_view extra_args = ""
     ) const {
-        auto vep_args = options;
         auto run_filter = gene_list.size() > 0;
-
-        // input / output / assembly file / thread
-        // assembly file is either absolute path or relative path under vep_repo_dir
-        vep_args.emplace_back(
-            fmt::format("-i {} -o {} --assembly {} --fasta {} --fork {}",
-                vep_inputfile.c_str(),
-                run_filter ? "STDOUT" : vep_outputfile.c_str(),
-                is_grch37 ? "GRCh37" : "GRCh38",
-                assembly_file.c_str(),
-                std::max(thread_num, 1) // positive value
-            )
-        );
-
-        // push vep plugins command
-        for(auto&& [plugin, cmd] : plugins) {
-            SPDLOG_INFO("[run vep] VEP uses {} plugin", plugin);
-            vep_args.emplace_back(cmd);
-        }
-
         SPDLOG_INFO("[run vep] filter_vep: {}", (run_filter ? "on" : "off"));
-        auto filter_vep_cmd = std::string{};
+        auto vep_cmd = make_vep_cmd(
+            vep_inputfile, run_filter ? "STDOUT" : vep_outputfile, thread_num, is_grch37, extra_args);
         if(run_filter){
-            filter_vep_cmd = fmt::format(
-                "| {} -o {} --filter \"SYMBOL {} {}\" --force_overwrite",
-                    filter_vep_executable.c_str(),
-                    vep_outputfile.c_str(),
-                    (gene_list.size() == 1 ? "is" : "in"),
-                    fmt::join(gene_list, ",")
-            );
-        }
-        auto vep_cmd = fmt::format(
-            "{} {} {}",
-                vep_executable.c_str(),
-                fmt::join(vep_args, " "),
-                filter_vep_cmd
-        );
+            vep_cmd += fmt::format(" | {}", make_filter_cmd(vep_outputfile, gene_list));
+        }
         return vep_cmd;
     }
 
+    /**
+     * @brief The commands of a VEP reading the VCF from stdin and writing the annotated VCF
+     * to stdout, followed by `filter_vep` if `gene_list` isn't empty (see `VEPProcess`)
+     */
+    [[nodiscard]] auto make_stream_cmds(
+        const std::vector<std::string>& gene_list,
+        int thread_num,
+        bool is_grch37 = false
+    ) const {
+        SPDLOG_INFO("[run vep] filter_vep: {}", (gene_list.empty() ? "off" : "on"));
+        auto cmds = std::vector{make_vep_cmd("STDIN", "STDOUT", thread_num, is_grch37, "--format vcf")};
+        if(!gene_list.empty()){
+            cmds.push_back(make_filter_cmd("STDOUT", gene_list));
+        }
+        return cmds;
+    }
+
+    /**
+     * @brief Runs `make_stream_cmds`, the output is also saved to `vep_outputfile` if given
+     */
+    [[nodiscard]] auto spawn(
+        const Path& vep_outputfile,
+        const std::vector<std::string>& gene_list,
+        int thread_num,
+        bool is_grch37 = false
+    ) const {
+        auto cmds = make_stream_cmds(gene_list, thread_num, is_grch37);
+        SPDLOG_INFO("[run vep] VEP command: {}", fmt::join(cmds, " | "));
+        return std::make_unique<VEPProcess>(cmds, vep_outputfile);
+    }
+
     [[nodiscard]] auto get_assembly_file() const {
         return assembly_file;
     }
 };
 
 }
+
+BOOST_CLASS_VERSION(Sherloc::DB::VEP::Table, 1)
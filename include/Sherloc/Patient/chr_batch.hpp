@@ -0,0 +1,161 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include <Sherloc/sherloc_member.hpp>
+
+namespace Sherloc::Patient {
+
+/**
+ * @brief An allele carried by one sample of a multi-sample (cohort) vcf
+ *
+ */
+struct SampleCall {
+  // index of the allele in Patient::sher_mems
+  size_t mem_idx;
+  std::array<int, 2> genotype;
+  std::string format;
+};
+
+/**
+ * @brief Compact columns of the patient VCF records that belong to one chromosome.
+ *
+ * A non-indexed VCF is decoded only once (see FileMaker::ingest), each record is appended
+ * to the batch of its chromosome. All the strings (REF, ALT, FORMAT, ID) of a batch are stored
+ * back to back in one arena, so a record costs one Row plus its bytes instead of a full
+ * SherlocMember.
+ * For a cohort vcf, the genotype and FORMAT of each carrier sample are kept as calls of the row.
+ */
+class ChrBatch {
+public:
+  struct Row {
+    size_t pos;
+    std::array<int, 2> genotype;
+    // end offsets of ref / alt / format / id in the arena,
+    // the begin offset of ref is the id end of the previous row
+    std::array<size_t, 4> ends;
+    // end offset of the calls of this row
+    size_t calls_end;
+  };
+
+  struct Call {
+    uint32_t sample;
+    std::array<int, 2> genotype;
+    // end offset of the FORMAT in the call arena
+    size_t format_end;
+  };
+
+private:
+  std::vector<Row> rows;
+  std::string arena;
+  std::vector<Call> calls;
+  std::string call_arena;
+
+  [[nodiscard]] auto field(size_t row_idx, size_t field_idx) const {
+    auto begin = field_idx == 0 ?
+      (row_idx == 0 ? size_t{0} : rows[row_idx - 1].ends.back()) :
+      rows[row_idx].ends[field_idx - 1];
+    return std::string_view{arena}.substr(begin, rows[row_idx].ends[field_idx] - begin);
+  }
+
+public:
+  void add(
+    size_t pos,
+    std::string_view ref,
+    std::string_view alt,
+    const std::array<int, 2>& genotype,
+    std::string_view fmt,
+    std::string_view id
+  ){
+    auto& row = rows.emplace_back(Row{pos, genotype, {}, calls.size()});
+    auto idx = size_t{0};
+    for(auto str : {ref, alt, fmt, id}){
+      arena.append(str);
+      row.ends[idx++] = arena.size();
+    }
+  }
+
+  /**
+   * @brief Attach a carrier sample to the last added record
+   *
+   * @param sample sample index in the vcf header
+   * @param genotype
+   * @param fmt FORMAT of this sample
+   */
+  void add_call(uint32_t sample, const std::array<int, 2>& genotype, std::string_view fmt){
+    call_arena.append(fmt);
+    calls.emplace_back(Call{sample, genotype, call_arena.size()});
+    rows.back().calls_end = calls.size();
+  }
+
+  [[nodiscard]] auto size() const {
+    return rows.size();
+  }
+
+  [[nodiscard]] auto empty() const {
+    return rows.empty();
+  }
+
+  /**
+   * @brief Materialize the batch into sherloc members, in the original VCF order
+   *
+   * @param chr normalized chromosome name of this batch
+   * @param sher_mems output container
+   * @param sample_calls per sample calls of a cohort vcf (one entry per sample), ignored if empty
+   */
+  void to_sher_mems(
+    const std::string& chr,
+    std::vector<SherlocMember>& sher_mems,
+    std::vector<std::vector<SampleCall>>& sample_calls
+  ) const {
+    sher_mems.reserve(sher_mems.size() + rows.size());
+    auto call_idx = size_t{0};
+    for(auto idx = size_t{0}; idx < rows.size(); ++idx){
+      auto& row = rows[idx];
+      for(; call_idx < row.calls_end; ++call_idx){
+        auto& call = calls[call_idx];
+        auto format_begin = call_idx == 0 ? size_t{0} : calls[call_idx - 1].format_end;
+        sample_calls[call.sample].emplace_back(SampleCall{
+          sher_mems.size(), call.genotype,
+          call_arena.substr(format_begin, call.format_end - format_begin)
+        });
+      }
+      SherlocMember new_member(chr, row.pos,
+        std::string{field(idx, 0)}, std::string{field(idx, 1)}, row.genotype);
+      SPDLOG_DEBUG("Sher mem GT={}/{}", new_member.genotype[0], new_member.genotype[1]);
+      new_member.vcf_format_col = field(idx, 2);
+      new_member.vcf_id_col = field(idx, 3);
+
+      // FIXME: there some vcf records have more then one alt
+      // e.g. chr3	193643619	.	G	A,T	.	.	.	GT:AD:DP:GQ:PL	1/2:174,123:297:99:2572,0,3905
+      // TODO: should make HTS_VCF handle this. And replace the following approach
+      if(
+        !sher_mems.empty() and
+        sher_mems.back().same_coordinate_as(new_member)
+      ) [[unlikely]]
+      {
+        new_member.next = -1;
+        sher_mems.back().next = 1;
+      }
+
+      sher_mems.emplace_back(std::move(new_member));
+    }
+  }
+
+  /**
+   * @brief Release the memory hold by this batch
+   *
+   */
+  void clear(){
+    rows = {};
+    arena = {};
+    calls = {};
+    call_arena = {};
+  }
+};
+
+}
@@ -4,8 +4,10 @@
 #include <Sherloc/disease_database.hpp>
 #include <Sherloc/DB/vcf.hpp>
 #include <Sherloc/Patient/other_patient.hpp>
+#include <Sherloc/Patient/chr_batch.hpp>
 #include <Sherloc/Attr/allele.hpp>
 #include <nlohmann/json.hpp>
+#include <memory>
 
 namespace Sherloc::Patient {
 
@@ -14,6 +16,16 @@ public:
   std::string vcf_file;
   std::string name;
   std::vector<SherlocMember> sher_mems;
+  // per chromosome records of the patient vcf, filled by FileMaker::ingest
+  std::vector<ChrBatch> chr_batches;
+  bool ingested = false;
+  // indexed patient vcf, kept open (with its index) and read by region query instead of chr_batches
+  std::shared_ptr<DB::HTS_VCF> indexed_vcf;
+  // samples of a multi-sample (cohort) vcf, and the alleles each sample carries on the loaded chromosome
+  std::vector<std::string> samples;
+  std::vector<std::vector<SampleCall>> sample_calls;
+  // the sample has a non-reference call on chrY, used by sex detection
+  std::vector<bool> sample_on_y;
   bool sex;
   bool is_sick;
   bool is_denovo;
@@ -56,6 +68,34 @@ public:
     sick_family = OtherPatient(vec);
   }
 
+  /**
+   * @brief Whether the vcf has more than one sample, each sample is reported as its own patient
+   */
+  [[nodiscard]] bool is_cohort() const {
+    return samples.size() > 1;
+  }
+
+  /**
+   * @brief Build the patient of one sample in a cohort vcf
+   *
+   * The attributes of the cohort entry are shared by all samples,
+   * and can be overwritten per sample by `"samples": {"<sample name>": {...}}`,
+   * e.g. `{"sex": true, "dad_vcf": "..."}`.
+   *
+   * @param js the cohort entry of input json
+   * @param sample_name
+   */
+  static Patient from_cohort_sample(nlohmann::json js, const std::string& sample_name){
+    if(js.contains("samples") and js["samples"].contains(sample_name)){
+      for(auto& [key, value] : js["samples"][sample_name].items()){
+        js[key] = value;
+      }
+    }
+    auto patient = Patient{js};
+    patient.name = fmt::format("{}_{}", patient.name, sample_name);
+    return patient;
+  }
+
   auto check_allele_denovo(const SherlocMember& sher_mem, bool sex = false){
     using namespace Attr;
     if(sex){
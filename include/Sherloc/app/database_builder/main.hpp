@@ -24,6 +24,7 @@ struct Parameters
     std::string output;
     bool separate;
     int thread_num;
+    int io_threads;
 };
 
 class GetParameters :
@@ -62,7 +63,10 @@ public:
             
             ( "output,o",   po::value<std::string>(&output)->default_value("/tmp/"), "Output directory" )
 
-            ( "thread,t",   po::value<int>(&thread_num)->default_value(4), "Thread num for parallel building GnomAD" )
+            ( "thread,t",   po::value<int>(&thread_num)->default_value(4), "Thread num for parallel building GnomAD and coverage" )
+
+            ( "io_threads", po::value<int>(&io_threads)->default_value(0),
+                "Threads for decompressing bgzipped inputs, shared by all readers (0: no extra thread)" )
         ;
 
         po::store( po::parse_command_line( argc, argv, desc ), vm );
@@ -85,6 +89,7 @@ void Run( GET_PARAMETERS&& args )
     // 2. Create database object
     // 3. Save database objects into one archive file
     using namespace std::filesystem;
+    Sherloc::DB::HTSThreadPool::get().init(args.io_threads);
     Sherloc::DB::DBSet dbset;
     std::string database_to_build = "[";
     auto output_dir = path(args.output);
@@ -164,6 +169,7 @@ void Run( GET_PARAMETERS&& args )
     if(!args.coverage_file.empty()){
         database_to_build += "Coverage,";
         SPDLOG_INFO("Building Coverage...");
+        dbset.db_coverage.thread_num = std::max(1, args.thread_num);
         dbset.db_coverage.from(args.coverage_file);
         dbset.db_coverage.save(output_dir / DB::DBSet::get_default("coverage"));
     }
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <iostream>
+#include <Sherloc/option_parser.hpp>
+#include <Sherloc/DB/dbset.hpp>
+#include <Sherloc/DB/db_server.hpp>
+#include <Sherloc/DB/vep.hpp>
+#include <spdlog/spdlog.h>
+
+namespace Sherloc::app::holmes_dbd {
+
+using Path = std::filesystem::path;
+
+struct Parameters {
+  std::string dbconfig;
+  std::string vepconfig;
+  std::string socket;
+  int db_load_threads;
+  int thread_num;
+  size_t gnomad_cache_mb;
+  bool gnomad_prefetch = false;
+};
+
+class GetParameters :
+  public Parameters,
+  public nucleona::app::cli::OptionParser {
+public:
+  GetParameters(int argc, char const* argv[]) {
+    namespace po = boost::program_options;
+    po::options_description desc("Allowed options");
+    desc.add_options()
+      ("help,h", "show help message")
+      ("db_config", po::value< std::string >(&dbconfig)->default_value(""),
+        "Holmes database config file, default to ${project dir}/config/db_config.json")
+      ("vep_config", po::value< std::string >(&vepconfig)->default_value(""),
+        "VEP config file (for the assembly), default to ${project dir}/config/vep_config.json")
+      ("socket,s", po::value< std::string >(&socket)->default_value("/tmp/holmes_dbd.sock"),
+        "Unix domain socket to listen on, pass it to `sherloc --db_server`")
+      ("db_load_threads", po::value< int >(&db_load_threads)->default_value(4),
+        "Number of databases loaded concurrently at startup")
+      ("thread_num,t", po::value< int >(&thread_num)->default_value(4),
+        "Threads decoding the gnomAD chunks of a batch")
+      ("gnomad_cache_mb", po::value< size_t >(&gnomad_cache_mb)->default_value(4096),
+        "Memory budget (MB) of the decoded gnomAD chunks kept in the LRU cache")
+      ("gnomad_prefetch", po::bool_switch(&gnomad_prefetch),
+        "Load the next gnomAD chunk in the background while querying the current one")
+      ;
+
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+
+    if (vm.count("help")) {
+      std::cout << desc << std::endl;
+      std::exit(1);
+    }
+
+    po::notify(vm);
+  }
+};
+
+void Run(const GetParameters& args) {
+  // before the loading threads start, so only the server loop receives SIGINT / SIGTERM
+  DB::DBServer::block_stop_signals();
+  auto vep_runner = DB::VEPRunner(
+    args.vepconfig.empty() ?
+      Path(HOLMES_CONFIG_PATH) / "vep_config.json" :
+      Path(args.vepconfig)
+  );
+
+  auto db = DB::DBSet{
+    args.dbconfig.empty() ?
+      Path(HOLMES_CONFIG_PATH) / "db_config.json" :
+      Path(args.dbconfig),
+    vep_runner.get_assembly_file(),
+    args.db_load_threads
+  };
+  db.db_gnom.set_cache(args.gnomad_cache_mb << 20, args.gnomad_prefetch);
+
+  auto server = DB::DBServer(db, args.socket, args.thread_num);
+  server.run();
+  db.db_gnom.get_cache().log_stats("gnomAD");
+}
+
+}
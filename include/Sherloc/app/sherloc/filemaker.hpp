@@ -5,10 +5,15 @@
 #include <string>
 #include <fstream>
 #include <future>
+#include <iterator>
+#include <map>
+#include <span>
+#include <stdexcept>
 #include <spdlog/spdlog.h>
 #include <Sherloc/Patient/patient.hpp>
 #include <Sherloc/specialcase.hpp>
 #include <Sherloc/app/sherloc/sherloc_parameter.hpp>
+#include <Sherloc/app/sherloc/pipeline.hpp>
 #include <Sherloc/Attr/utils.hpp>
 #include <Sherloc/Attr/inheritance_patterns.hpp>
 #include <Sherloc/Attr/rule.hpp>
@@ -43,14 +48,17 @@ public:
   );
   FileMaker() = default;
 
-  void load_chr(Patient::Patient& patient, std::string_view this_chr){
-    using namespace std::literals;
-    decltype(auto) para = SherlocParameter::get_paras();
-    // TODO: Currently we don't need the INFO part
-    auto patient_vcf = DB::HTS_VCF{patient.vcf_file, true, false, false, true};
+  /**
+   * @brief Iterate over the records of a patient vcf, records on unacceptable chromosomes are skipped
+   * 
+   * @param patient_vcf 
+   * @param on_record callback `(size_t chr_idx, DB::HTS_VCF& vcf)`
+   */
+  template<class Fn>
+  static void for_each_record(DB::HTS_VCF& patient_vcf, Fn&& on_record){
     auto vcf_status = DB::HTS_VCF::VCF_Status{};
-    auto previous_skipped_chr = ""s;
-    while((vcf_status = patient_vcf.parse_line()) != DB::HTS_VCF::VCF_Status::VCF_EOF){
+    auto previous_skipped_chr = std::string_view{};
+    while((vcf_status = patient_vcf.parse_view()) != DB::HTS_VCF::VCF_Status::VCF_EOF){
       switch (vcf_status) {
         using enum DB::HTS_VCF::VCF_Status;
         case OK:
@@ -62,171 +70,383 @@ public:
           SPDLOG_ERROR("HTS_VCF parsing error, status code: {}", int(vcf_status));
           exit(1);
       }
-      auto& rec = patient_vcf.record;
-      try{
-        rec.chr = Attr::ChrMap::norm_chr(rec.chr);
-      } catch (std::out_of_range& e){
+      auto& rec = patient_vcf.view;
+      if(!rec.accepted_chr()){
+        // chr name points to the vcf header, it stays valid between records
         if(rec.chr != previous_skipped_chr){
           SPDLOG_WARN("Skip seq: '{}', this chromosome is not acceptable", rec.chr);
           previous_skipped_chr = rec.chr;
         }
         continue;
       }
+      on_record(rec.chr_idx, patient_vcf);
+    }
+  }
 
-      if(para.detect_sex and rec.chr == "Y"){
+  /**
+   * @brief A cohort sample carries the allele if its genotype has any non-reference allele
+   */
+  static bool is_carrier(const std::array<int32_t, 2>& genotype){
+    return genotype[0] > 0 or genotype[1] > 0;
+  }
+
+  static void add_to_batch(Patient::ChrBatch& batch, DB::HTS_VCF& patient_vcf, bool cohort = false){
+    auto& rec = patient_vcf.view;
+    // in a cohort the FORMAT of each sample is kept by its call, the row doesn't need one
+    batch.add(rec.pos(), rec.ref, rec.alt, rec.genotype,
+      cohort ? std::string{} : patient_vcf.get_fmt(), patient_vcf.get_ID());
+    if(!cohort){
+      return;
+    }
+    for(auto sample = uint32_t{0}; sample < rec.sample_genotypes.size(); ++sample){
+      auto& genotype = rec.sample_genotypes[sample];
+      if(is_carrier(genotype)){
+        batch.add_call(sample, genotype, patient_vcf.get_fmt(sample));
+      }
+    }
+  }
+
+  static void mark_sample_on_y(Patient::Patient& patient, const DB::HTS_VCF& patient_vcf){
+    auto& sample_genotypes = patient_vcf.view.sample_genotypes;
+    for(auto sample = size_t{0}; sample < sample_genotypes.size(); ++sample){
+      if(is_carrier(sample_genotypes[sample])){
+        patient.sample_on_y[sample] = true;
+      }
+    }
+  }
+
+  /**
+   * @brief Prepare the patient vcf for `load_chr`, and detect the sex (if enabled).
+   * 
+   * If the vcf is indexed (.tbi / .csi), each chromosome will be read by a region query.
+   * Otherwise the vcf is decoded once here, and the records are split into per chromosome batches.
+   * A multi-sample vcf is decoded once as well, the calls of every carrier sample are kept in the batches.
+   *
+   * @param patient
+   */
+  void ingest(Patient::Patient& patient){
+    decltype(auto) para = SherlocParameter::get_paras();
+    // TODO: Currently we don't need the INFO part
+    auto vcf_ptr = std::make_shared<DB::HTS_VCF>(patient.vcf_file, true, false, false, true);
+    auto& patient_vcf = *vcf_ptr;
+    patient.ingested = true;
+    patient.samples = patient_vcf.sample_names();
+    patient.sample_on_y = std::vector<bool>(patient.samples.size(), false);
+    auto cohort = patient.is_cohort();
+
+    if(patient_vcf.has_index()){
+      SPDLOG_INFO("Patient vcf is indexed, read each chromosome by region query");
+      patient.indexed_vcf = vcf_ptr;
+      if(para.detect_sex and patient_vcf.query("Y")){
+        for_each_record(patient_vcf, [&patient](size_t, DB::HTS_VCF& vcf){
+          patient.sex = true;
+          mark_sample_on_y(patient, vcf);
+        });
+      }
+      return;
+    }
+
+    patient.chr_batches = std::vector<Patient::ChrBatch>(Attr::ChrMap::approved_chr.size());
+    for_each_record(patient_vcf, [&](size_t chr_idx, DB::HTS_VCF& vcf){
+      if(para.detect_sex and Attr::ChrMap::idx2chr(chr_idx) == "Y"){
         patient.sex = true;
+        mark_sample_on_y(patient, vcf);
       }
+      add_to_batch(patient.chr_batches[chr_idx], vcf, cohort);
+    });
+  }
 
-      // TODO: maybe a more elegant way to do this
-      if(rec.chr != this_chr){
-        continue;
+  void load_chr(Patient::Patient& patient, std::string_view this_chr){
+    load_chr(patient, this_chr, patient.sher_mems, patient.sample_calls);
+  }
+
+  /**
+   * @brief `load_chr` into the given alleles / sample calls instead of the patient ones,
+   * the patient (already ingested) is only read apart from the batch of `this_chr`, so
+   * another chromosome of it can be processed meanwhile.
+   */
+  void load_chr(
+    Patient::Patient& patient,
+    std::string_view this_chr,
+    std::vector<SherlocMember>& sher_mems,
+    std::vector<std::vector<Patient::SampleCall>>& sample_calls
+  ){
+    if(!patient.ingested){
+      ingest(patient);
+    }
+    sample_calls.assign(patient.is_cohort() ? patient.samples.size() : 0, {});
+
+    if(patient.indexed_vcf){
+      auto& patient_vcf = *patient.indexed_vcf;
+      auto batch = Patient::ChrBatch{};
+      if(patient_vcf.query(this_chr)){
+        for_each_record(patient_vcf, [&batch, cohort = patient.is_cohort()](size_t, DB::HTS_VCF& vcf){
+          add_to_batch(batch, vcf, cohort);
+        });
       }
+      batch.to_sher_mems(std::string{this_chr}, sher_mems, sample_calls);
+      return;
+    }
+
+    auto& batch = patient.chr_batches[Attr::ChrMap::chr2idx(std::string{this_chr})];
+    batch.to_sher_mems(std::string{this_chr}, sher_mems, sample_calls);
+    // this chromosome is consumed, release its batch
+    batch.clear();
+  }
 
-      SherlocMember new_member(rec.chr, rec.pos, rec.ref, rec.alt, rec.genotype);
-      SPDLOG_DEBUG("Sher mem GT={}/{}", new_member.genotype[0], new_member.genotype[1]);
-      new_member.vcf_format_col = patient_vcf.get_fmt();
-      new_member.vcf_id_col = patient_vcf.get_ID();
+  /**
+   * @brief Build the patient of a cohort sample, the sex is detected per sample (if enabled).
+   * 
+   * @param patient_json the cohort entry of input json
+   * @param cohort the ingested cohort patient
+   * @param sample sample index
+   */
+  static auto make_sample_patient(
+    const nlohmann::json& patient_json,
+    const Patient::Patient& cohort,
+    size_t sample
+  ){
+    decltype(auto) para = SherlocParameter::get_paras();
+    auto sample_patient = Patient::Patient::from_cohort_sample(patient_json, cohort.samples[sample]);
+    if(para.detect_sex and cohort.sample_on_y[sample]){
+      sample_patient.sex = true;
+    }
+    return sample_patient;
+  }
 
-      // FIXME: there some vcf records have more then one alt
-      // e.g. chr3	193643619	.	G	A,T	.	.	.	GT:AD:DP:GQ:PL	1/2:174,123:297:99:2572,0,3905
-      // TODO: should make HTS_VCF handle this. And replace the following approach
+  /**
+   * @brief Copy the annotated alleles carried by one cohort sample into its own patient,
+   * with the genotype and FORMAT of that sample.
+   * 
+   * @param cohort the cohort patient, annotated by the genotype independent trees
+   * @param sample sample index
+   * @param sample_patient output patient, its sher_mems are replaced
+   */
+  static void load_sample_chr(
+    Patient::Patient& cohort,
+    size_t sample,
+    Patient::Patient& sample_patient
+  ){
+    auto& calls = cohort.sample_calls[sample];
+    auto& sher_mems = sample_patient.sher_mems;
+    sher_mems.clear();
+    sher_mems.reserve(calls.size());
+    for(auto idx = size_t{0}; idx < calls.size(); ++idx){
+      auto& call = calls[idx];
+      auto& sher_mem = sher_mems.emplace_back(cohort.sher_mems[call.mem_idx]);
+      sher_mem.genotype = call.genotype;
+      sher_mem.vcf_format_col = std::move(call.format);
+      sher_mem.next = 0;
+      // keep the link of multi-alt records only if the sample carries both alleles
       if(
-        !patient.sher_mems.empty() and 
-        patient.sher_mems.back().same_coordinate_as(new_member)
-      ) [[unlikely]]
-      {
-        new_member.next = -1;
-        patient.sher_mems.back().next = 1;
+        idx > 0 and
+        calls[idx - 1].mem_idx + 1 == call.mem_idx and
+        cohort.sher_mems[call.mem_idx].next == -1
+      ){
+        sher_mems[idx - 1].next = 1;
+        sher_mem.next = -1;
       }
+    }
+    calls = {};
+  }
+
+  /**
+   * @brief Looks the alleles of a chromosome up in the VEP cache, the hits get their cached
+   * annotations and are marked in `work.cache_hits`. Returns the number of misses.
+   */
+  size_t find_cached(ChrWork& work, DB::VEP& cache){
+    auto& sher_mems = work.sher_mems;
+    spdlog::stopwatch sw;
+    SPDLOG_INFO("Searching and parsing cached VEP results ...");
+    work.cache_hits = cache.try_insert_batch(sher_mems);
+    auto from_cache = static_cast<size_t>(std::ranges::count(work.cache_hits, true));
+    SPDLOG_INFO("Take {} sec. chr{}: Cached / Total = {} / {} = {:.2f}%",
+      sw, work.chr, from_cache, sher_mems.size(), double(from_cache) / sher_mems.size() * 100.);
+    return sher_mems.size() - from_cache;
+  }
 
-      patient.sher_mems.emplace_back(std::move(new_member));
+  /**
+   * @brief The alleles of the chromosomes of a VEP run, by the CHROM and ID columns of
+   * `make_damaging_vcf` (the container of `VEP::parse_vcf_into`)
+   */
+  struct VEPAlleles {
+    std::map<size_t, ChrWork*> chr2work;
+
+    explicit VEPAlleles(const std::vector<ChrWork*>& works){
+      for(auto work : works){
+        chr2work.emplace(Attr::ChrMap::chr2idx(work->chr), work);
+      }
     }
+
+    SherlocMember& at(const std::string& chr, size_t idx){
+      return chr2work.at(Attr::ChrMap::chr2idx(chr))->sher_mems.at(idx);
+    }
+  };
+
+  /**
+   * @brief VCF lines of the alleles not in the cache, the ID column is the allele index
+   * in its chromosome (fed to VEP through its stdin)
+   */
+  std::string make_damaging_vcf(const std::vector<ChrWork*>& works){
+    auto damage_vcf = std::string{};
+    for(auto work : works){
+      for(auto idx = size_t{0}; idx < work->sher_mems.size(); ++idx){
+        if(!work->cache_hits[idx]){ // Those not in cache
+          auto& allele = work->sher_mems[idx];
+          fmt::format_to(std::back_inserter(damage_vcf), "chr{}\t{}\t{}\t{}\t{}\t.\t.\n",
+            allele.chr, allele.pos, idx, allele.ref, allele.alt);
+        }
+      }
+    }
+    return damage_vcf;
   }
 
-  Path make_damaging_vcf(
-    Patient::Patient& patient,
-    const Path& vepfile,
-    DB::VEP& vep_cache,
-    const std::vector<bool>& cache_hit_mask,
-    std::string_view this_chr
-  ){
-    auto damage_vcf_path = vepfile / fmt::format("dmg_for_vep_chr{}_{}.vcf",
-      this_chr, patient.name);
-    auto ofs = std::ofstream(damage_vcf_path);
-    SPDLOG_INFO("[make_damaging_vcf] Saving damage VCF...",
-      damage_vcf_path.c_str());
-    
-    for(auto idx = 0; auto& allele : patient.sher_mems) {
-      if(!cache_hit_mask[idx]){ // Those not in cache
-        fmt::print(ofs, "chr{}\t{}\t{}\t{}\t{}\t.\t.\n",
-          allele.chr, allele.pos, idx, allele.ref, allele.alt);
+  /**
+   * @brief Splits the VEP output of several chromosomes into one file per chromosome, each
+   * with the whole header. `files` maps the CHROM column (e.g. "chr1") to the file.
+   */
+  static void split_by_chrom(const Path& vep_output, const std::map<std::string, Path, std::less<>>& files){
+    auto is = std::ifstream(vep_output);
+    if(!is.is_open()){
+      throw std::runtime_error(fmt::format("[run vep] can't open '{}'", vep_output.c_str()));
+    }
+    auto line = std::string{};
+    auto header = std::string{};
+    while(is.peek() == '#' and std::getline(is, line)){
+      header += line;
+      header += '\n';
+    }
+
+    auto outputs = std::map<std::string_view, std::ofstream, std::less<>>{};
+    for(auto& [chrom, file] : files){
+      auto& os = outputs[chrom] = std::ofstream(file);
+      os << header;
+    }
+    while(std::getline(is, line)){
+      auto chrom = std::string_view{line}.substr(0, line.find('\t'));
+      auto it = outputs.find(chrom);
+      if(it == outputs.end()){
+        throw std::runtime_error(fmt::format(
+          "[run vep] '{}' has a record on '{}', not a chromosome of the run", vep_output.c_str(), chrom));
+      }
+      it->second << line << '\n';
+    }
+    for(auto& [chrom, os] : outputs){
+      os.close();
+      if(os.fail()){
+        throw std::runtime_error(fmt::format("[run vep] can't write '{}'", files.find(chrom)->second.c_str()));
       }
-      ++idx;
     }
-    SPDLOG_INFO("[make_damaging_vcf] damage VCF is saved to {}",
-      damage_vcf_path.c_str());
-    return damage_vcf_path;
   }
 
+  /**
+   * @brief Annotates the cache misses (see `find_cached`) of consecutive chromosomes of a
+   * patient by one VEP run, then converts the alleles to the VEP style
+   *
+   * The output of each chromosome is saved to `vep_chr<chr>_<name>.vcf`, whatever the
+   * chromosomes run together. With `use_exist_vep_output` the chromosomes having this file
+   * read it instead of running VEP.
+   */
   void run_vep(
-    Patient::Patient& ze, 
+    const std::string& name,
+    std::span<ChrWork> works,
     const Path& vep_output_dir, 
     const DB::VEPRunner& vep_runner,
     const std::vector<std::string>& genes,
-    std::string_view this_chr,
     DB::VEP& cache
   ){
     using namespace std::filesystem;
     using namespace DB;
 
-    auto vep_inputfile  = path();
-    auto vep_outputfile = vep_output_dir / fmt::format("vep_chr{}_{}.vcf",
-      this_chr, ze.name);
+    auto vep_outputfile = [&](const ChrWork& work){
+      return vep_output_dir / fmt::format("vep_chr{}_{}.vcf", work.chr, name);
+    };
     decltype(auto) para = SherlocParameter::get_paras();
 
     spdlog::stopwatch sw;
-
-    // search variant in cache
-    SPDLOG_INFO("Searching cached VEP results ...");
-    int total = 0, from_cache = 0;
-    sw.reset();
-    auto cache_hit_mask = std::vector<bool>(ze.sher_mems.size(), false);
-    for(auto& sher_mem : ze.sher_mems){
-      if(cache.find(sher_mem).has_value()){
-        ++from_cache;
-        cache_hit_mask[total] = true;
+    auto to_annotate = std::vector<ChrWork*>{};
+    auto misses = size_t{0};
+    for(auto& work : works){
+      // if user want to use existing vep annotation file in `vepfile`, skip vep running
+      if(para.use_exist_vep_output and std::filesystem::exists(vep_outputfile(work))){
+        SPDLOG_INFO("[run vep] chr{}: Found existing vep output, skipping run_vep.", work.chr);
+        sw.reset();
+        HTS_VCF vep_output_vcf{vep_outputfile(work), true, false, true, false};
+        VEP::parse_vcf_into(vep_output_vcf, work.sher_mems);
+        SPDLOG_INFO("Parsing VEP output into sherloc member takes {} sec", sw);
+        continue;
+      }
+      if(auto work_misses = std::ranges::count(work.cache_hits, false); work_misses > 0){
+        to_annotate.push_back(&work);
+        misses += work_misses;
+      }else{
+        SPDLOG_INFO("[run vep] chr{}: all alleles are in cache, skip VEP running", work.chr);
       }
-      ++total;
     }
-    SPDLOG_INFO("Take {} sec. chr{}: Cached / Total = {} / {} = {:.2f}%",
-      sw, this_chr, from_cache, total, double(from_cache) / (total) * 100.);
-
-    // Task that will parse cache
-    auto cache_parsing_task = 
-      [&sher_mems = ze.sher_mems, &cache_hit_mask, &cache](bool is_async){
-        SPDLOG_INFO("[cache parsing] Parsing cache {}...",
-          is_async ? "while vep running" : "");
-        auto sw = spdlog::stopwatch{};
-        for(auto idx = 0; idx < sher_mems.size(); ++idx){
-          if(cache_hit_mask[idx]){
-            cache.try_insert_into(sher_mems[idx]);
-          }
-        }
-        SPDLOG_INFO("[cache parsing] Parsing cache takes {} sec.", sw);
-      };
-
-    auto all_var_are_in_cache = false;
-    // if user want to use existing vep annotation file in `vepfile`, skip vep running
-    if(!(para.use_exist_vep_output and std::filesystem::exists(vep_outputfile))){
-      vep_inputfile = make_damaging_vcf(ze, vep_output_dir, cache, cache_hit_mask, this_chr);
-      if(from_cache < total){ // some variants are not in cache
-        SPDLOG_INFO("dmg vcf not empty after cache search, Running VEP to annotate these...");
-        auto vep_cmd = vep_runner.make_cmd(
-          vep_inputfile, vep_outputfile, genes, para.thread_num, para.grch37);
-        SPDLOG_INFO("[run vep] VEP command: {}", vep_cmd);
-        SPDLOG_INFO("[run vep] Launch VEP task in background");
-        
-        sw.reset();
-        auto vep_cmd_future = std::async(std::launch::async, std::system, vep_cmd.c_str());
 
-        // parsing cache
-        cache_parsing_task(true);
+    if(!to_annotate.empty()){
+      auto& first = *to_annotate.front();
+      auto& last = *to_annotate.back();
+      auto chrs = to_annotate.size() == 1 ? first.chr : fmt::format("{}-{}", first.chr, last.chr);
+      // the output of several chromosomes is split into their own files once VEP is done
+      auto run_outputfile = to_annotate.size() == 1 ?
+        vep_outputfile(first) :
+        vep_output_dir / fmt::format("vep_chr{}_{}.vcf.tmp", chrs, name);
+      SPDLOG_INFO("chr{}: {} alleles not in cache, Running VEP to annotate these...", chrs, misses);
 
-        vep_cmd_future.wait();
-        SPDLOG_INFO("VEP runner take {} sec", sw);
+      // the alleles are piped into VEP and its output parsed while it runs,
+      // the output is still saved for `use_exist_vep_output`
+      sw.reset();
+      auto alleles = VEPAlleles(to_annotate);
+      auto vep = vep_runner.spawn(run_outputfile, genes, para.thread_num, para.grch37);
+      auto vep_input = std::async(std::launch::async,
+        [&vep, damage_vcf = make_damaging_vcf(to_annotate)]{
+          vep->write(damage_vcf);
+          vep->close_input();
+        });
 
-        auto vep_cmd_retcode = vep_cmd_future.get();
-        if(vep_cmd_retcode != 0){
-          SPDLOG_ERROR("[run vep] VEP error, return code = {}", vep_cmd_retcode);
-          exit(1);
+      try{
+        HTS_VCF vep_output_vcf{vep->output_path(), true, false, true, false};
+        VEP::parse_vcf_into(vep_output_vcf, alleles);
+        vep_input.get();
+      }catch(const std::exception& e){
+        // VEP stops on the closed output, then the input thread on the closed input
+        vep->close_output();
+        vep_input.wait();
+        throw std::runtime_error(fmt::format("[run vep] can't annotate with VEP: {}", e.what()));
+      }
+
+      auto vep_cmd_retcode = vep->wait();
+      SPDLOG_INFO("VEP runner and parsing take {} sec", sw);
+      if(vep_cmd_retcode != 0){
+        throw std::runtime_error(fmt::format("[run vep] VEP error, return code = {}", vep_cmd_retcode));
+      }
+      if(para.vep_cache_write_back){
+        sw.reset();
+        cache.write_back(run_outputfile);
+        SPDLOG_INFO("Writing VEP output back to the cache takes {} sec", sw);
+      }
+      if(to_annotate.size() > 1){
+        auto files = std::map<std::string, Path, std::less<>>{};
+        for(auto work : to_annotate){
+          files.emplace(fmt::format("chr{}", work->chr), vep_outputfile(*work));
         }
-      }else{
-        SPDLOG_INFO("[run vep] Dmg vcf empty after cache search, skip VEP running");
-        all_var_are_in_cache = true;
-        cache_parsing_task(false);
+        split_by_chrom(run_outputfile, files);
+        std::filesystem::remove(run_outputfile);
       }
-    }else{
-      SPDLOG_INFO("[run vep] Found existing vep output, skipping run_vep.");
-      cache_parsing_task(false);
     }
-    
-    sw.reset();
-    if(!all_var_are_in_cache) { // only parse VEP output when the input dmg is not empty
-      HTS_VCF vep_output_vcf{vep_outputfile, true, false, true, false};
-      VEP::parse_vcf_into(vep_output_vcf, ze.sher_mems);
-      SPDLOG_INFO("Parsing VEP output into sherloc member takes {} sec", sw);
-    }
-    
 
     // TODO: I think unify all the allele storing convention to VCF style is better
     // consider changing it, otherwise dealing with style conversion is painful
-    for(auto& sher_mem : ze.sher_mems){
-      if(sher_mem.ref.size() != sher_mem.alt.size()){ // indel vcf style to vep style
-        sher_mem.pos++;
-        sher_mem.ref = sher_mem.ref.substr(1);
-        sher_mem.alt = sher_mem.alt.substr(1);
-        if(sher_mem.ref.size() == 0) sher_mem.ref = "-";
-        if(sher_mem.alt.size() == 0) sher_mem.alt = "-";
+    for(auto& work : works){
+      for(auto& sher_mem : work.sher_mems){
+        if(sher_mem.ref.size() != sher_mem.alt.size()){ // indel vcf style to vep style
+          sher_mem.pos++;
+          sher_mem.ref = sher_mem.ref.substr(1);
+          sher_mem.alt = sher_mem.alt.substr(1);
+          if(sher_mem.ref.size() == 0) sher_mem.ref = "-";
+          if(sher_mem.alt.size() == 0) sher_mem.alt = "-";
+        }
       }
     }
   }
@@ -2,6 +2,7 @@
 
 #include <iostream>
 #include <fstream>
+#include <future>
 #include <Sherloc/specialcase.hpp>
 #include <Sherloc/option_parser.hpp>
 #include <Sherloc/DB/dbset.hpp>
@@ -13,6 +14,7 @@
 #include <Sherloc/app/sherloc/sherloc_consequence.hpp>
 #include <Sherloc/app/sherloc/variant_rule.hpp>
 #include <Sherloc/app/sherloc/predict.hpp>
+#include <Sherloc/app/sherloc/pipeline.hpp>
 #include <Sherloc/Patient/patient.hpp>
 #include <Sherloc/Patient/other_patient.hpp>
 #include <Sherloc/version.h>
@@ -32,6 +34,7 @@ struct Parameters {
   bool consequence = false;
   bool observation = false;
   bool use_exist_vep_output = false;
+  bool vep_cache_write_back = false;
   bool filter_rules = false;
   bool detect_sex = false;
   bool grch37 = false;
@@ -47,7 +50,14 @@ struct Parameters {
   std::string dbconfig;
   std::string output;
   std::string db_compression;
+  std::string db_server;
   int thread_num;
+  int io_threads;
+  int db_load_threads;
+  size_t gnomad_cache_mb;
+  size_t vep_cache_mb;
+  size_t vep_min_batch;
+  bool gnomad_prefetch = false;
 };
 
 class GetParameters :
@@ -74,7 +84,24 @@ public:
       ("db_config", po::value< std::string >(&dbconfig)->default_value(""),
         "Holmes database config file, default to ${project dir}/config/db_config.json")
       ("vep_cache", po::value< std::string >(&vepcache)->default_value(""), "VEP cache dir")
+      ("vep_cache_write_back", po::bool_switch(&vep_cache_write_back),
+        "Add the alleles annotated by VEP to the VEP cache (fold them in with `vep_cache_builder --compact`)")
       ("thread_num,t", po::value< int >(&thread_num)->default_value(8), "Thread num (mostly for VEP)")
+      ("io_threads", po::value< int >(&io_threads)->default_value(0),
+        "Threads for decompressing bgzipped VCFs, shared by all readers (0: no extra thread)")
+      ("db_load_threads", po::value< int >(&db_load_threads)->default_value(4),
+        "Number of databases loaded concurrently at startup")
+      ("gnomad_cache_mb", po::value< size_t >(&gnomad_cache_mb)->default_value(1024),
+        "Memory budget (MB) of the decoded gnomAD chunks kept in the LRU cache")
+      ("vep_cache_mb", po::value< size_t >(&vep_cache_mb)->default_value(256),
+        "Memory budget (MB) of the decoded VEP cache blocks kept in the LRU cache")
+      ("vep_min_batch", po::value< size_t >(&vep_min_batch)->default_value(0),
+        "Cache misses gathered over consecutive chromosomes before running VEP on them, "
+        "the chromosomes wait in memory and don't reach the trees meanwhile (0: one VEP run per chromosome)")
+      ("gnomad_prefetch", po::bool_switch(&gnomad_prefetch),
+        "Load the next gnomAD chunk in the background while querying the current one")
+      ("db_server", po::value< std::string >(&db_server)->default_value(""),
+        "Socket of a running holmes_dbd, query the allele databases from it instead of loading them")
       ("grch37", po::bool_switch(&grch37), "Use grch37 coordinate")
       ("output_rule_tag", po::bool_switch(&output_rule_tag), "Whether to output rule tags for Web App")
       ("output,o", po::value< std::string >(&output)->default_value("result.txt"), "output file")
@@ -104,6 +131,7 @@ void Run(GetParameters& args) {
     DB::DBSet::inspect(args.dbconfig);
     return;
   }
+  DB::HTSThreadPool::get().init(args.io_threads);
 
   if(!args.score_table_file.empty()){
     para.load_score_table(args.score_table_file);
@@ -121,8 +149,13 @@ void Run(GetParameters& args) {
     args.dbconfig.empty() ?
       Path(HOLMES_CONFIG_PATH) / "db_config.json" :
       Path(args.dbconfig),
-    vep_runner.get_assembly_file()
+    vep_runner.get_assembly_file(),
+    args.db_load_threads,
+    args.db_server.empty() ?
+      std::nullopt :
+      std::optional<Path>(args.db_server)
   };
+  db.db_gnom.set_cache(args.gnomad_cache_mb << 20, args.gnomad_prefetch);
 
 
   // read input json file
@@ -132,6 +165,7 @@ void Run(GetParameters& args) {
   auto vep_output_dir = Path{args.vepfile};  
 
   auto vep_cache    = DB::VEP{};
+  vep_cache.set_block_cache(args.vep_cache_mb << 20);
   auto sher_conseq  = SherlocConsequence{};
   auto op           = Patient::OtherPatient{};
   auto disease      = Disease{};
@@ -142,6 +176,7 @@ void Run(GetParameters& args) {
   }
 
   para.use_exist_vep_output = args.use_exist_vep_output;
+  para.vep_cache_write_back = args.vep_cache_write_back;
   para.filter_rules = args.filter_rules;
   para.thread_num = args.thread_num;
   para.detect_sex = args.detect_sex;
@@ -199,11 +234,7 @@ R"(
       genes.emplace_back(gene);
   }
 
-  // Run pipeline
-  for (const auto & patient_json : js["patient"]) {
-    auto patient = Patient::Patient{patient_json};
-
-    auto output_file = Path(args.output) / fmt::format("sherloc_{}.txt", patient.name);
+  auto open_output = [&args](const Path& output_file){
     auto os = std::ofstream(output_file);
     if (!os.is_open()) {
       fmt::print(std::cerr, "cannot open file `{}`\n", output_file.c_str());
@@ -213,36 +244,173 @@ R"(
       fmt::join(FileMaker::header_cols, "\t"),
       args.output_rule_tag ? "\trule_tag" : ""
     );
-    // run by chromosome
-    for(auto& this_chr : Attr::ChrMap::approved_chr){
-      BENCHMARK(fmt::format("run load chr{}", this_chr),
-        fm.load_chr(patient, this_chr), sw);
-      if(patient.sher_mems.empty()){
-        SPDLOG_WARN("Patient '{}' has no variant on chr{}, skipped",
-          patient.name, this_chr);
-        continue;
+    return os;
+  };
+  auto output_path = [&args](const std::string& name){
+    return Path(args.output) / fmt::format("sherloc_{}.txt", name);
+  };
+
+  // Run pipeline
+  for (const auto & patient_json : js["patient"]) {
+    auto patient = Patient::Patient{patient_json};
+
+    // decode the patient vcf once, each chromosome below consumes its own batch
+    BENCHMARK("ingest patient vcf", fm.ingest(patient), sw);
+
+    // a multi-sample vcf is annotated once, only the clinical tree (the genotype dependent one)
+    // and the output are run per sample, each sample has its own output file (kept open)
+    auto sample_patients = std::vector<Patient::Patient>{};
+    auto sample_outputs = std::vector<std::ofstream>{};
+    if(patient.is_cohort()){
+      SPDLOG_INFO("Patient vcf '{}' has {} samples, run in cohort mode",
+        patient.name, patient.samples.size());
+      for(auto sample = size_t{0}; sample < patient.samples.size(); ++sample){
+        auto& sample_patient = sample_patients.emplace_back(
+          FileMaker::make_sample_patient(patient_json, patient, sample));
+        sample_outputs.emplace_back(open_output(output_path(sample_patient.name)));
+      }
+    }
+
+    auto output_file = output_path(patient.name);
+    auto os = patient.is_cohort() ? std::ofstream{} : open_output(output_file);
+
+    // run by chromosome, as a pipeline of three stages on their own threads:
+    // load -> VEP -> trees and output. With one chromosome queued between the stages, VEP
+    // annotates chromosome k + 1 and chromosome k + 2 is loaded while chromosome k is
+    // classified and written. The chromosomes are written in order and released once written.
+    // Beyond the one being loaded, at most four chromosomes are in memory (one in each queue,
+    // the one waiting to enter the full `annotated` queue and the one classified). Only an
+    // opt-in `vep_min_batch` holds more, the chromosomes gathered for one VEP run.
+    auto loaded = BoundedQueue<ChrWork>{1};
+    auto annotated = BoundedQueue<ChrWork>{1};
+
+    auto loader = std::async(std::launch::async, [&]{
+      auto sw = spdlog::stopwatch{};
+      try{
+        for(auto& this_chr : Attr::ChrMap::approved_chr){
+          auto work = ChrWork{std::string{this_chr}};
+          BENCHMARK(fmt::format("run load chr{}", this_chr),
+            fm.load_chr(patient, this_chr, work.sher_mems, work.sample_calls), sw);
+          if(work.sher_mems.empty()){
+            SPDLOG_WARN("Patient '{}' has no variant on chr{}, skipped",
+              patient.name, this_chr);
+            continue;
+          }
+          if(!loaded.push(std::move(work))){
+            break;
+          }
+        }
+      }catch(...){
+        loaded.close();
+        annotated.close();
+        throw;
+      }
+      loaded.close();
+    });
+
+    auto annotator = std::async(std::launch::async, [&]{
+      auto sw = spdlog::stopwatch{};
+      // each chromosome is annotated by its own VEP run, unless `vep_min_batch` is set: a VEP
+      // launch takes tens of seconds, so the cache misses of consecutive chromosomes are then
+      // annotated by one VEP run once there are `vep_min_batch` of them
+      auto group = std::vector<ChrWork>{};
+      auto misses = size_t{0};
+      auto annotate_group = [&]{
+        BENCHMARK(fmt::format("run vep chr{}-{}", group.front().chr, group.back().chr), fm.run_vep(
+          patient.name, group, vep_output_dir, vep_runner, genes, vep_cache), sw);
+        for(auto& work : group){
+          if(!annotated.push(std::move(work))){
+            return false;
+          }
+        }
+        group.clear();
+        misses = 0;
+        return true;
+      };
+      try{
+        auto running = true;
+        while(running){
+          auto work = loaded.pop();
+          if(work){
+            misses += fm.find_cached(*work, vep_cache);
+            group.push_back(std::move(*work));
+          }
+          if(!group.empty() and (!work or misses == 0 or misses >= args.vep_min_batch)){
+            running = annotate_group();
+          }
+          running = running and work.has_value();
+        }
+      }catch(...){
+        loaded.close();
+        annotated.close();
+        throw;
       }
-      BENCHMARK("run vep", fm.run_vep(
-        patient, vep_output_dir, vep_runner, genes, this_chr, vep_cache), sw);
-
-      BENCHMARK("run population tree", population_tree.run(
-        patient, db, disease, special_case_list), sw);
-      BENCHMARK("run clinical tree", clinical_tree.run(
-        patient, disease, op), sw);
-      BENCHMARK("run variant_rule tree", variant_rule_tree.run(
-        patient, db, sher_conseq), sw);
-      BENCHMARK("run prediction tree", prediction_tree.run(
-        patient), sw);
-      
-      BENCHMARK("write to output file", fm.run_output(
-        patient, os, args.output_rule_tag), sw);
-      // release processed chr to reduce mem usage
-      BENCHMARK(fmt::format("clean up chr{}", this_chr),
-        patient.sher_mems.clear(), sw);
+      annotated.close();
+    });
+
+    try{
+      while(auto work = annotated.pop()){
+        auto& this_chr = work->chr;
+        patient.sher_mems = std::move(work->sher_mems);
+        patient.sample_calls = std::move(work->sample_calls);
+
+        BENCHMARK("run population tree", population_tree.run(
+          patient, db, disease, special_case_list), sw);
+        if(!patient.is_cohort()){
+          BENCHMARK("run clinical tree", clinical_tree.run(
+            patient, disease, op), sw);
+        }
+        BENCHMARK("run variant_rule tree", variant_rule_tree.run(
+          patient, db, sher_conseq), sw);
+        BENCHMARK("run prediction tree", prediction_tree.run(
+          patient), sw);
+        
+        if(!patient.is_cohort()){
+          BENCHMARK("write to output file", fm.run_output(
+            patient, os, args.output_rule_tag), sw);
+        }else{
+          // the clinical tree doesn't affect the variant_rule / prediction trees,
+          // so running it after them gives the same result as the single sample order
+          BENCHMARK("run clinical tree and output for each sample", {
+            for(auto sample = size_t{0}; sample < sample_patients.size(); ++sample){
+              auto& sample_patient = sample_patients[sample];
+              FileMaker::load_sample_chr(patient, sample, sample_patient);
+              if(sample_patient.sher_mems.empty()){
+                continue;
+              }
+              clinical_tree.run(sample_patient, disease, op);
+              fm.run_output(sample_patient, sample_outputs[sample], args.output_rule_tag);
+              sample_patient.sher_mems.clear();
+            }
+          }, sw);
+        }
+        // release processed chr to reduce mem usage
+        BENCHMARK(fmt::format("clean up chr{}", this_chr),
+          patient.sher_mems.clear(), sw);
+      }
+    }catch(...){
+      // stop the other stages before unwinding
+      loaded.close();
+      annotated.close();
+      loader.wait();
+      annotator.wait();
+      throw;
+    }
+    loader.get();
+    annotator.get();
+
+    if(patient.is_cohort()){
+      for(auto& sample_patient : sample_patients){
+        SPDLOG_INFO("Output file path: {}", output_path(sample_patient.name).c_str());
+      }
+    }else{
+      SPDLOG_INFO("Output file path: {}", output_file.c_str());
     }
-    SPDLOG_INFO("Output file path: {}", output_file.c_str());
     SPDLOG_INFO("Patient {} done.", patient.name);
   }
+  if(!db.is_remote()){
+    db.db_gnom.get_cache().log_stats("gnomAD");
+  }
 
 }
 
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+#include <Sherloc/Patient/chr_batch.hpp>
+#include <Sherloc/sherloc_member.hpp>
+
+namespace Sherloc::app::sherloc {
+
+/**
+ * @brief FIFO between two pipeline stages, holding at most `capacity` items
+ *
+ * `push` blocks while the queue is full, `pop` while it is empty. After `close` the
+ * pushes fail and the pops drain the queue then return `nullopt`, a stage closes its
+ * output queue when it's done (or fails) so the next stage stops too.
+ */
+template<class T>
+class BoundedQueue {
+private:
+  std::deque<T> items;
+  size_t capacity;
+  bool closed = false;
+  std::mutex mutex;
+  std::condition_variable not_full;
+  std::condition_variable not_empty;
+
+public:
+  explicit BoundedQueue(size_t capacity): capacity(std::max(capacity, size_t{1})) {}
+
+  /**
+   * @brief Append an item, false (the item is dropped) if the queue is closed
+   */
+  bool push(T item){
+    auto lock = std::unique_lock{mutex};
+    not_full.wait(lock, [this]{ return closed or items.size() < capacity; });
+    if(closed){
+      return false;
+    }
+    items.emplace_back(std::move(item));
+    not_empty.notify_one();
+    return true;
+  }
+
+  std::optional<T> pop(){
+    auto lock = std::unique_lock{mutex};
+    not_empty.wait(lock, [this]{ return closed or !items.empty(); });
+    if(items.empty()){
+      return std::nullopt;
+    }
+    auto item = std::move(items.front());
+    items.pop_front();
+    not_full.notify_one();
+    return item;
+  }
+
+  void close(){
+    auto lock = std::lock_guard{mutex};
+    closed = true;
+    not_full.notify_all();
+    not_empty.notify_all();
+  }
+};
+
+/**
+ * @brief The alleles of one chromosome of a patient moving through the pipeline stages
+ */
+struct ChrWork {
+  std::string chr;
+  std::vector<SherlocMember> sher_mems;
+  std::vector<std::vector<Patient::SampleCall>> sample_calls;
+  std::vector<bool> cache_hits; // the alleles found in the VEP cache, see `FileMaker::find_cached`
+};
+
+}
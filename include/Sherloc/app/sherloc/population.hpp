@@ -6,6 +6,8 @@
 #include <Sherloc/disease_database.hpp>
 #include <Sherloc/app/sherloc/sherloc_parameter.hpp>
 #include <string>
+#include <exception>
+#include <omp.h>
 #include <spdlog/spdlog.h>
 
 namespace Sherloc::app::sherloc {
@@ -116,7 +118,7 @@ public:
     // exac status 2: AN < 15000
     // Use 1kg AF instead
     if (exac.status == '2') {
-      auto af = db.db_1kg.find(sher_mem);
+      auto af = db.find_1kg(sher_mem);
 
       // <0 stands for no result
       if(af < 0.)
@@ -245,127 +247,156 @@ public:
           , const std::vector< SpecialCase >& special_cases
   ) {
     decltype(auto) para = SherlocParameter::get_paras();
-    for (auto& sher_mem : sher.sher_mems) {
-      auto clinvar_opt = db.db_clinvar.find(sher_mem);
-      auto dvd_opt = db.db_dvd.find(sher_mem);
+    // the lookups of the members are done up front, one merge per database,
+    // the gnomAD chunks are decoded in parallel
+    db.prefetch(sher.sher_mems, para.thread_num);
 
-      // inheritance patterns for each variants
-      auto gene_info_inhe_patts = db.db_gene_info.find(sher_mem);
-      SPDLOG_DEBUG("geneinfo inhe: {}", std::string_view{
-        std::begin(gene_info_inhe_patts),
-        std::end(gene_info_inhe_patts)
-      });
+    // each member only writes itself and the db lookups are thread safe, so the members
+    // are evaluated in parallel. Exceptions can't leave the omp loop, keep the first one
+    auto error = std::exception_ptr{};
+    auto& sher_mems = sher.sher_mems;
+    #pragma omp parallel for schedule(dynamic, 256) num_threads(std::max(1, para.thread_num))
+    for (size_t mem_idx = 0; mem_idx < sher_mems.size(); ++mem_idx) {
+      try {
+        run_one(para, sher_mems[mem_idx], db, disease, special_cases);
+      } catch (...) {
+        #pragma omp critical(population_error)
+        if (!error) error = std::current_exception();
+      }
+    }
+    db.release_prefetch();
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
 
-      auto dvd_genes = std::set<std::string>{};
-      auto dvd_pathogenic = false, dvd_benign = false;
-      auto clinvar_genes = std::set<std::string>{};
-      auto clinvar_pathogenic = false, clinvar_benign = false;
+private:
+  void run_one(
+          const SherlocParameter& para
+          , SherlocMember& sher_mem
+          , DB::DBSet& db
+          , const Disease& disease
+          , const std::vector< SpecialCase >& special_cases
+  ) {
+    auto clinvar_opt = db.find_clinvar(sher_mem);
+    auto dvd_opt = db.find_dvd(sher_mem);
 
-      if(dvd_opt.has_value()){
-        auto& dvd = dvd_opt.value();
-        sher_mem.onset = sher_mem.onset or dvd.onset;
-        sher_mem.severe = sher_mem.onset or dvd.severe;
-        sher_mem.dvd_clnsig = dvd.clnsig;
-        if(!dvd.gene_symbol.empty()){
-          dvd_genes.emplace(dvd.gene_symbol);
-        }
+    // inheritance patterns for each variants
+    auto gene_info_inhe_patts = db.find_gene_info(sher_mem);
+    SPDLOG_DEBUG("geneinfo inhe: {}", std::string_view{
+      std::begin(gene_info_inhe_patts),
+      std::end(gene_info_inhe_patts)
+    });
 
-        dvd_pathogenic = dvd.consequence;
-        dvd_benign = dvd.benign;
+    auto dvd_genes = std::set<std::string>{};
+    auto dvd_pathogenic = false, dvd_benign = false;
+    auto clinvar_genes = std::set<std::string>{};
+    auto clinvar_pathogenic = false, clinvar_benign = false;
+
+    if(dvd_opt.has_value()){
+      auto& dvd = dvd_opt.value();
+      sher_mem.onset = sher_mem.onset or dvd.onset;
+      sher_mem.severe = sher_mem.onset or dvd.severe;
+      sher_mem.dvd_clnsig = dvd.clnsig;
+      if(!dvd.gene_symbol.empty()){
+        dvd_genes.emplace(dvd.gene_symbol);
       }
 
-      if(clinvar_opt.has_value()){
-        auto& clinvar = clinvar_opt.value();
-        sher_mem.onset = sher_mem.onset or clinvar.onset;
-        sher_mem.severe = sher_mem.onset or clinvar.severe;
-        sher_mem.clinvar_clnsig = clinvar.clnsig;
-        sher_mem.clinvar_geneinfo = clinvar.geneinfo;
-        sher_mem.clinvar_allele_id = clinvar.allele_id;
-        sher_mem.clinvar_star = clinvar.star;
-        sher_mem.codon = clinvar.codon;
+      dvd_pathogenic = dvd.consequence;
+      dvd_benign = dvd.benign;
+    }
 
-        auto gene_vec = clinvar.get_genes();
-        clinvar_genes = std::set(gene_vec.begin(), gene_vec.end());
+    if(clinvar_opt.has_value()){
+      auto& clinvar = clinvar_opt.value();
+      sher_mem.onset = sher_mem.onset or clinvar.onset;
+      sher_mem.severe = sher_mem.onset or clinvar.severe;
+      sher_mem.clinvar_clnsig = clinvar.clnsig;
+      sher_mem.clinvar_geneinfo = clinvar.geneinfo;
+      sher_mem.clinvar_allele_id = clinvar.allele_id;
+      sher_mem.clinvar_star = clinvar.star;
+      sher_mem.codon = clinvar.codon;
 
-        clinvar_pathogenic = clinvar.consequence;
-        clinvar_benign = clinvar.benign;
-      }
+      auto gene_vec = clinvar.get_genes();
+      clinvar_genes = std::set(gene_vec.begin(), gene_vec.end());
 
-      SPDLOG_DEBUG("DVD GENES: {}", fmt::join(dvd_genes, "|"));
-      SPDLOG_DEBUG("CLINVAR GENES: {}", fmt::join(clinvar_genes, "|"));
+      clinvar_pathogenic = clinvar.consequence;
+      clinvar_benign = clinvar.benign;
+    }
 
-      // set each variants inheritance patterns and sources
-      auto& vars = sher_mem.variants;
-      auto& sher_mem_patt = 
-        sher_mem.inheritance_patterns = std::vector<char>(vars.size(), 'U');
-      auto& sher_mem_src = 
-        sher_mem.inheritance_pattern_sources = std::vector<std::string>(vars.size());
-      sher_mem.clinvar_valid = std::vector<bool>(vars.size(), false);
-      sher_mem.dvd_valid = std::vector<bool>(vars.size(), false);
-      for(int idx = 0; idx < vars.size(); ++idx){
-        if (dvd_genes.contains(vars[idx].gene_name)){
-          sher_mem.dvd_valid[idx] = true;
-          if (sher_mem_patt[idx] == 'U') {
-            sher_mem_patt[idx] = dvd_opt->adar;
-            sher_mem_src[idx] = "DVD";
-          }
-          if (dvd_pathogenic)
-            vars[idx].add_rule(215);
-          if (dvd_benign)
-            vars[idx].add_rule(216);
-        }
-        
-        if (clinvar_genes.contains(vars[idx].gene_name)) {
-          sher_mem.clinvar_valid[idx] = true;
-          if (sher_mem_patt[idx] == 'U') {
-            sher_mem_patt[idx] = clinvar_opt->adar;
-            sher_mem_src[idx] = "ClinVar";
-          }
-          if (clinvar_pathogenic)
-            vars[idx].add_rule(213);
-          if (clinvar_benign)
-            vars[idx].add_rule(214);
+    SPDLOG_DEBUG("DVD GENES: {}", fmt::join(dvd_genes, "|"));
+    SPDLOG_DEBUG("CLINVAR GENES: {}", fmt::join(clinvar_genes, "|"));
+
+    // set each variants inheritance patterns and sources
+    auto& vars = sher_mem.variants;
+    auto& sher_mem_patt = 
+      sher_mem.inheritance_patterns = std::vector<char>(vars.size(), 'U');
+    auto& sher_mem_src = 
+      sher_mem.inheritance_pattern_sources = std::vector<std::string>(vars.size());
+    sher_mem.clinvar_valid = std::vector<bool>(vars.size(), false);
+    sher_mem.dvd_valid = std::vector<bool>(vars.size(), false);
+    for(int idx = 0; idx < vars.size(); ++idx){
+      if (dvd_genes.contains(vars[idx].gene_name)){
+        sher_mem.dvd_valid[idx] = true;
+        if (sher_mem_patt[idx] == 'U') {
+          sher_mem_patt[idx] = dvd_opt->adar;
+          sher_mem_src[idx] = "DVD";
         }
-        
-        if (gene_info_inhe_patts[idx] != 'U') {
-          if (sher_mem_patt[idx] == 'U') {
-            sher_mem_patt[idx] = gene_info_inhe_patts[idx];
-            sher_mem_src[idx] = "GeneInfo";
-          }
+        if (dvd_pathogenic)
+          vars[idx].add_rule(215);
+        if (dvd_benign)
+          vars[idx].add_rule(216);
+      }
+      
+      if (clinvar_genes.contains(vars[idx].gene_name)) {
+        sher_mem.clinvar_valid[idx] = true;
+        if (sher_mem_patt[idx] == 'U') {
+          sher_mem_patt[idx] = clinvar_opt->adar;
+          sher_mem_src[idx] = "ClinVar";
         }
-        
-        // fallback
+        if (clinvar_pathogenic)
+          vars[idx].add_rule(213);
+        if (clinvar_benign)
+          vars[idx].add_rule(214);
+      }
+      
+      if (gene_info_inhe_patts[idx] != 'U') {
         if (sher_mem_patt[idx] == 'U') {
-          sher_mem_src[idx] = "None";
+          sher_mem_patt[idx] = gene_info_inhe_patts[idx];
+          sher_mem_src[idx] = "GeneInfo";
         }
       }
+      
+      // fallback
+      if (sher_mem_patt[idx] == 'U') {
+        sher_mem_src[idx] = "None";
+      }
+    }
 
-      // FIXME: use one of the adar for now, but this variable should be deprecated
-      // instead, use different adar for different variant
-      sher_mem.inheritance_pattern = (
-        dvd_opt.has_value() ?
-          dvd_opt->adar :
-          (clinvar_opt.has_value() ?
-            clinvar_opt->adar :
-            'U'
-          )
-      );
+    // FIXME: use one of the adar for now, but this variable should be deprecated
+    // instead, use different adar for different variant
+    sher_mem.inheritance_pattern = (
+      dvd_opt.has_value() ?
+        dvd_opt->adar :
+        (clinvar_opt.has_value() ?
+          clinvar_opt->adar :
+          'U'
+        )
+    );
 
-      bool is_special_case = false;
-      for (const auto & sc : special_cases) {
-        if (sher_mem.chr==sc.chr and sher_mem.pos==sc.pos and sher_mem.ref==sc.ref and sher_mem.alt==sc.alt) {
-          is_special_case = true;
-          break;
-        }
+    bool is_special_case = false;
+    for (const auto & sc : special_cases) {
+      if (sher_mem.chr==sc.chr and sher_mem.pos==sc.pos and sher_mem.ref==sc.ref and sher_mem.alt==sc.alt) {
+        is_special_case = true;
+        break;
       }
-      if (is_special_case) continue;
-      
-      auto exac = db.db_gnom.find(sher_mem);
-      auto coverage = db.db_coverage.find(sher_mem);
-      sher_mem.gnomAD_status = exac.status;
-      set_freq(para, sher_mem, db, disease, exac, coverage);
-      set_hom(para, sher_mem, db, exac, coverage);
     }
+    if (is_special_case) return;
+    
+    auto exac = db.find_gnom(sher_mem);
+    auto coverage = db.find_coverage(sher_mem);
+    sher_mem.gnomAD_status = exac.status;
+    set_freq(para, sher_mem, db, disease, exac, coverage);
+    set_hom(para, sher_mem, db, exac, coverage);
   }
 };
 
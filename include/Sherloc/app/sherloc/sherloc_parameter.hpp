@@ -38,6 +38,7 @@ class SherlocParameter
 
     // for runtime options
     bool use_exist_vep_output = false;
+    bool vep_cache_write_back = false;
 
     // for rule filtering
     bool filter_rules = false;
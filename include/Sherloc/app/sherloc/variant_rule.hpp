@@ -129,12 +129,12 @@ class VariantRule {
         return lof;
     }
 
-    inline bool is_snv(const DB::Clinvar& var){
+    inline bool is_snv(const DB::ClinvarView& var){
         return 
-            var.ref != "-" and 
-            var.alt != "-" and 
-            var.ref.size() == 1 and 
-            var.alt.size() == 1;
+            var.ref() != "-" and 
+            var.alt() != "-" and 
+            var.ref().size() == 1 and 
+            var.alt().size() == 1;
     };
 
     void go_null( SherlocMember& sher_mem
@@ -303,24 +303,24 @@ class VariantRule {
                 &DB::DataBaseClinvar::AA_proj
             );
 
-        for(auto v : reported_variants_in_same_aa){
-            if(v and is_snv(*v)){
-                auto clinvar_var_codon = uniprot.get_codon( v->codon );
-                if(v->consequence){
+        for(auto& v : reported_variants_in_same_aa){
+            if(is_snv(v)){
+                auto clinvar_var_codon = uniprot.get_codon( std::string{v.codon()} );
+                if(v.consequence()){
                     if(variant.codon == clinvar_var_codon){ // [[exact same amino acid change]]
                         variant.add_rule( 18 );
                         variant.add_tag(HOLMES_MAKE_TAG(vm0));
                         use_rule44_if_no_rule18 = false;
                         break;
                     }else{
-                        SPDLOG_CRITICAL("Clinvar Allele: ref{}, alt{}", v->ref, v->alt);
+                        SPDLOG_CRITICAL("Clinvar Allele: ref{}, alt{}", v.ref(), v.alt());
                         SPDLOG_CRITICAL("Rule 44: clinvar id {} codon: {}, uniprot: {}", 
-                            v->allele_id, clinvar_var_codon, v->codon);
+                            v.allele_id(), clinvar_var_codon, v.codon());
                         use_rule44_if_no_rule18 = true; // different missense changes at this codon
                     }
                 }
 
-                if(v->benign){ // FIXME: maybe need to check the AF, should above high
+                if(v.benign()){ // FIXME: maybe need to check the AF, should above high
                     if(
                         // FIXME: should also be a "different nucleotide substitution"
                         // current implementation of DBClinvar is kinda poor
@@ -381,10 +381,10 @@ class VariantRule {
             );
 
         int patho_count = 0, benign_count = 0;
-        for(auto v : reported_variants_in_same_region){
-            if(v and is_snv(*v)){ // only use for missense change
-                if(v->consequence) ++patho_count;
-                if(v->benign) ++benign_count;
+        for(auto& v : reported_variants_in_same_region){
+            if(is_snv(v)){ // only use for missense change
+                if(v.consequence()) ++patho_count;
+                if(v.benign()) ++benign_count;
             }
         }
 
@@ -558,25 +558,11 @@ class VariantRule {
             sher_mem.alt.size() == 1
         );
         if (sher_mem_is_snv){
-            const auto& clinvar = db.db_clinvar;
-            auto it_chr = clinvar.chr2vec.find(Attr::ChrMap::chr2idx(sher_mem.chr));
-            if (it_chr != clinvar.chr2vec.end()){
-                auto& vec = it_chr->second;
-
-                auto [s_it, e_it] = std::ranges::equal_range(
-                    vec,
-                    sher_mem.pos,
-                    {},
-                    &DB::DataBaseClinvar::PosClinvar::first
-                );
-
-                // check if any pathogenic variant at the same position in ClinVar is also SNV
-                for(auto it = s_it; it != e_it; ++it){
-                    auto& clinvar_variant = it->second;
-                    if (is_snv(clinvar_variant) and clinvar_variant.consequence){
-                        sher_mem.add_rule(139);
-                        break;
-                    }
+            // check if any pathogenic variant at the same position in ClinVar is also SNV
+            for(auto& clinvar_variant : db.db_clinvar.find_at(sher_mem.chr, sher_mem.pos)){
+                if (is_snv(clinvar_variant) and clinvar_variant.consequence()){
+                    sher_mem.add_rule(139);
+                    break;
                 }
             }
         }
@@ -15,7 +15,11 @@ namespace Sherloc::app::vep_cache_builder {
 
 struct Parameters {
   bool grch37 = false;
+  bool parsed = false;
+  bool compact = false;
   int thread_num;
+  int io_threads;
+  size_t block_rows;
   std::string vepfile;
   std::string output;
   std::string vepconfig;
@@ -29,7 +33,7 @@ public:
     po::options_description desc("Allowed options");
     desc.add_options()("help,h", "show help message")
         ("input,i", po::value<std::string>(&vepfile)->
-            required(), "input vep annotation file")
+            default_value(""), "input vep annotation file")
         ("output,o", po::value<std::string>(&output)->
             default_value("/tmp/vep_cache/"),
             "output vep cache archive dirname, this dir will end up containing all the `chr.arc` file")
@@ -37,7 +41,15 @@ public:
             default_value(""),
             "vep config file for running vep. If not specified, will assume the `--input` file is already annotated.")
         ("thread_num,t", po::value< int >(&thread_num)->default_value(1), "Thread num (for VEP)")
+        ("io_threads", po::value< int >(&io_threads)->default_value(0),
+            "Threads for decompressing the bgzipped input (0: no extra thread)")
+        ("block_rows", po::value< size_t >(&block_rows)->default_value(Sherloc::DB::VEP::default_block_rows),
+            "Alleles per compressed block, a query decompresses only the blocks it hits")
         ("grch37", po::bool_switch(&grch37), "Use grch37 coordinate")
+        ("parsed", po::bool_switch(&parsed),
+            "Also store the parsed annotations, cache hits then skip parsing the CSQ strings (larger cache)")
+        ("compact", po::bool_switch(&compact),
+            "Fold the alleles written back by `sherloc --vep_cache_write_back` into the cache in `--output`")
         ;
 
     po::store(po::parse_command_line(argc, argv, desc), vm);
@@ -48,6 +60,11 @@ public:
     }
 
     po::notify(vm);
+
+    if (vepfile.empty() and !compact) {
+      std::cerr << "the option '--input' is required unless '--compact'\n" << desc << std::endl;
+      std::exit(1);
+    }
   }
 };
 
@@ -72,8 +89,19 @@ void Run(const GetParameters &args) {
     // TODO:
     using namespace Sherloc::DB;
     spdlog::stopwatch sw;
+    HTSThreadPool::get().init(args.io_threads);
     VEP cache;
 
+    if (args.compact){
+      SPDLOG_INFO("Compacting VEP cache {}...", args.output);
+      sw.reset();
+      cache.load(args.output);
+      cache.set_block_rows(args.block_rows);
+      cache.compact();
+      SPDLOG_INFO("Compacting takes {} sec.", sw);
+      return;
+    }
+
     Path annotated_vcf{args.vepfile};
     auto to_run_vep = !args.vepconfig.empty();
 
@@ -84,6 +112,8 @@ void Run(const GetParameters &args) {
     SPDLOG_INFO("Parsing & Saving VEP VCF...");
     sw.reset();
     cache.set_output_dir(args.output);
+    cache.set_store_parsed(args.parsed);
+    cache.set_block_rows(args.block_rows);
     cache.from(annotated_vcf);
     SPDLOG_INFO("Parsing & Saving takes {} sec.", sw);
 
@@ -65,50 +65,65 @@ void Run(const GetParameters &args) {
     fmt::print(output_tsv, "# vep header: {}\n", vep_header);
     fmt::print(output_tsv, "{}\n", tsv_header);
 
-    auto vcf_status = HTS_VCF::VCF_Status{};
     auto previous_skipped_chr = ""s;
     int line_id = 0;
-    while((vcf_status = input_vcf.parse_line()) != HTS_VCF::VCF_Status::VCF_EOF){
-      ++line_id;
-      switch (vcf_status) {
-        using enum HTS_VCF::VCF_Status;
-        case OK:
-          break;
-        case RECORD_NO_ALT:
-          SPDLOG_WARN("vcf record line id: #{} (1-based) has no alt, skip it.", line_id);
+    auto query_records = [&](){
+      auto vcf_status = HTS_VCF::VCF_Status{};
+      while((vcf_status = input_vcf.parse_line()) != HTS_VCF::VCF_Status::VCF_EOF){
+        ++line_id;
+        switch (vcf_status) {
+          using enum HTS_VCF::VCF_Status;
+          case OK:
+            break;
+          case RECORD_NO_ALT:
+            SPDLOG_WARN("vcf record line id: #{} (1-based) has no alt, skip it.", line_id);
+            continue;
+          default:
+            SPDLOG_ERROR("HTS_VCF parsing error, status code: {}", int(vcf_status));
+            exit(1);
+        }
+        auto& rec = input_vcf.record;
+        auto normed_chr = ""s;
+        try{
+          normed_chr = Attr::ChrMap::norm_chr(rec.chr);
+        } catch (std::out_of_range& e){
+          if(normed_chr != previous_skipped_chr){
+            SPDLOG_WARN("Skip seq: '{}', this chromosome is not acceptable", rec.chr);
+            previous_skipped_chr = normed_chr;
+          }
           continue;
-        default:
-          SPDLOG_ERROR("HTS_VCF parsing error, status code: {}", int(vcf_status));
-          exit(1);
-      }
-      auto& rec = input_vcf.record;
-      auto normed_chr = ""s;
-      try{
-        normed_chr = Attr::ChrMap::norm_chr(rec.chr);
-      } catch (std::out_of_range& e){
-        if(normed_chr != previous_skipped_chr){
-          SPDLOG_WARN("Skip seq: '{}', this chromosome is not acceptable", rec.chr);
-          previous_skipped_chr = normed_chr;
         }
-        continue;
-      }
 
 
-      SherlocMember new_member(normed_chr, rec.pos, rec.ref, rec.alt);
-      auto result_it = cache.find(new_member);
+        SherlocMember new_member(normed_chr, rec.pos, rec.ref, rec.alt);
+        auto result = cache.find(new_member);
 
-      fmt::print(
-        output_tsv,
-        "{}\t{}\t{}\t{}\t{}\n",
-        rec.chr,
-        rec.pos,
-        rec.ref,
-        rec.alt,
-        (result_it.has_value() ? *(result_it.value()) : ""s)
-      );
+        fmt::print(
+          output_tsv,
+          "{}\t{}\t{}\t{}\t{}\n",
+          rec.chr,
+          rec.pos,
+          rec.ref,
+          rec.alt,
+          result.value_or(""sv)
+        );
+      }
+    };
+
+    if(input_vcf.has_index()){
+      // query chromosome by chromosome, so each cache table is loaded only once
+      // and each chromosome only costs its own bytes,
+      // the sequences are visited in the index order so the output keeps the file order
+      SPDLOG_INFO("Input vcf is indexed, query by chromosome.");
+      for(auto& seq : input_vcf.index_seqnames()){
+        if(input_vcf.query(seq)){
+          query_records();
+        }
+      }
+    }else{
+      query_records();
     }
 
-
     return;
 }
 
@@ -87,6 +87,21 @@ public:
     return feature.substr(0, feature.find('.'));
   }
 
+  // VEP columns forwarded as they are in `extra_info`
+  static inline const std::vector<std::string> extra_info_cols = {
+    "SIFT",
+    "PolyPhen",
+    "REVEL",
+    "CADD_PHRED",
+    "VARIANT_CLASS",
+    "HGNC_ID",
+    "MANE_SELECT",
+    "MANE_PLUS_CLINICAL",
+    "CANONICAL",
+    "MaxEntScan_diff",
+    "pLI_gene_value"
+  };
+
   Variant() = default;
 
   Variant(
@@ -98,20 +113,6 @@ public:
     static constexpr auto pipe_delimiter = Attr::delimiter('|');
     // vep VCF output format will replace ',' with '&'
     static constexpr auto and_delimiter  = Attr::delimiter('&');
-    static const std::vector<std::string> extra_info_cols = {
-      "SIFT",
-      "PolyPhen",
-      "REVEL",
-      "CADD_PHRED",
-      "VARIANT_CLASS",
-      "HGNC_ID",
-      "MANE_SELECT",
-      "MANE_PLUS_CLINICAL",
-      "CANONICAL",
-      "MaxEntScan_diff",
-      "pLI_gene_value"
-    };
-
     std::vector<std::string> entry;
     boost::split(entry, vep_record, pipe_delimiter);
     entry.emplace_back(""); // for unknown col
@@ -0,0 +1,9 @@
+#include <iostream> 
+#include <Sherloc/app/holmes_dbd/main.hpp>
+
+int main( int argc, const char* argv[] )
+{
+    Sherloc::app::holmes_dbd::GetParameters parameters( argc, argv );    
+    Sherloc::app::holmes_dbd::Run( parameters );
+    return 0;
+}
@@ -1,9 +1,19 @@
+#include <exception>
 #include <iostream> 
 #include <Sherloc/app/sherloc/main.hpp>
+#include <spdlog/spdlog.h>
 
 int main( int argc, const char* argv[] )
 {
-    Sherloc::app::sherloc::GetParameters parameters( argc, argv );    
-    Sherloc::app::sherloc::Run( parameters );
+    try
+    {
+        Sherloc::app::sherloc::GetParameters parameters( argc, argv );    
+        Sherloc::app::sherloc::Run( parameters );
+    }
+    catch( const std::exception& e )
+    {
+        SPDLOG_ERROR( "sherloc: {}", e.what() );
+        return 1;
+    }
     return 0;
 }
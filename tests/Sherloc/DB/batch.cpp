@@ -0,0 +1,113 @@
+#include <catch/catch.hpp>
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+#include <Sherloc/DB/batch.hpp>
+#include <Sherloc/DB/k.hpp>
+#include <Sherloc/DB/coverage.hpp>
+#include <Sherloc/sherloc_member.hpp>
+
+TEST_CASE("GallopCursor equal ranges"){
+  using namespace Sherloc::DB;
+
+  auto gen = std::mt19937{42};
+  auto values = std::vector<unsigned>(5000);
+  for(auto& value : values){
+    value = gen() % 20000;
+  }
+  std::ranges::sort(values);
+
+  SECTION("sorted keys"){
+    auto keys = std::vector<unsigned>(800);
+    for(auto& key : keys){
+      key = gen() % 21000;
+    }
+    std::ranges::sort(keys);
+
+    auto cursor = GallopCursor(values);
+    for(auto key : keys){
+      auto expected = std::ranges::equal_range(values, key);
+      auto got = cursor.equal_range(key);
+      CHECK(got.begin() == expected.begin());
+      CHECK(got.end() == expected.end());
+    }
+  }
+
+  SECTION("keys going backwards"){
+    auto cursor = GallopCursor(values);
+    for(auto key : {15000u, 300u, 300u, 19999u, 0u, 7000u, 6999u}){
+      auto expected = std::ranges::equal_range(values, key);
+      auto got = cursor.equal_range(key);
+      CHECK(got.begin() == expected.begin());
+      CHECK(got.end() == expected.end());
+    }
+  }
+}
+
+TEST_CASE("K find_batch matches find"){
+  using namespace Sherloc;
+  using namespace Sherloc::DB;
+
+  auto k = K{};
+  for(auto pos : {10u, 10u, 20u, 35u}){
+    k.db_vec_snp.push_back(pos);
+  }
+  for(auto alt : {'A', 'G', 'T', 'C'}){
+    k.db_vec_snp_alt.push_back(alt);
+  }
+  k.db_vec_snp_status = std::vector<K::StatusType>{0.1f, 0.2f, 0.3f, 0.4f};
+  k.db_vec_ins.push_back(15);
+  k.db_vec_ins.push_back(40);
+  k.db_vec_ins_alt.emplace_back("AT");
+  k.db_vec_ins_alt.emplace_back("G");
+  k.db_vec_ins_status = std::vector<K::StatusType>{0.5f, 0.6f};
+  k.db_vec_del.push_back(20);
+  k.db_vec_del_ref.emplace_back("CC");
+  k.db_vec_del_status = std::vector<K::StatusType>{0.7f};
+
+  auto sher_mems = std::vector<SherlocMember>{
+    {"1", 5, "A", "T"},
+    {"1", 10, "C", "G"},
+    {"1", 15, "-", "AT"},
+    {"1", 20, "CC", "-"},
+    {"1", 20, "A", "T"},
+    {"1", 35, "A", "G"},
+    {"1", 40, "-", "G"},
+    {"1", 41, "A", "C"},
+  };
+  auto batch = k.find_batch(sher_mems);
+  REQUIRE(batch.size() == sher_mems.size());
+  for(size_t idx = 0; idx < sher_mems.size(); ++idx){
+    CHECK(batch[idx] == k.find(sher_mems[idx]));
+  }
+  CHECK(batch[1] == Approx(0.2f));
+  CHECK(batch[3] == Approx(0.7f));
+  CHECK(batch[6] == Approx(0.6f));
+}
+
+TEST_CASE("Coverage find_batch matches find"){
+  using namespace Sherloc;
+  using namespace Sherloc::DB;
+
+  auto cov = DataBaseCoverage{};
+  auto cov_vec = std::vector<Coverage>{};
+  cov_vec.emplace_back(0, '0');
+  for(size_t pos = 1; pos < 2000; pos += 7){
+    cov_vec.emplace_back(pos, static_cast<char>('0' + pos % 4));
+  }
+  cov.db_map.emplace_back(std::begin(cov_vec), std::end(cov_vec));
+
+  auto sher_mems = std::vector<SherlocMember>{};
+  for(size_t pos : {0, 1, 2, 8, 8, 9, 64, 65, 900, 1999, 2500, 3}){ // the last one goes back
+    sher_mems.emplace_back("1", pos, "A", "T");
+  }
+  auto batch = cov.find_batch(sher_mems);
+  REQUIRE(batch.size() == sher_mems.size());
+  for(size_t idx = 0; idx < sher_mems.size(); ++idx){
+    CHECK(batch[idx].pos == cov.find(sher_mems[idx]).pos);
+    CHECK(batch[idx].status == cov.find(sher_mems[idx]).status);
+  }
+}
@@ -27,13 +27,17 @@ TEST_CASE("Test ClinVar"){
   {
     auto clinvar_loaded = DataBaseClinvar{};
     clinvar_loaded.load(clinvar_tmp_arc);
-    CHECK(clinvar_loaded.chr2vec.size() == clinvar.chr2vec.size());
-    CHECK(clinvar_loaded.clinvar_id2index.size() == clinvar.clinvar_id2index.size());
+    CHECK(clinvar_loaded.chr2table.size() == clinvar.chr2table.size());
+    CHECK(clinvar_loaded.strings.size() == clinvar.strings.size());
+    CHECK(clinvar_loaded.id_index.size() == clinvar.id_index.size());
+    auto loaded_record = clinvar_loaded.find(size_t{2352466});
+    REQUIRE(loaded_record.has_value());
+    CHECK(loaded_record->allele_id == 2336495);
     CHECK(clinvar_loaded.txp_map.size() == clinvar.txp_map.size());
   }
 
-  for(auto& [chr, vec] : clinvar.chr2vec){
-    CHECK(std::ranges::is_sorted(vec, {}, &DataBaseClinvar::PosClinvar::first));
+  for(auto& [chr, table] : clinvar.chr2table){
+    CHECK(std::ranges::is_sorted(table.alleles.positions));
   }
 
   SECTION("Pathogenic case"){
@@ -95,6 +99,16 @@ TEST_CASE("Test ClinVar"){
     REQUIRE_FALSE(not_found_case.has_value());
   }
 
+  SECTION("ClinVar ID case"){
+    // record:
+    // 5	1296371	375479	A	G	.	.	ALLELEID=362290;...
+    auto by_id = clinvar.find(size_t{375479});
+    REQUIRE(by_id.has_value());
+    CHECK(by_id->allele_id == 362290);
+    CHECK(clinvar.view(size_t{375479})->allele_id() == 362290);
+    CHECK_FALSE(clinvar.find(size_t{1}).has_value());
+  }
+
   SECTION("Deletion case"){
     // record:
     // 1	1703608	1810316	CT	C	.	.	ALLELEID=1867317;CLNDISDB=MedGen:CN517202;CLNDN=not_provided;CLNHGVS=NC_000001.11:g.1703609del;CLNREVSTAT=no_assertion_provided;CLNSIG=not_provided;CLNVC=Deletion;CLNVCSO=SO:0000159;GENEINFO=CDK11A:728642;MC=SO:0001589|frameshift_variant,SO:0001619|non-coding_transcript_variant;ORIGIN=1
@@ -111,4 +125,105 @@ TEST_CASE("Test ClinVar"){
     CHECK_FALSE(del_case->benign);
     CHECK(del_case->clnsig == "NOT_PROVIDED");
   }
-}
\ No newline at end of file
+
+  SECTION("Batch lookup"){
+    // the records of the sections above and misses, grouped by chromosome and sorted by position
+    auto sher_mems = std::vector<Sherloc::SherlocMember>{
+      {"1", 1000, "A", "T"},
+      {"1", 1703609, "T", "-"},
+      {"4", 87616081, "-", "GCAGCGACAGCAGTGATAGCAGTGACAGCAGTGATAGCAGCGATAGCAGTGACAGCAGCG"},
+      {"5", 143134, "G", "A"},
+      {"5", 143134, "G", "C"},
+      {"5", 1296371, "A", "G"},
+      {"5", 1296371, "A", "G"},
+      {"22", 1000, "A", "T"}
+    };
+    auto batch = clinvar.find_batch(sher_mems);
+    REQUIRE(batch.size() == sher_mems.size());
+    auto hits = 0;
+    for(size_t idx = 0; idx < sher_mems.size(); ++idx){
+      auto expected = clinvar.find(sher_mems[idx]);
+      REQUIRE(batch[idx].has_value() == expected.has_value());
+      if(expected.has_value()){
+        CHECK(batch[idx]->allele_id == expected->allele_id);
+        CHECK(batch[idx]->clnsig == expected->clnsig);
+        ++hits;
+      }
+    }
+    CHECK(hits == 5);
+  }
+}
+TEST_CASE("ClinVar ID index"){
+  using namespace Sherloc::DB;
+
+  auto entries = std::vector<ClinvarIdIndex::Entry>{};
+  for(uint64_t id = 0; id < 5000; ++id){
+    entries.emplace_back(id * 3 + 1, id % 24, id);
+  }
+  entries.emplace_back(4, 7, 99999); // repeated ID, the first is kept
+  auto index = ClinvarIdIndex{};
+  index.build(entries);
+  CHECK(index.size() == 5000);
+
+  for(uint64_t id = 0; id < 5000; ++id){
+    auto location = index.find(id * 3 + 1);
+    REQUIRE(location.has_value());
+    REQUIRE(location->first == id % 24);
+    REQUIRE(location->second == id);
+    REQUIRE_FALSE(index.find(id * 3 + 2).has_value());
+  }
+  CHECK_FALSE(ClinvarIdIndex{}.find(1).has_value());
+}
+
+TEST_CASE("ClinVar table round trip of a record"){
+  using namespace Sherloc::DB;
+
+  auto strings = InternedStrings{};
+  auto table = ClinvarTable{};
+  auto clinvar = Clinvar{"-", "TTG"};
+  clinvar.clnsig = "PATHOGENIC";
+  clinvar.codon = "R123C";
+  clinvar.geneinfo = "BRCA1:672";
+  clinvar.allele_id = 1234;
+  clinvar.severe = true;
+  clinvar.consequence = true;
+  clinvar.star = 3;
+  clinvar.adar = 'D';
+  table.push_back(100, clinvar, strings);
+  auto other = Clinvar{"A", "T"};
+  other.clnsig = "PATHOGENIC";
+  other.benign = true;
+  table.push_back(100, other, strings);
+
+  // "PATHOGENIC" and the empty codon / geneinfo of `other` are stored once
+  CHECK(strings.size() == 8);
+  REQUIRE(table.size() == 2);
+
+  auto found = table.alleles.find(table.alleles.equal_range(100), "A", "T", strings);
+  REQUIRE(found == size_t{1});
+  CHECK(table.record(1, strings).benign);
+
+  auto record = table.record(0, strings);
+  CHECK(record.ref == "-");
+  CHECK(record.alt == "TTG");
+  CHECK(record.clnsig == "PATHOGENIC");
+  CHECK(record.codon == "R123C");
+  CHECK(record.get_genes() == std::vector<std::string>{"BRCA1"});
+  CHECK(record.allele_id == 1234);
+  CHECK_FALSE(record.onset);
+  CHECK(record.severe);
+  CHECK(record.consequence);
+  CHECK_FALSE(record.benign);
+  CHECK(record.star == 3);
+  CHECK(record.adar == 'D');
+
+  auto view = ClinvarView{table, 0, strings};
+  CHECK(view.ref() == "-");
+  CHECK(view.alt() == "TTG");
+  CHECK(view.codon() == "R123C");
+  CHECK(view.allele_id() == 1234);
+  CHECK(view.consequence());
+  CHECK_FALSE(view.benign());
+  CHECK(ClinvarView{table, 1, strings}.benign());
+  CHECK(view.record().geneinfo == "BRCA1:672");
+}
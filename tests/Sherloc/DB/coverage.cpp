@@ -5,6 +5,12 @@
 #include <algorithm>
 #include <string>
 #include <ranges>
+#include <random>
+#include <set>
+#include <sstream>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
 
 #include <Sherloc/DB/coverage.hpp>
 
@@ -18,10 +24,10 @@ TEST_CASE("new Gnom_coverage correctness"){
     auto cov = DataBaseCoverage{};
     auto cov_vec = std::vector<Coverage>{
         Coverage{0, '0'},
-        Coverage{1, '4'},
+        Coverage{1, '1'},
         Coverage{3, '2'},
         Coverage{70, '3'},
-        Coverage{200, '4'},
+        Coverage{200, '1'},
         Coverage{1000, '2'},
         Coverage{2000, '3'}
     };
@@ -53,3 +59,77 @@ TEST_CASE("new Gnom_coverage correctness"){
         CHECK(cov.find(chr, pos).status == '3');
     }
 }
+
+TEST_CASE("Coverage track matches the runs"){
+    using namespace Sherloc::DB;
+
+    auto gen = std::mt19937{5};
+    auto runs = std::set<Coverage>{Coverage{0, '0'}};
+    auto pos = size_t{0};
+    for(int idx = 0; idx < 5000; ++idx){
+        pos += 1 + gen() % 300;
+        runs.emplace(pos, static_cast<char>('0' + gen() % 4));
+    }
+    auto track = CoverageTrack(runs.begin(), runs.end());
+    REQUIRE(track.size() == runs.size());
+    CHECK(track.bytes() == runs.size() * sizeof(uint32_t));
+
+    auto find_next = track.cursor();
+    for(size_t query = 0; query < pos + 1000; query += 1 + gen() % 97){
+        auto expected = *std::prev(runs.upper_bound(Coverage{query}));
+        auto found = track.find(query);
+        REQUIRE(found.pos == expected.pos);
+        REQUIRE(found.status == expected.status);
+        REQUIRE(find_next(query).pos == expected.pos);
+    }
+
+    CHECK_THROWS_AS(track.push_back(Coverage{pos, '1'}), std::invalid_argument);
+    CHECK_THROWS_AS(track.push_back(Coverage{pos + 1, '4'}), std::invalid_argument);
+    CHECK_THROWS_AS(track.push_back(Coverage{CoverageTrack::max_pos + 1, '1'}), std::invalid_argument);
+}
+
+TEST_CASE("Coverage loads the trees of version 0"){
+    using namespace Sherloc::DB;
+
+    auto trees = std::vector<std::set<Coverage>>{
+        {Coverage{0, '0'}, Coverage{10, '3'}, Coverage{25, '1'}}
+    };
+    auto ss = std::stringstream{};
+    {
+        auto arc = boost::archive::binary_oarchive(ss);
+        auto db_version = BaseDB::VersionType{"old"};
+        auto db_build_time = BaseDB::TimePointType{0};
+        arc & db_version;
+        arc & db_build_time;
+        arc & trees;
+    }
+    auto arc = boost::archive::binary_iarchive(ss);
+    auto cov = DataBaseCoverage{};
+    boost::serialization::serialize_adl(arc, cov, 0);
+    REQUIRE(cov.db_map.size() == 1);
+    CHECK(cov.find("1", 9).status == '0');
+    CHECK(cov.find("1", 10).status == '3');
+    CHECK(cov.find("1", 100).pos == 25);
+}
+
+TEST_CASE("Coverage line parsing"){
+    using namespace Sherloc::DB;
+
+    auto columns = DataBaseCoverage::Columns::from_header("locus\tmean\tmedian_approx\tover_20");
+    CHECK_FALSE(columns.pos.has_value());
+    auto parsed = DataBaseCoverage::parse_line("chr2:12345\t35.5\t36\t0.5", columns);
+    REQUIRE(parsed.has_value());
+    CHECK(parsed->first == "chr2");
+    CHECK(parsed->second.pos == 12345);
+    CHECK(parsed->second.status == Coverage{0, 35.5, 0.5}.status);
+    CHECK_FALSE(DataBaseCoverage::parse_line("chr2:12345\tx\t36\t0.5", columns).has_value());
+    CHECK_FALSE(DataBaseCoverage::parse_line("chr2:12345\t35.5", columns).has_value());
+
+    auto old_columns = DataBaseCoverage::Columns::from_header("chrom\tpos\tmean\tover_20");
+    REQUIRE(old_columns.pos == size_t{1});
+    auto old_parsed = DataBaseCoverage::parse_line("X\t100\t10\t0.05", old_columns);
+    REQUIRE(old_parsed.has_value());
+    CHECK(old_parsed->first == "X");
+    CHECK(old_parsed->second.pos == 100);
+    CHECK(old_parsed->second.status == '0');
+}
@@ -0,0 +1,82 @@
+#include <catch/catch.hpp>
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <Sherloc/DB/db_remote.hpp>
+#include <Sherloc/sherloc_member.hpp>
+
+TEST_CASE("DB remote frames round trip"){
+  using namespace Sherloc::DB;
+
+  int fds[2];
+  REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  auto sher_mem = Sherloc::SherlocMember("1", 16103, "T", "G");
+  sher_mem.variants.resize(2);
+  sher_mem.variants[0].gene_name = "BRCA1";
+  sher_mem.variants[1].gene_name = "NBR2";
+
+  auto request = DBRequest{{AlleleQuery(sher_mem)}};
+  remote::send_frame(fds[0], request);
+
+  auto received = DBRequest{};
+  REQUIRE(remote::recv_frame(fds[1], received));
+  REQUIRE(received.alleles.size() == 1);
+  auto query_mem = received.alleles[0].to_sher_mem();
+  CHECK(query_mem.chr == "1");
+  CHECK(query_mem.pos == 16103);
+  CHECK(query_mem.ref == "T");
+  CHECK(query_mem.alt == "G");
+  REQUIRE(query_mem.variants.size() == 2);
+  CHECK(query_mem.variants[1].gene_name == "NBR2");
+
+  auto answer = AlleleAnswer{};
+  answer.k_af = 0.02f;
+  answer.has_clinvar = true;
+  answer.clinvar.clnsig = "Pathogenic";
+  answer.clinvar.allele_id = 42;
+  answer.gene_info = {'D', 'U'};
+  auto exac = Exac("T", "G");
+  exac.pos = 16103;
+  exac.status = '7';
+  exac.hom = '2';
+  answer.set_exac(exac);
+  answer.coverage = Coverage(16000, '3');
+  remote::send_frame(fds[1], DBResponse{{answer}, ""});
+
+  auto response = DBResponse{};
+  REQUIRE(remote::recv_frame(fds[0], response));
+  REQUIRE(response.answers.size() == 1);
+  auto& got = response.answers[0];
+  CHECK(got.k_af == Approx(0.02f));
+  CHECK(got.has_clinvar);
+  CHECK(got.clinvar.clnsig == "Pathogenic");
+  CHECK(got.clinvar.allele_id == 42);
+  CHECK_FALSE(got.has_dvd);
+  CHECK(got.gene_info == std::vector<char>{'D', 'U'});
+  CHECK(got.get_exac().status == '7');
+  CHECK(got.get_exac().hom == '2');
+  CHECK(got.coverage.status == '3');
+
+  // closing the peer ends the stream
+  ::close(fds[1]);
+  CHECK_FALSE(remote::recv_frame(fds[0], response));
+  ::close(fds[0]);
+}
+
+TEST_CASE("DB remote frame size limit"){
+  using namespace Sherloc::DB;
+
+  int fds[2];
+  REQUIRE(::socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+
+  // a length above the limit is rejected before its payload is allocated
+  auto size = remote::max_frame_size + 1;
+  remote::write_all(fds[0], reinterpret_cast<const char*>(&size), sizeof(size));
+  auto request = DBRequest{};
+  CHECK_THROWS_AS(remote::recv_frame(fds[1], request), std::runtime_error);
+
+  ::close(fds[0]);
+  ::close(fds[1]);
+}
@@ -27,14 +27,15 @@ TEST_CASE("Test DVD"){
     auto dvd_loaded = DataBaseDVD{};
     dvd_loaded.load(dvd_tmp_arc);
     CHECK(dvd_loaded.db_map.size() == dvd.db_map.size());
-    for(auto& [chr, vec] : dvd_loaded.db_map){
+    CHECK(dvd_loaded.strings.size() == dvd.strings.size());
+    for(auto& [chr, table] : dvd_loaded.db_map){
       REQUIRE(dvd.db_map.contains(chr));
-      CHECK(dvd.db_map.at(chr).size() == vec.size());
+      CHECK(dvd.db_map.at(chr).size() == table.size());
     }
   }
 
-  for(auto& [chr, vec] : dvd.db_map){
-    CHECK(std::ranges::is_sorted(vec, {}, &DataBaseDVD::PosDVD::first));
+  for(auto& [chr, table] : dvd.db_map){
+    CHECK(std::ranges::is_sorted(table.alleles.positions));
   }
 
   SECTION("Pathogenic case"){
@@ -134,4 +135,60 @@ TEST_CASE("Test DVD"){
     CHECK_FALSE(same2->consequence);
     CHECK_FALSE(same2->benign);
   }
-}
\ No newline at end of file
+
+  SECTION("Batch lookup"){
+    // the records of the sections above and misses, sorted by position
+    auto sher_mems = std::vector<Sherloc::SherlocMember>{
+      {"1", 1000, "A", "T"},
+      {"1", 6425205, "G", "T"},
+      {"1", 6425219, "G", "A"},
+      {"1", 6426293, "C", "-"},
+      {"1", 6426487, "G", "A"},
+      {"1", 6426487, "G", "C"},
+      {"1", 6426487, "G", "T"},
+      {"2", 1000, "A", "T"}
+    };
+    auto batch = dvd.find_batch(sher_mems);
+    REQUIRE(batch.size() == sher_mems.size());
+    auto hits = 0;
+    for(size_t idx = 0; idx < sher_mems.size(); ++idx){
+      auto expected = dvd.find(sher_mems[idx]);
+      REQUIRE(batch[idx].has_value() == expected.has_value());
+      if(expected.has_value()){
+        CHECK(batch[idx]->consequence == expected->consequence);
+        CHECK(batch[idx]->benign == expected->benign);
+        ++hits;
+      }
+    }
+    CHECK(hits == 5);
+  }
+}
+TEST_CASE("DVD tables flat round trip"){
+  using namespace Sherloc::DB;
+
+  auto dvd = DataBaseDVD{};
+  auto record = DVD{"G", "A"};
+  record.gene_symbol = "ESPN";
+  record.clnsig = "PATHOGENIC";
+  record.consequence = true;
+  record.adar = 'R';
+  dvd.db_map[0].push_back(6425219, record, dvd.strings);
+  dvd.db_map[0].push_back(6425300, DVD{"-", "T"}, dvd.strings);
+
+  auto tmp_arc = std::filesystem::temp_directory_path() / "holmes_test_dvd_tables.arc";
+  dvd.save(tmp_arc);
+  auto loaded = DataBaseDVD{};
+  loaded.load(tmp_arc);
+
+  auto found = loaded.find("1", 6425219, "G", "A");
+  REQUIRE(found.has_value());
+  CHECK(found->gene_symbol == "ESPN");
+  CHECK(found->clnsig == "PATHOGENIC");
+  CHECK(found->consequence);
+  CHECK_FALSE(found->benign);
+  CHECK(found->adar == 'R');
+  CHECK(loaded.find("1", 6425301, "-", "T").has_value()); // indel shift
+  CHECK(loaded.get_gene_symbol("1", 6425219) == "ESPN");
+  CHECK_FALSE(loaded.find("1", 6425219, "G", "C").has_value());
+  std::filesystem::remove(tmp_arc);
+}
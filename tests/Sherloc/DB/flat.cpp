@@ -0,0 +1,156 @@
+#include <catch/catch.hpp>
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Sherloc/DB/db.hpp>
+
+namespace {
+
+struct LegacyTable {
+  std::vector<uint32_t> positions;
+  std::vector<std::string> alts;
+  std::map<std::string, std::vector<size_t>> index;
+  std::string version;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & positions;
+    ar & alts;
+    ar & index;
+    ar & version;
+  }
+};
+
+struct FlatTable {
+  Sherloc::DB::FlatArray<uint32_t> positions;
+  Sherloc::DB::FlatStrings alts;
+  std::map<std::string, std::vector<size_t>> index;
+  std::string version;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & positions;
+    ar & alts;
+    ar & index;
+    ar & version;
+  }
+};
+
+// the same class before and after a layout change (class version 1 adds `extra`)
+struct RecordV0 {
+  uint32_t value = 0;
+
+  HOLMES_SERIALIZE(ar, _ver){
+    ar & value;
+  }
+};
+
+struct RecordV1 {
+  uint32_t value = 0;
+  uint32_t extra = 7;
+
+  HOLMES_SERIALIZE(ar, version){
+    ar & value;
+    if(version > 0){
+      ar & extra;
+    }
+  }
+};
+
+auto make_flat_table(){
+  auto table = FlatTable{};
+  for(uint32_t pos = 0; pos < 1000; ++pos){
+    table.positions.push_back(pos * 3);
+    table.alts.emplace_back(std::string(pos % 7, 'A'));
+  }
+  table.index["BRCA1"] = {1, 2, 3};
+  table.index["TP53"] = {};
+  table.version = "v1";
+  return table;
+}
+
+}
+
+BOOST_CLASS_VERSION(RecordV1, 1)
+
+TEST_CASE("Flat file save & mapped load"){
+  using namespace Sherloc::DB;
+  auto file = std::filesystem::temp_directory_path() / "flat_table.arc";
+
+  auto table = make_flat_table();
+  save_flat_to(table, file);
+  REQUIRE(is_flat_file(file));
+
+  auto loaded = FlatTable{};
+  load_archive_from(loaded, file);
+
+  CHECK(loaded.positions.is_mapped());
+  CHECK(reinterpret_cast<uintptr_t>(loaded.positions.data()) % alignof(uint32_t) == 0);
+  REQUIRE(loaded.positions.size() == 1000);
+  REQUIRE(loaded.alts.size() == 1000);
+  CHECK(std::ranges::equal(loaded.positions, table.positions));
+  for(size_t idx = 0; idx < 1000; ++idx){
+    CHECK(loaded.alts[idx] == table.alts[idx]);
+  }
+  CHECK(loaded.index == table.index);
+  CHECK(loaded.version == "v1");
+
+  // appending to a mapped array copies it
+  loaded.positions.push_back(5000);
+  CHECK_FALSE(loaded.positions.is_mapped());
+  CHECK(loaded.positions.size() == 1001);
+  CHECK(loaded.positions[999] == 2997);
+}
+
+TEST_CASE("Flat containers load boost archives of std containers"){
+  using namespace Sherloc::DB;
+  auto file = std::filesystem::temp_directory_path() / "legacy_table.arc";
+
+  auto legacy = LegacyTable{{1, 5, 9}, {"A", "", "CTT"}, {{"GENE", {4}}}, "v0"};
+  save_archive_to(legacy, file);
+  REQUIRE_FALSE(is_flat_file(file));
+
+  auto loaded = FlatTable{};
+  load_archive_from(loaded, file);
+  CHECK_FALSE(loaded.positions.is_mapped());
+  CHECK(std::ranges::equal(loaded.positions, legacy.positions));
+  REQUIRE(loaded.alts.size() == 3);
+  CHECK(loaded.alts[0] == "A");
+  CHECK(loaded.alts[1] == "");
+  CHECK(loaded.alts[2] == "CTT");
+  CHECK(loaded.index == legacy.index);
+
+  // and back again
+  save_archive_to(loaded, file);
+  auto reloaded = LegacyTable{};
+  load_archive_from(reloaded, file);
+  CHECK(reloaded.positions == legacy.positions);
+  CHECK(reloaded.alts == legacy.alts);
+  CHECK(reloaded.version == "v0");
+}
+
+TEST_CASE("Flat files store the class versions"){
+  using namespace Sherloc::DB;
+  auto file = std::filesystem::temp_directory_path() / "flat_versioned.arc";
+
+  // written at version 0, read by the version 1 layout
+  auto old_records = std::vector<RecordV0>{{3}, {5}};
+  save_flat_to(old_records, file);
+  auto converted = std::vector<RecordV1>{};
+  load_archive_from(converted, file);
+  REQUIRE(converted.size() == 2);
+  CHECK(converted[1].value == 5);
+  CHECK(converted[1].extra == 7);
+
+  auto records = std::vector<RecordV1>{{4, 9}};
+  save_flat_to(records, file);
+  auto loaded = std::vector<RecordV1>{};
+  load_archive_from(loaded, file);
+  REQUIRE(loaded.size() == 1);
+  CHECK(loaded[0].extra == 9);
+
+  // a newer class version than this build
+  auto downgraded = std::vector<RecordV0>{};
+  CHECK_THROWS_AS(load_archive_from(downgraded, file), std::runtime_error);
+}
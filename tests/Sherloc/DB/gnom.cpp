@@ -0,0 +1,235 @@
+#include <catch/catch.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <Sherloc/DB/gnom.hpp>
+#include <Sherloc/sherloc_member.hpp>
+
+namespace {
+
+// a chunk holding `n` snps, so its bytes are n * (sizeof(PositionType) + sizeof(StatusType))
+auto make_chunk(size_t n){
+  auto chunk = std::make_shared<Sherloc::DB::Gnom_alt>();
+  for(size_t idx = 0; idx < n; ++idx){
+    chunk->db_vec_snp.emplace_back(idx);
+    chunk->db_vec_snp_status.emplace_back(0);
+  }
+  return chunk;
+}
+
+}
+
+TEST_CASE("gnomAD chunk cache LRU"){
+  using namespace Sherloc::DB;
+  using Key = GnomChunkCache::Key;
+
+  auto loads = std::atomic<int>{0};
+  auto chunk_bytes = make_chunk(100)->bytes();
+  auto cache = GnomChunkCache([&](const Key& key) -> GnomChunkCache::ChunkPtr {
+    ++loads;
+    return key.second == 99 ? nullptr : make_chunk(100);
+  }, chunk_bytes * 2);
+
+  auto c0 = cache.get({0, 0});
+  REQUIRE(c0 != nullptr);
+  CHECK(c0->db_vec_snp.size() == 100);
+  CHECK(cache.get({0, 0}) == c0);
+  CHECK(loads == 1);
+
+  cache.get({0, 1});
+  cache.get({0, 0}); // (0, 1) is now the least recently used
+  cache.get({0, 2}); // evicts (0, 1)
+  CHECK(cache.size() == 2);
+  CHECK(cache.bytes_used() == chunk_bytes * 2);
+  CHECK(cache.get_stats().evictions == 1);
+
+  cache.get({0, 0});
+  CHECK(loads == 3);
+  cache.get({0, 1});
+  CHECK(loads == 4);
+
+  // missing chunk files are cached as nullptr
+  CHECK(cache.get({0, 99}) == nullptr);
+  CHECK(cache.get({0, 99}) == nullptr);
+  CHECK(loads == 5);
+
+  auto stats = cache.get_stats();
+  CHECK(stats.misses == 5);
+  CHECK(stats.hits == 4);
+}
+
+TEST_CASE("gnomAD chunk cache prefetch"){
+  using namespace Sherloc::DB;
+  using Key = GnomChunkCache::Key;
+
+  auto loads = std::atomic<int>{0};
+  auto cache = GnomChunkCache([&](const Key& key){
+    ++loads;
+    return make_chunk(key.second + 1);
+  });
+
+  cache.prefetch({1, 3});
+  cache.prefetch({1, 3}); // already loading
+  auto chunk = cache.get({1, 3});
+  REQUIRE(chunk != nullptr);
+  CHECK(chunk->db_vec_snp.size() == 4);
+  CHECK(loads == 1);
+
+  cache.prefetch({1, 3}); // already cached
+  CHECK(loads == 1);
+
+  auto stats = cache.get_stats();
+  CHECK(stats.prefetches == 1);
+  CHECK(stats.prefetch_hits == 1);
+  CHECK(stats.misses == 0);
+}
+
+TEST_CASE("gnomAD chunk cache concurrent get"){
+  using namespace Sherloc::DB;
+  using Key = GnomChunkCache::Key;
+
+  auto loads = std::atomic<int>{0};
+  auto cache = GnomChunkCache([&](const Key& key){
+    ++loads;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    return make_chunk(10);
+  });
+
+  auto chunks = std::vector<GnomChunkCache::ChunkPtr>(16);
+  #pragma omp parallel for num_threads(8)
+  for(int idx = 0; idx < 16; ++idx){
+    chunks[idx] = cache.get({2, static_cast<size_t>(idx % 2)});
+  }
+
+  // each chunk is decoded once and shared by all the threads
+  CHECK(loads == 2);
+  for(int idx = 2; idx < 16; ++idx){
+    CHECK(chunks[idx] == chunks[idx % 2]);
+  }
+  auto stats = cache.get_stats();
+  CHECK(stats.misses == 2);
+  CHECK(stats.hits == 14);
+}
+
+TEST_CASE("gnomAD presence filter"){
+  using namespace Sherloc::DB;
+
+  auto chunk = Gnom_alt{};
+  for(uint32_t idx = 0; idx < 2000; ++idx){
+    chunk.db_vec_snp.push_back(1000 + idx * 5);
+    chunk.db_vec_snp_status.push_back(Gnom_alt::compress_status("ACGT"[idx % 4], '3', '0'));
+  }
+  chunk.db_vec_ins.push_back(1002);
+  chunk.db_vec_ins_alt.emplace_back("TTA");
+  chunk.db_vec_ins_status.push_back(Gnom_alt::compress_status('A', '3', '0'));
+
+  auto filter = AlleleFilter{};
+  filter.add_chunk(2, chunk.key_hashes());
+  CHECK(filter.chunks() == 3);
+
+  // no false negative
+  for(uint32_t idx = 0; idx < 2000; ++idx){
+    auto alt = std::string(1, "ACGT"[idx % 4]);
+    REQUIRE(filter.may_contain(2, Gnom_alt::key_hash(1000 + idx * 5, "A", alt)));
+  }
+  CHECK(filter.may_contain(2, Gnom_alt::key_hash(1002, "-", "TTA")));
+
+  // empty chunks never match
+  CHECK_FALSE(filter.may_contain(0, Gnom_alt::key_hash(1000, "A", "A")));
+  CHECK_FALSE(filter.may_contain(3, Gnom_alt::key_hash(1000, "A", "A")));
+
+  auto false_positives = 0;
+  for(uint32_t idx = 0; idx < 10000; ++idx){
+    false_positives += filter.may_contain(2, Gnom_alt::key_hash(50000 + idx, "-", "GG"));
+  }
+  CHECK(false_positives < 300);
+}
+
+TEST_CASE("gnomAD presence filter from chunk blocks"){
+  using namespace Sherloc::DB;
+
+  // chunks built apart, as the region parallel builder does
+  auto hashes = std::vector<uint64_t>{};
+  for(uint32_t idx = 0; idx < 500; ++idx){
+    hashes.push_back(allele_key_hash('S', idx * 3, "G"));
+  }
+  auto blocks = AlleleFilter::make_blocks(hashes);
+
+  auto filter = AlleleFilter{};
+  filter.append_blocks(0, {});
+  filter.append_blocks(1, blocks);
+  auto same = AlleleFilter{};
+  same.add_chunk(1, hashes);
+  REQUIRE(filter.chunks() == 2);
+  REQUIRE(filter.bytes() == same.bytes());
+  for(auto hash : hashes){
+    REQUIRE(filter.may_contain(1, hash));
+    REQUIRE_FALSE(filter.may_contain(0, hash));
+  }
+  CHECK_THROWS_AS(filter.append_blocks(1, blocks), std::invalid_argument);
+}
+
+TEST_CASE("gnomAD find_batch matches find"){
+  using namespace Sherloc::DB;
+  using Sherloc::SherlocMember;
+
+  auto gnom_dir = std::filesystem::temp_directory_path() / "holmes_test_gnom_batch";
+  std::filesystem::remove_all(gnom_dir);
+  // two chunks of chr1 and one of chr2, no presence filter
+  for(auto [chr, arc_idx] : {std::pair{"1", 0}, {"1", 1}, {"2", 0}}){
+    auto chunk = Gnom_alt{};
+    auto base = static_cast<uint32_t>(arc_idx * DataBaseGnomAD::chunk_size + 1000);
+    for(uint32_t idx = 0; idx < 500; ++idx){
+      chunk.db_vec_snp.push_back(base + idx * 5);
+      chunk.db_vec_snp_status.push_back(Gnom_alt::compress_status("ACGT"[idx % 4], '3' + idx % 5, '1'));
+    }
+    chunk.db_vec_ins.push_back(base + 2);
+    chunk.db_vec_ins_alt.emplace_back("TTA");
+    chunk.db_vec_ins_status.push_back(Gnom_alt::compress_status('A', '7', '2'));
+    chunk.db_vec_del.push_back(base + 3);
+    chunk.db_vec_del_ref.emplace_back("GC");
+    chunk.db_vec_del_status.push_back(Gnom_alt::compress_status('G', '4', '0'));
+    std::filesystem::create_directories(gnom_dir / chr);
+    save_flat_to(chunk, gnom_dir / chr / DataBaseGnomAD::get_arc_name(arc_idx));
+  }
+
+  auto db = DataBaseGnomAD{};
+  db.load(gnom_dir);
+
+  // grouped by chromosome and sorted by position, hits and misses of every kind
+  auto sher_mems = std::vector<SherlocMember>{};
+  for(auto chr : {"1", "2", "3"}){
+    for(auto base : {size_t{1000}, DataBaseGnomAD::chunk_size + 1000}){
+      sher_mems.emplace_back(chr, base, "G", "A");
+      sher_mems.emplace_back(chr, base + 2, "-", "TTA");
+      sher_mems.emplace_back(chr, base + 3, "GC", "-");
+      sher_mems.emplace_back(chr, base + 3, "GA", "-");
+      for(size_t idx = 0; idx < 100; ++idx){
+        sher_mems.emplace_back(chr, base + 5 + idx * 3, "N", std::string(1, "ACGT"[idx % 4]));
+      }
+    }
+  }
+
+  for(auto threads : {1, 4}){
+    auto batch = db.find_batch(sher_mems, threads);
+    REQUIRE(batch.size() == sher_mems.size());
+    auto hits = 0;
+    for(size_t idx = 0; idx < sher_mems.size(); ++idx){
+      auto expected = db.find(sher_mems[idx]);
+      REQUIRE(batch[idx].pos == expected.pos);
+      REQUIRE(batch[idx].ref == expected.ref);
+      REQUIRE(batch[idx].alt == expected.alt);
+      REQUIRE(batch[idx].status == expected.status);
+      REQUIRE(batch[idx].hom == expected.hom);
+      hits += expected.pos != 0;
+    }
+    // at least the snp, insertion and deletion at the start of each chunk
+    CHECK(hits >= 3 * 3);
+  }
+  std::filesystem::remove_all(gnom_dir);
+}
@@ -0,0 +1,130 @@
+#include <catch/catch.hpp>
+
+#include <algorithm>
+#include <filesystem>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <boost/archive/binary_iarchive.hpp>
+#include <boost/archive/binary_oarchive.hpp>
+#include <Sherloc/DB/packed.hpp>
+#include <Sherloc/DB/k.hpp>
+
+namespace {
+
+// sorted positions with repeats, small gaps and a few large jumps
+auto make_positions(size_t n){
+  auto gen = std::mt19937{7};
+  auto positions = std::vector<uint32_t>{};
+  auto pos = uint32_t{100};
+  for(size_t idx = 0; idx < n; ++idx){
+    auto roll = gen() % 100;
+    if(roll < 10){
+      // multi allelic, same position
+    }else if(roll < 12){
+      pos += 1000000 + gen() % 1000000;
+    }else{
+      pos += 1 + gen() % 60;
+    }
+    positions.push_back(pos);
+  }
+  return positions;
+}
+
+}
+
+TEST_CASE("PackedPositions matches the plain positions"){
+  using namespace Sherloc::DB;
+
+  auto plain = make_positions(1000);
+  auto packed = PackedPositions{};
+  for(auto pos : plain){
+    packed.push_back(pos);
+  }
+  REQUIRE(packed.size() == plain.size());
+  CHECK(packed.bytes() < plain.size() * sizeof(uint32_t));
+
+  for(size_t idx = 0; idx < plain.size(); ++idx){
+    REQUIRE(packed[idx] == plain[idx]);
+  }
+
+  auto gen = std::mt19937{11};
+  for(int n = 0; n < 2000; ++n){
+    auto pos = n % 2 ? plain[gen() % plain.size()] : plain.front() + gen() % (plain.back() + 10);
+    auto [s_it, e_it] = std::ranges::equal_range(plain, pos);
+    auto [s_idx, e_idx] = packed.equal_range(pos);
+    REQUIRE(s_idx == static_cast<size_t>(s_it - plain.begin()));
+    REQUIRE(e_idx == static_cast<size_t>(e_it - plain.begin()));
+  }
+
+  auto cursor = PackedCursor(packed);
+  for(auto pos : {uint32_t{0}, plain[5], plain[5], plain[700], plain[300], plain.back() + 1}){
+    auto [s_it, e_it] = std::ranges::equal_range(plain, pos);
+    auto [s_idx, e_idx] = cursor.equal_range(pos);
+    CHECK(s_idx == static_cast<size_t>(s_it - plain.begin()));
+    CHECK(e_idx == static_cast<size_t>(e_it - plain.begin()));
+  }
+
+  CHECK_THROWS_AS(packed.push_back(plain.back() - 1), std::invalid_argument);
+}
+
+TEST_CASE("PackedBases keeps the bases other than ACGT"){
+  using namespace Sherloc::DB;
+
+  auto plain = std::vector<char>{};
+  for(size_t idx = 0; idx < 100; ++idx){
+    plain.push_back(idx == 3 or idx == 40 ? 'N' : "ACGT"[idx * 7 % 4]);
+  }
+  auto packed = PackedBases{};
+  for(auto base : plain){
+    packed.push_back(base);
+  }
+  REQUIRE(packed.size() == plain.size());
+  for(size_t idx = 0; idx < plain.size(); ++idx){
+    CHECK(packed[idx] == plain[idx]);
+  }
+}
+
+TEST_CASE("Packed columns load the plain arrays of version 0"){
+  using namespace Sherloc::DB;
+
+  auto plain = make_positions(300);
+  auto ss = std::stringstream{};
+  {
+    auto arc = boost::archive::binary_oarchive(ss);
+    auto column = FlatArray<uint32_t>(plain);
+    arc & column;
+  }
+  auto arc = boost::archive::binary_iarchive(ss);
+  auto packed = PackedPositions{};
+  serialize_packed(arc, packed, 0);
+  REQUIRE(packed.size() == plain.size());
+  CHECK(packed[0] == plain[0]);
+  CHECK(packed[299] == plain[299]);
+}
+
+TEST_CASE("Packed K flat round trip"){
+  using namespace Sherloc;
+  using namespace Sherloc::DB;
+
+  auto k_db = DataBase1KG{};
+  auto& k = k_db.db_map[0];
+  auto plain = make_positions(500);
+  for(size_t idx = 0; idx < plain.size(); ++idx){
+    k.db_vec_snp.push_back(plain[idx]);
+    k.db_vec_snp_alt.push_back("ACGT"[idx % 4]);
+    k.db_vec_snp_status.push_back(static_cast<float>(idx));
+  }
+
+  auto tmp_arc = std::filesystem::temp_directory_path() / "packed_k.arc";
+  k_db.save(tmp_arc);
+  auto load_k_db = DataBase1KG{};
+  load_k_db.load(tmp_arc);
+
+  for(auto idx : {size_t{0}, size_t{130}, size_t{499}}){
+    auto allele = SherlocMember("1", plain[idx], "A", std::string(1, "ACGT"[idx % 4]));
+    CHECK(load_k_db.find(allele) == k_db.find(allele));
+  }
+  std::filesystem::remove(tmp_arc);
+}
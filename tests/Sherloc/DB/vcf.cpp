@@ -18,6 +18,7 @@ const auto child_vcf = path(DATA_PATH) / "trio/child.vcf";
 const auto dad_vcf = path(DATA_PATH) / "trio/dad.vcf";
 const auto mom_vcf = path(DATA_PATH) / "trio/mom.vcf";
 const auto util_vcf = path(DATA_PATH) / "vcf/util.vcf";
+const auto cohort_vcf = path(DATA_PATH) / "vcf/cohort.vcf";
 
 auto count_db_size(const DataBaseVcf& db){
     auto s = size_t{};
@@ -74,4 +75,112 @@ TEST_CASE("HTS VCF get_fmt"){
         REQUIRE(vcf.parse_line() == HTS_VCF::OK);
         CHECK(vcf.get_fmt() == "::::");
     }
-}
\ No newline at end of file
+}
+TEST_CASE("HTS VCF region query"){
+    auto count_records = [](HTS_VCF& vcf){
+        auto cnt = 0;
+        while(true){
+            auto status = vcf.parse_line();
+            if(status == HTS_VCF::VCF_EOF) break;
+            if(status == HTS_VCF::OK) ++cnt;
+        }
+        return cnt;
+    };
+
+    SECTION("Indexed vcf"){
+        auto vcf = HTS_VCF(path(DATA_PATH) / "clinvar/clinvar_test.annotated.vcf.gz");
+        REQUIRE(vcf.has_index());
+
+        REQUIRE(vcf.query("Y"));
+        CHECK(count_records(vcf) == 20);
+
+        // "chr" prefix is also accepted
+        REQUIRE(vcf.query("chr5:1000000-1300000"));
+        CHECK(count_records(vcf) == 7);
+
+        REQUIRE_FALSE(vcf.query("chrUnknown"));
+        CHECK(vcf.parse_line() == HTS_VCF::VCF_EOF);
+    }
+
+    SECTION("Fallback to sequential scan"){
+        auto vcf = HTS_VCF(dad_vcf);
+        REQUIRE_FALSE(vcf.has_index());
+
+        REQUIRE(vcf.query("1", 1220751, 1221049));
+        CHECK(count_records(vcf) == 2);
+
+        // each query scans again from the first record
+        REQUIRE(vcf.query("1", 1220751, 1221049));
+        CHECK(count_records(vcf) == 2);
+    }
+}
+TEST_CASE("HTS VCF multi-sample"){
+    using GT = std::array<int32_t, 2>;
+    auto vcf = HTS_VCF(cohort_vcf);
+    REQUIRE(vcf.n_samples() == 3);
+    CHECK(vcf.sample_names() == std::vector<std::string>{"S1", "S2", "S3"});
+
+    REQUIRE(vcf.parse_line() == HTS_VCF::OK);
+    CHECK(vcf.record.sample_genotypes == std::vector<GT>{{0, 1}, {0, 0}, {1, 1}});
+    CHECK(vcf.record.genotype == GT{0, 1});
+    CHECK(vcf.get_fmt(0) == "0/1::20:99:");
+    CHECK(vcf.get_fmt(2) == "1/1::25:90:");
+    CHECK(vcf.get_fmt(3) == "::::");
+
+    REQUIRE(vcf.parse_line() == HTS_VCF::OK);
+    CHECK(vcf.record.sample_genotypes == std::vector<GT>{{-1, -1}, {0, 1}, {0, 0}});
+    CHECK(vcf.get_fmt(0) == "./.::.:.:");
+    CHECK(vcf.get_fmt(1) == "0|1::30:70:");
+
+    SECTION("haploid calls keep 0 as the second allele"){
+        REQUIRE(vcf.parse_line() == HTS_VCF::OK);
+        CHECK(vcf.record.sample_genotypes == std::vector<GT>{{1, 0}, {0, 1}, {0, 0}});
+        CHECK(vcf.get_fmt(0) == "1::15:50:");
+    }
+}
+TEST_CASE("HTS VCF record view"){
+    using namespace std::literals;
+    auto vcf = HTS_VCF(dad_vcf);
+    REQUIRE(vcf.parse_view() == HTS_VCF::OK);
+    auto& rec = vcf.view;
+    CHECK(rec.chr == "chr1"sv);
+    CHECK(rec.chr_idx == Sherloc::Attr::ChrMap::chr2idx("1"));
+    CHECK(rec.pos0 == 1216707);
+    CHECK(rec.pos() == 1216708);
+    CHECK(rec.ref == "CT"sv);
+    CHECK(rec.alt == "C"sv);
+    CHECK(rec.genotype == std::array<int32_t, 2>{0, 1});
+
+    CHECK(rec.to_vep_style() == 1216709);
+    CHECK(rec.ref == "T"sv);
+    CHECK(rec.alt == "-"sv);
+
+    SECTION("parse_line fills the same record"){
+        REQUIRE(vcf.parse_line() == HTS_VCF::OK);
+        CHECK(vcf.record.chr == std::string{vcf.view.chr});
+        CHECK(vcf.record.pos == vcf.view.pos());
+        CHECK(vcf.record.ref == "T");
+        CHECK(vcf.record.alt == "C");
+        CHECK(vcf.record.genotype == vcf.view.genotype);
+    }
+}
+TEST_CASE("HTS VCF info by header id"){
+    using namespace std::literals;
+    auto vcf = HTS_VCF(path(DATA_PATH) / "clinvar/clinvar_test.annotated.vcf.gz");
+    auto allele_id = vcf.info2id("ALLELEID");
+    auto clnsig = vcf.info2id("CLNSIG");
+    auto af_esp = vcf.info2id("AF_ESP");
+    REQUIRE(allele_id >= 0);
+    REQUIRE(clnsig >= 0);
+    CHECK(vcf.info2id("NOT_A_TAG") == -1);
+
+    REQUIRE(vcf.parse_view() == HTS_VCF::OK);
+    CHECK(vcf.info_int(allele_id) == 2193183);
+    CHECK(vcf.info_view(clnsig) == "Likely_benign"sv);
+    CHECK(vcf.info_str("CLNSIG") == "Likely_benign");
+    CHECK(vcf.info_int("ALLELEID") == vcf.info_int(allele_id));
+    // absent in this record, type mismatch, and undefined tag
+    CHECK_FALSE(vcf.info_float(af_esp).has_value());
+    CHECK_FALSE(vcf.info_float(allele_id).has_value());
+    CHECK_FALSE(vcf.info_view(-1).has_value());
+}
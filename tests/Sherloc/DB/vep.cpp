@@ -8,14 +8,352 @@
 #include <ranges>
 #include <filesystem>
 #include <random>
+#include <cmath>
+#include <tuple>
+#include <future>
+#include <chrono>
+#include <iterator>
 
 #include <Sherloc/DB/db.hpp>
 #include <Sherloc/DB/vep.hpp>
 #include <Sherloc/sherloc_member.hpp>
 
 using namespace std::filesystem;
+using namespace Sherloc;
 using namespace Sherloc::DB;
 
 TEST_CASE("VEP test"){
     // TODO: 
-}
\ No newline at end of file
+}
+TEST_CASE("VEP parsed variants round trip"){
+    auto header_index = Sherloc::Attr::make_header_index(
+        "Allele|Consequence|SYMBOL|Gene|Feature|EXON|INTRON|HGVSc|HGVSp|CDS_position|Protein_position"
+        "|Amino_acids|STRAND|SIFT|PolyPhen|HGVSg|CADD_PHRED|MaxEntScan_alt|MaxEntScan_diff|MaxEntScan_ref|NMD|REVEL|pLI_gene_value",
+        Sherloc::Attr::delimiter('|'));
+    auto csqs = std::vector<std::string>{
+        "T|splice_region_variant&missense_variant|SAMD11|ENSG00000187634|ENST00000341065.8|1/12||c.4C>T|p.His2Tyr|4|2"
+        "|H/Y|1|deleterious(0.02)|benign(0.044)|chr1:g.930314C>T|22.4|7.1|-1.5|8.6|NMD_escaping_variant|0.103|0.00,"
+        "T|upstream_gene_variant|LOC107985728|107985728|NR_168405.1||3/5|||||||-1||||||||||",
+        ""
+    };
+
+    auto parsed = VEP::ParsedVariants{};
+    for(auto& csq : csqs){
+        parsed.push_back(Sherloc::Variant::make_variants(header_index, csq));
+    }
+    REQUIRE(parsed.size() == csqs.size());
+
+    auto same = [](const Sherloc::Variant& l, const Sherloc::Variant& r){
+        auto same_score = [](double a, double b){ return (std::isnan(a) and std::isnan(b)) or a == b; };
+        return l.feature_strand == r.feature_strand and l.sift == r.sift and l.poly == r.poly
+            and l.mes_empty == r.mes_empty and l.mes == r.mes and l.might_escape_nmd == r.might_escape_nmd
+            and same_score(l.mes_score, r.mes_score) and same_score(l.pli, r.pli)
+            and same_score(l.revel_score, r.revel_score) and same_score(l.cadd_phred_score, r.cadd_phred_score)
+            and l.cds_pos == r.cds_pos and l.aa_pos == r.aa_pos
+            and l.gene_name == r.gene_name and l.gene == r.gene and l.trans == r.trans
+            and l.type == r.type and l.extra_info == r.extra_info
+            and l.sub_feat.has == r.sub_feat.has and l.sub_feat.is_exon == r.sub_feat.is_exon
+            and l.sub_feat.idx == r.sub_feat.idx and l.sub_feat.total == r.sub_feat.total
+            and l.hgvsc == r.hgvsc and l.hgvsp == r.hgvsp and l.hgvsg == r.hgvsg and l.codon == r.codon;
+    };
+    for(size_t idx = 0; idx < csqs.size(); ++idx){
+        auto expected = Sherloc::Variant::make_variants(header_index, csqs[idx]);
+        auto variants = parsed.variants(idx);
+        REQUIRE(variants.size() == expected.size());
+        for(size_t i = 0; i < variants.size(); ++i){
+            CHECK(same(variants[i], expected[i]));
+        }
+    }
+
+    auto first = parsed.variants(0);
+    CHECK(first[0].type == std::vector<std::string>{"splice_region_variant", "missense_variant"});
+    CHECK(first[0].might_escape_nmd);
+    CHECK(std::isnan(first[1].revel_score));
+    CHECK_FALSE(first[1].sub_feat.is_exon);
+    CHECK(first[1].sub_feat.total == 5);
+}
+
+TEST_CASE("VEP cache blocks"){
+    // positions 10, 20, 20, 30, ... cut into blocks of 2 rows, the alleles of 20 stay together
+    auto alleles = std::vector<std::tuple<int64_t, std::string, std::string>>{
+        {10, "A", "C"}, {20, "A", "G"}, {20, "A", "T"}, {30, "C", "G"},
+        {40, "G", "T"}, {50, "T", "A"}, {60, "T", "C"}
+    };
+    auto writer = VEP::BlockWriter(2);
+    for(auto& [pos, ref, alt] : alleles){
+        auto record = HTS_VCF::VCF_Record{};
+        record.pos = pos;
+        record.ref = ref;
+        record.alt = alt;
+        writer.add_row(record, fmt::format("csq_{}_{}_{}", pos, ref, alt));
+    }
+    writer.flush();
+
+    auto& blocked = writer.table;
+    REQUIRE(blocked.size() == 3);
+    CHECK(std::vector<VEP::PosType>(blocked.first_positions.begin(), blocked.first_positions.end())
+        == std::vector<VEP::PosType>{10, 30, 50});
+    CHECK(std::vector<VEP::PosType>(blocked.last_positions.begin(), blocked.last_positions.end())
+        == std::vector<VEP::PosType>{20, 40, 60});
+    CHECK(blocked.find_block(20) == 0);
+    CHECK(blocked.find_block(45) == std::nullopt);
+    CHECK(blocked.find_block(60) == 2);
+    CHECK(blocked.find_block(5) == std::nullopt);
+    CHECK(blocked.block(0).records[2] == "csq_20_A_T");
+
+    SECTION("Unsorted rows are rejected"){
+        auto record = HTS_VCF::VCF_Record{};
+        record.pos = 55;
+        record.ref = "A";
+        record.alt = "C";
+        writer.add_row(record, "");
+        CHECK_THROWS_AS(writer.flush(), std::invalid_argument);
+    }
+
+    SECTION("Lookups decompress only the hit blocks"){
+        auto dir = temp_directory_path() / "holmes_test_vep_cache";
+        create_directories(dir);
+        save_flat_to(blocked, dir / "1.blocks.arc");
+
+        auto cache = VEP{};
+        cache.set_output_dir(dir);
+        cache.set_block_cache(1); // keep only the last block
+        CHECK(cache.find(SherlocMember("1", 20, "A", "T")) == "csq_20_A_T");
+        CHECK(cache.find(SherlocMember("1", 20, "A", "C")) == std::nullopt);
+        CHECK(cache.find(SherlocMember("2", 20, "A", "T")) == std::nullopt);
+
+        auto sher_mems = std::vector<SherlocMember>{
+            {"1", 10, "A", "C"}, {"1", 45, "A", "C"}, {"1", 50, "T", "A"}, {"1", 60, "T", "C"}
+        };
+        auto batch = cache.find_batch(sher_mems);
+        REQUIRE(batch.size() == sher_mems.size());
+        CHECK(batch[0] == "csq_10_A_C");
+        CHECK(batch[1] == std::nullopt);
+        CHECK(batch[2] == "csq_50_T_A"); // still valid after its block was evicted
+        CHECK(batch[3] == "csq_60_T_C");
+
+        remove_all(dir);
+    }
+}
+
+TEST_CASE("VEP cache delta segments"){
+    using Alleles = std::vector<std::tuple<int64_t, std::string, std::string>>;
+    auto make_blocks = [](const Alleles& alleles, std::string_view tag){
+        auto writer = VEP::BlockWriter(2);
+        for(auto& [pos, ref, alt] : alleles){
+            auto record = HTS_VCF::VCF_Record{};
+            record.pos = pos;
+            record.ref = ref;
+            record.alt = alt;
+            writer.add_row(record, fmt::format("{}_{}", tag, pos));
+        }
+        writer.flush();
+        return std::move(writer.table);
+    };
+
+    auto dir = temp_directory_path() / "holmes_test_vep_delta";
+    remove_all(dir);
+    create_directories(dir);
+    auto save = [&dir, &make_blocks](const Alleles& alleles, std::string_view tag, std::string_view filename){
+        auto blocked = make_blocks(alleles, tag);
+        save_flat_to(blocked, dir / filename);
+    };
+    save({{10, "A", "C"}, {20, "A", "G"}, {30, "C", "G"}}, "base", "1.blocks.arc");
+    save({{15, "G", "T"}, {20, "A", "G"}}, "delta0", "1.delta.0.arc");
+    save({{40, "T", "A"}}, "delta1", "1.delta.1.arc");
+    save({{5, "T", "A"}}, "delta0", "2.delta.0.arc");
+
+    auto check = [](VEP& cache){
+        CHECK(cache.find(SherlocMember("1", 15, "G", "T")) == "delta0_15");
+        CHECK(cache.find(SherlocMember("1", 20, "A", "G")) == "base_20"); // the base is kept
+        CHECK(cache.find(SherlocMember("1", 40, "T", "A")) == "delta1_40");
+        CHECK(cache.find(SherlocMember("2", 5, "T", "A")) == "delta0_5");
+
+        auto sher_mems = std::vector<SherlocMember>{
+            {"1", 10, "A", "C"}, {"1", 15, "G", "T"}, {"1", 35, "A", "C"}, {"1", 40, "T", "A"}
+        };
+        auto batch = cache.find_batch(sher_mems);
+        CHECK(batch[0] == "base_10");
+        CHECK(batch[1] == "delta0_15");
+        CHECK(batch[2] == std::nullopt);
+        CHECK(batch[3] == "delta1_40");
+
+        auto inserted = sher_mems;
+        auto hits = cache.try_insert_batch(inserted);
+        CHECK(hits == std::vector<bool>{true, true, false, true});
+        CHECK(inserted[1].variants.size() == 1); // the CSQ string "delta0_15" parsed
+        CHECK(inserted[2].variants.empty());
+    };
+
+    auto cache = VEP{};
+    cache.set_output_dir(dir);
+    check(cache);
+
+    cache.compact();
+    CHECK_FALSE(exists(dir / "1.delta.0.arc"));
+    CHECK_FALSE(exists(dir / "1.delta.1.arc"));
+    CHECK(exists(dir / "2.blocks.arc"));
+    check(cache);
+
+    auto merged = VEP::BlockedTable{};
+    load_archive_from(merged, dir / "1.blocks.arc");
+    auto rows = size_t{0};
+    for(size_t idx = 0; idx < merged.size(); ++idx){
+        rows += merged.block(idx).size();
+    }
+    CHECK(rows == 5);
+
+    remove_all(dir);
+}
+
+TEST_CASE("VEP cache write back"){
+    auto dir = temp_directory_path() / "holmes_test_vep_write_back";
+    remove_all(dir);
+    create_directories(dir);
+
+    auto row = [](int64_t pos, std::string ref, std::string alt){
+        auto record = HTS_VCF::VCF_Record{};
+        record.pos = pos;
+        record.ref = std::move(ref);
+        record.alt = std::move(alt);
+        return record;
+    };
+    auto new_rows = VEP::TablesType{};
+    new_rows[Attr::ChrMap::chr2idx("1")].add_row(row(15, "G", "T"), "new_15");
+
+    SECTION("A cache without the parsed key keeps the variants of its base"){
+        auto writer = VEP::BlockWriter(2);
+        writer.add_row(row(10, "A", "C"), "base_10");
+        writer.pending.variants.push_back(std::vector<Variant>(1));
+        writer.flush();
+        save_flat_to(writer.table, dir / "1.blocks.arc");
+
+        auto cache = VEP{};
+        cache.set_output_dir(dir);
+        cache.write_back(new_rows);
+        auto delta = VEP::BlockedTable{};
+        load_archive_from(delta, dir / "1.delta.0.arc");
+        CHECK(delta.block(0).variants.size() == 1);
+
+        cache.compact();
+        auto merged = VEP::BlockedTable{};
+        load_archive_from(merged, dir / "1.blocks.arc");
+        CHECK(merged.block(0).variants.size() == 2);
+
+        auto sher_mem = SherlocMember("1", 15, "G", "T");
+        CHECK(cache.try_insert_into(sher_mem));
+        CHECK(sher_mem.variants.size() == 1);
+    }
+
+    SECTION("A write back waits for the lock and renames its segment in place"){
+        auto cache = VEP{};
+        cache.set_output_dir(dir);
+        auto written = std::future<void>{};
+        {
+            auto lock = VEP::DirLock(dir, true); // e.g. a compaction in another process
+            written = std::async(std::launch::async, [&cache, &new_rows]{ cache.write_back(new_rows); });
+            CHECK(written.wait_for(std::chrono::milliseconds(200)) == std::future_status::timeout);
+            CHECK_FALSE(exists(dir / "1.delta.0.arc"));
+        }
+        written.get();
+        CHECK(exists(dir / "1.delta.0.arc"));
+        for(auto& entry : directory_iterator(dir)){
+            CHECK_FALSE(entry.path().extension() == ".tmp");
+        }
+        CHECK(cache.find(SherlocMember("1", 15, "G", "T")) == "new_15");
+
+        cache.write_back(new_rows); // the next segment of the chromosome
+        CHECK(exists(dir / "1.delta.1.arc"));
+    }
+
+    remove_all(dir);
+}
+
+TEST_CASE("VEP cache write back of a VEP output"){
+    // the ClinVar test data is a VEP annotated VCF
+    auto vep_output = path(DATA_PATH) / "clinvar/clinvar_test.annotated.vcf.gz";
+    auto dir = temp_directory_path() / "holmes_test_vep_write_back_output";
+    remove_all(dir);
+
+    auto cache = VEP{};
+    cache.set_output_dir(dir);
+    cache.set_store_parsed(true);
+    cache.from(vep_output);
+    cache.save(dir);
+    auto allele = SherlocMember("1", 69134, "A", "G");
+    auto csq = std::string{cache.find(allele).value_or("")};
+    REQUIRE(csq.starts_with("G|missense_variant|MODERATE|OR4F5"));
+
+    // chromosome 1 is dropped from the base, then comes back from the VEP output
+    cache = VEP{};
+    cache.load(dir);
+    remove(dir / "1.blocks.arc");
+    CHECK(cache.find(allele) == std::nullopt);
+    cache.write_back(vep_output);
+    CHECK(exists(dir / "1.delta.0.arc"));
+    CHECK(cache.find(allele) == csq);
+
+    cache.compact();
+    CHECK_FALSE(exists(dir / "1.delta.0.arc"));
+    auto sher_mem = allele;
+    REQUIRE(cache.try_insert_into(sher_mem));
+    REQUIRE_FALSE(sher_mem.variants.empty());
+    CHECK(sher_mem.variants[0].gene_name == "OR4F5");
+
+    remove_all(dir);
+}
+
+TEST_CASE("VEP process pipes"){
+    SECTION("The output streams back while the command runs"){
+        // more than the stdio buffer of `tr`, so it writes some before its input ends
+        auto lines = 4000;
+        auto input = std::string{};
+        for(int i = 0; i < lines; ++i){
+            input += "chr1\tacgt\n";
+        }
+        auto copy_file = temp_directory_path() / "holmes_test_vep_process_copy.vcf";
+        auto process = VEPProcess("tr a-z A-Z", copy_file);
+        process.write(input);
+
+        auto output = std::ifstream(process.output_path());
+        auto line = std::string{};
+        REQUIRE(std::getline(output, line)); // stdin still open
+        CHECK(line == "CHR1\tACGT");
+
+        process.close_input();
+        auto read = 1;
+        while(std::getline(output, line)){
+            ++read;
+        }
+        CHECK(read == lines);
+        CHECK(process.wait() == 0);
+
+        auto copy = std::ifstream(copy_file);
+        auto copied = std::string(std::istreambuf_iterator<char>(copy), {});
+        CHECK(copied.size() == input.size());
+        CHECK(copied.starts_with("CHR1\tACGT\n"));
+        remove(copy_file);
+    }
+
+    SECTION("A failed command of the pipeline is reported, not only the last one"){
+        auto process = VEPProcess(std::vector<std::string>{"cat; exit 3", "tr a-z A-Z"});
+        process.write("acgt\n");
+        process.close_input();
+        auto output = std::ifstream(process.output_path());
+        auto line = std::string{};
+        REQUIRE(std::getline(output, line));
+        CHECK(line == "ACGT");
+        auto status = process.wait();
+        CHECK(WIFEXITED(status));
+        CHECK(WEXITSTATUS(status) == 3);
+    }
+
+    SECTION("A command exiting early fails the write, not the caller"){
+        auto process = VEPProcess("exit 3");
+        auto input = std::string(size_t{1} << 20, 'A');
+        CHECK_THROWS_AS(process.write(input), std::runtime_error);
+        auto status = process.wait();
+        CHECK(WIFEXITED(status));
+        CHECK(WEXITSTATUS(status) == 3);
+    }
+}
@@ -0,0 +1,94 @@
+#include <catch/catch.hpp>
+
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iterator>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <Sherloc/app/sherloc/pipeline.hpp>
+#include <Sherloc/app/sherloc/filemaker.hpp>
+
+using namespace Sherloc::app::sherloc;
+
+TEST_CASE("Bounded queue keeps the order between stages"){
+    auto first = BoundedQueue<int>{1};
+    auto second = BoundedQueue<int>{1};
+
+    // the stages return their results, the assertions stay on this thread
+    auto producer = std::async(std::launch::async, [&first]{
+        auto pushed = 0;
+        for(int i = 0; i < 100; ++i){
+            pushed += first.push(i);
+        }
+        first.close();
+        return pushed;
+    });
+    auto doubler = std::async(std::launch::async, [&first, &second]{
+        while(auto item = first.pop()){
+            second.push(*item * 2);
+        }
+        second.close();
+    });
+
+    auto results = std::vector<int>{};
+    while(auto item = second.pop()){
+        results.push_back(*item);
+    }
+    CHECK(producer.get() == 100);
+    doubler.get();
+
+    REQUIRE(results.size() == 100);
+    for(int i = 0; i < 100; ++i){
+        CHECK(results[i] == i * 2);
+    }
+}
+
+TEST_CASE("Bounded queue close releases the stages"){
+    auto queue = BoundedQueue<int>{2};
+    CHECK(queue.push(1));
+    CHECK(queue.push(2));
+
+    // a producer blocked on the full queue gives up once the consumer closes it
+    auto producer = std::async(std::launch::async, [&queue]{ return queue.push(3); });
+    queue.close();
+    CHECK_FALSE(producer.get());
+
+    // the queued items are still drained
+    CHECK(queue.pop() == 1);
+    CHECK(queue.pop() == 2);
+    CHECK(queue.pop() == std::nullopt);
+}
+
+TEST_CASE("VEP output of several chromosomes is split per chromosome"){
+    using namespace std::filesystem;
+    auto dir = temp_directory_path() / "holmes_test_vep_split";
+    remove_all(dir);
+    create_directories(dir);
+    {
+        auto os = std::ofstream(dir / "run.vcf");
+        os << "##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"
+           << "chr1\t100\t0\tA\tC\t.\t.\tCSQ=a\n"
+           << "chr2\t200\t0\tG\tT\t.\t.\tCSQ=b\n"
+           << "chr1\t300\t1\tA\tG\t.\t.\tCSQ=c\n";
+    }
+    auto read = [](const path& file){
+        auto is = std::ifstream(file);
+        return std::string(std::istreambuf_iterator<char>(is), {});
+    };
+    auto header = std::string{"##fileformat=VCFv4.2\n#CHROM\tPOS\tID\tREF\tALT\tQUAL\tFILTER\tINFO\n"};
+
+    FileMaker::split_by_chrom(dir / "run.vcf", {
+        {"chr1", dir / "vep_chr1.vcf"}, {"chr2", dir / "vep_chr2.vcf"}, {"chr3", dir / "vep_chr3.vcf"}
+    });
+    CHECK(read(dir / "vep_chr1.vcf") == header
+        + "chr1\t100\t0\tA\tC\t.\t.\tCSQ=a\nchr1\t300\t1\tA\tG\t.\t.\tCSQ=c\n");
+    CHECK(read(dir / "vep_chr2.vcf") == header + "chr2\t200\t0\tG\tT\t.\t.\tCSQ=b\n");
+    CHECK(read(dir / "vep_chr3.vcf") == header); // no record left after the filter
+
+    CHECK_THROWS_AS(FileMaker::split_by_chrom(dir / "run.vcf", {{"chr1", dir / "vep_chr1.vcf"}}),
+        std::runtime_error);
+    remove_all(dir);
+}